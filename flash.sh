@@ -3,6 +3,8 @@
 set -e -o pipefail
 
 CHUNK_SIZE=64
+# Factory app partition
+APP_OFFSET=0x20000
 
 idf.py build
 
@@ -14,12 +16,12 @@ done)
 esptool.py -p /dev/ttyACM* -b 460800 --before default_reset --after no_reset --chip esp32s3  write_flash --flash_mode dio --flash_size detect --flash_freq 80m --no-compress \
 	0x0 build/bootloader/bootloader.bin \
 	0x10000 build/partition_table/partition-table.bin \
-	0xfe000 build/ota_data_initial.bin
+	0x1e000 build/ota_data_initial.bin
 
 for i in `seq 0 $((fin - 1))`; do
 	for try in `seq 3`; do
 		esptool.py -p /dev/ttyACM* -b 460800 --before default_reset --after $([ $i -eq $((fin - 1)) ] && echo hard_reset || echo no_reset) --chip esp32s3  write_flash --flash_mode dio --flash_size detect --flash_freq 80m --no-compress \
-			$((1048576 + 4096 * $CHUNK_SIZE * $i)) build/oled_nametag$i.bin && break || (echo "Upload try $try for chunk $i failed, retrying..." && [ $try -lt 3 ] && sleep 3)
+			$((APP_OFFSET + 4096 * $CHUNK_SIZE * $i)) build/oled_nametag$i.bin && break || (echo "Upload try $try for chunk $i failed, retrying..." && [ $try -lt 3 ] && sleep 3)
 	done
 done
 
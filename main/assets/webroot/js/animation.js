@@ -13,46 +13,18 @@ $(function() {
 
     var reader = new FileReader();
     reader.onload = function(event) {
-      var data = event.target.result;
-      var view = new Uint8Array(data);
-      var hex = encodeHex(view);
-      var encodedFilename = encodeURIComponent(file.name);
-
-      $.ajax({
-        url: "/api/v1/upload_animation?filename=" + encodedFilename,
-        method: "POST",
-        contentType: "application/x-www-form-urlencoded",
-        data: hex,
-        dataType: "json",
-        xhr: function() {
-          var xhr = $.ajaxSettings.xhr();
-
-          xhr.upload.onprogress = function(event) {
-            if (event.lengthComputable) {
-              var progress = Math.ceil(event.loaded / event.total * 100)
-
-              $(".js-upload-progress").css("width", progress + "%").attr("aria-valuenow", progress);
-              console.log("Progress: " + event.loaded / event.total);
-            }
-          };
-
-          return xhr;
-        }
-      })
-      .done(function() {
-        location.reload(true);
-      })
-      .fail(function(xhr) {
-        $(".js-upload-progress").addClass("bg-danger");
-        if (xhr.responseJSON && xhr.responseJSON["error"]) {
-          addToast("Upload failed", xhr.responseJSON["error"]);
-        } else {
-          addToast("Upload failed", xhr.statusText);
+      var data = new Uint8Array(event.target.result);
+
+      uploadAnimation(file.name, data, function(error) {
+        if (error) {
+          $(".js-upload-progress").addClass("bg-danger");
+          addToast("Upload failed", error);
         }
-      })
-      .always(function() {
         $(".js-upload-progress").css("width", "100%").attr("aria-valuenow", "100");
         $(".js-modal-upload").modal('hide');
+        if (!error) {
+          location.reload(true);
+        }
       });
     };
     $(".js-modal-upload").modal('show');
@@ -63,6 +35,47 @@ $(function() {
     return false;
   });
 
+  $(".js-preview-animation").click(function(event) {
+    var file = $(".js-upload-animation-file")[0].files[0];
+
+    event.preventDefault();
+    if (!file) {
+      return false;
+    }
+
+    // Played from RAM, nothing is written to flash until the preview is saved
+    $.ajax({
+      url: "/api/v1/preview_animation",
+      method: "POST",
+      contentType: "application/octet-stream",
+      processData: false,
+      data: file,
+      dataType: "json"
+    })
+    .done(function() {
+      $(".js-persist-preview").attr("data-filename", file.name).removeClass("d-none");
+      selectActiveAnimation(null);
+    })
+    .fail(function(xhr) {
+      addToast("Preview failed", errorFromXhr(xhr));
+    });
+    return false;
+  });
+
+  $(".js-persist-preview").click(function(event) {
+    var encodedFilename = encodeURIComponent($(this).attr("data-filename"));
+
+    event.preventDefault();
+    $.get({ url: "/api/v1/persist_preview?filename=" + encodedFilename, dataType: "json" })
+    .done(function() {
+      location.reload(true);
+    })
+    .fail(function(xhr) {
+      addToast("Saving preview failed", errorFromXhr(xhr));
+    });
+    return false;
+  });
+
   ajaxLoadAnimations();
 });
 
@@ -84,23 +97,115 @@ function addToast(title, body) {
   }, 30000);
 }
 
-function intToHexNibble(i) {
-  if (i < 10) {
-    return String.fromCharCode("0".charCodeAt(0) + i);
-  } else {
-    return String.fromCharCode("A".charCodeAt(0) + (i - 10));
+var UPLOAD_CHUNK_SIZE = 64 * 1024;
+var UPLOAD_MAX_RETRIES = 8;
+
+function errorFromXhr(xhr) {
+  if (xhr.responseJSON && xhr.responseJSON["error"]) {
+    return xhr.responseJSON["error"];
   }
+  return xhr.statusText;
 }
 
-function encodeHex(data) {
-  var hexstring = "";
+var crc32Table = null;
 
+function crc32(data) {
+  if (!crc32Table) {
+    crc32Table = new Uint32Array(256);
+    for (var i = 0; i < 256; i++) {
+      var c = i;
+      for (var j = 0; j < 8; j++) {
+        c = (c & 1) ? (0xEDB88320 ^ (c >>> 1)) : (c >>> 1);
+      }
+      crc32Table[i] = c;
+    }
+  }
+
+  var crc = 0xFFFFFFFF;
   for (var i = 0; i < data.length; i++) {
-    hexstring += intToHexNibble(data[i] >> 4);
-    hexstring += intToHexNibble(data[i] & 0x0f);
+    crc = crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >>> 8);
+  }
+  return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+// Uploads data in ranges, after a failed range upload resumes at the offset reported by the badge
+function uploadAnimation(filename, data, cb) {
+  var encodedFilename = encodeURIComponent(filename);
+  var retries = 0;
+
+  function setProgress(loaded) {
+    var progress = Math.ceil(loaded / data.length * 100);
+
+    $(".js-upload-progress").css("width", progress + "%").attr("aria-valuenow", progress);
+  }
+
+  function commit() {
+    $.get({
+      url: "/api/v1/upload_commit?filename=" + encodedFilename + "&size=" + data.length + "&crc32=" + crc32(data).toString(16),
+      dataType: "json"
+    })
+    .done(function() {
+      cb(null);
+    })
+    .fail(function(xhr) {
+      cb(errorFromXhr(xhr));
+    });
+  }
+
+  function retry(xhr) {
+    if (retries++ >= UPLOAD_MAX_RETRIES) {
+      cb(errorFromXhr(xhr));
+      return;
+    }
+    setTimeout(function() {
+      $.get({ url: "/api/v1/upload_status?filename=" + encodedFilename, dataType: "json" })
+      .done(function(status) {
+        sendChunk(status["offset"]);
+      })
+      .fail(function(xhr) {
+        if (xhr.status == 404) {
+          sendChunk(0);
+        } else {
+          retry(xhr);
+        }
+      });
+    }, 500 * retries);
+  }
+
+  function sendChunk(offset) {
+    if (offset >= data.length) {
+      commit();
+      return;
+    }
+
+    var end = Math.min(offset + UPLOAD_CHUNK_SIZE, data.length);
+
+    $.ajax({
+      url: "/api/v1/upload_chunk?filename=" + encodedFilename,
+      method: "POST",
+      contentType: "application/octet-stream",
+      headers: { "Content-Range": "bytes " + offset + "-" + (end - 1) + "/" + data.length },
+      processData: false,
+      data: data.subarray(offset, end),
+      dataType: "json",
+      xhr: function() {
+        var xhr = $.ajaxSettings.xhr();
+
+        xhr.upload.onprogress = function(event) {
+          setProgress(offset + event.loaded);
+        };
+
+        return xhr;
+      }
+    })
+    .done(function(response) {
+      retries = 0;
+      sendChunk(response["offset"]);
+    })
+    .fail(retry);
   }
 
-  return hexstring;
+  sendChunk(0);
 }
 
 function selectActiveAnimation(filename) {
@@ -48,6 +48,7 @@ void accept_all_the_cookies_init(gui_t *gui_root) {
 	gui_label_init(&cookies_label, accept_all_the_cookies);
 	gui_label_set_font_size(&cookies_label, 15);
 	gui_label_set_text_offset(&cookies_label, 0, 4);
+	gui_label_set_cache_surface(&cookies_label, true);
 	gui_element_set_size(&cookies_label.element, 1000, 22);
 //	gui_element_set_inverted(&cookies_label.element, true);
 
@@ -0,0 +1,247 @@
+#include "animation_cache.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "list.h"
+#include "util.h"
+
+typedef struct animation_cache_entry {
+	// Most recently used first
+	list_head_t list;
+	char *path;
+	uint8_t *data;
+	size_t size;
+	unsigned int refcount;
+} animation_cache_entry_t;
+
+typedef struct animation_cache {
+	list_head_t entries;
+	// Invalidated entries still referenced
+	list_head_t stale_entries;
+	size_t size;
+	size_t budget;
+	// Incremented on invalidation, loads started earlier are discarded
+	unsigned int generation;
+	SemaphoreHandle_t lock;
+	StaticSemaphore_t lock_buffer;
+} animation_cache_t;
+
+static const char *TAG = "animation_cache";
+
+static animation_cache_t animation_cache;
+
+void animation_cache_init(size_t budget) {
+	animation_cache_t *cache = &animation_cache;
+
+	INIT_LIST_HEAD(cache->entries);
+	INIT_LIST_HEAD(cache->stale_entries);
+	cache->size = 0;
+	cache->budget = budget;
+	cache->generation = 0;
+	cache->lock = xSemaphoreCreateMutexStatic(&cache->lock_buffer);
+}
+
+static void animation_cache_free_entry_(animation_cache_entry_t *entry) {
+	LIST_DELETE(&entry->list);
+	heap_caps_free(entry->data);
+	free(entry->path);
+	free(entry);
+}
+
+static animation_cache_entry_t *animation_cache_find_entry_(const char *path) {
+	animation_cache_entry_t *entry;
+
+	LIST_FOR_EACH_ENTRY(entry, &animation_cache.entries, list) {
+		if (!strcmp(entry->path, path)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+// Evict unreferenced entries until size additional bytes fit into budget
+static bool animation_cache_make_room_(size_t size) {
+	animation_cache_t *cache = &animation_cache;
+	animation_cache_entry_t *entry;
+	list_head_t *prev;
+
+	if (size > cache->budget) {
+		return false;
+	}
+
+	// Walk from least recently used end
+	for (prev = cache->entries.prev; prev != &cache->entries && cache->size + size > cache->budget;) {
+		entry = LIST_GET_ENTRY(prev, animation_cache_entry_t, list);
+		prev = prev->prev;
+		if (entry->refcount) {
+			continue;
+		}
+		ESP_LOGD(TAG, "Evicting '%s'", entry->path);
+		cache->size -= entry->size;
+		animation_cache_free_entry_(entry);
+	}
+
+	return cache->size + size <= cache->budget;
+}
+
+int animation_cache_get(const char *path, const uint8_t **data, size_t *size) {
+	animation_cache_t *cache = &animation_cache;
+	animation_cache_entry_t *entry;
+
+	xSemaphoreTake(cache->lock, portMAX_DELAY);
+	entry = animation_cache_find_entry_(path);
+	if (!entry) {
+		xSemaphoreGive(cache->lock);
+		return -ENOENT;
+	}
+
+	entry->refcount++;
+	LIST_DELETE(&entry->list);
+	LIST_APPEND(&entry->list, &cache->entries);
+	*data = entry->data;
+	*size = entry->size;
+	xSemaphoreGive(cache->lock);
+	return 0;
+}
+
+void animation_cache_release(const uint8_t *data) {
+	animation_cache_t *cache = &animation_cache;
+	animation_cache_entry_t *entry;
+	list_head_t *next;
+
+	xSemaphoreTake(cache->lock, portMAX_DELAY);
+	LIST_FOR_EACH_ENTRY(entry, &cache->entries, list) {
+		if (entry->data == data) {
+			entry->refcount--;
+			goto out;
+		}
+	}
+	LIST_FOR_EACH_ENTRY_SAFE(entry, next, &cache->stale_entries, list) {
+		if (entry->data == data) {
+			if (!--entry->refcount) {
+				animation_cache_free_entry_(entry);
+			}
+			goto out;
+		}
+	}
+	ESP_LOGW(TAG, "Released unknown entry");
+out:
+	xSemaphoreGive(cache->lock);
+}
+
+int animation_cache_load(const char *path) {
+	animation_cache_t *cache = &animation_cache;
+	animation_cache_entry_t *entry;
+	unsigned int generation;
+	struct stat st;
+	FILE *file;
+	uint8_t *data;
+	char *path_copy;
+	int err = 0;
+
+	xSemaphoreTake(cache->lock, portMAX_DELAY);
+	if (animation_cache_find_entry_(path)) {
+		xSemaphoreGive(cache->lock);
+		return 0;
+	}
+	generation = cache->generation;
+	xSemaphoreGive(cache->lock);
+
+	if (stat(path, &st)) {
+		return -errno;
+	}
+
+	xSemaphoreTake(cache->lock, portMAX_DELAY);
+	if (!animation_cache_make_room_(st.st_size)) {
+		xSemaphoreGive(cache->lock);
+		return -ENOSPC;
+	}
+	xSemaphoreGive(cache->lock);
+
+	// Read without holding the lock, file IO is slow
+	entry = calloc(1, sizeof(*entry));
+	path_copy = strdup(path);
+	data = heap_caps_malloc_prefer(st.st_size, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT);
+	if (!entry || !path_copy || !data) {
+		err = -ENOMEM;
+		goto fail;
+	}
+
+	file = fopen(path, "r");
+	if (!file) {
+		err = -errno;
+		goto fail;
+	}
+	if (fread(data, 1, st.st_size, file) != st.st_size) {
+		err = -EIO;
+	}
+	fclose(file);
+	if (err) {
+		goto fail;
+	}
+
+	entry->path = path_copy;
+	entry->data = data;
+	entry->size = st.st_size;
+
+	xSemaphoreTake(cache->lock, portMAX_DELAY);
+	// File might have changed while being read
+	if (generation != cache->generation || animation_cache_find_entry_(path) ||
+	    !animation_cache_make_room_(entry->size)) {
+		xSemaphoreGive(cache->lock);
+		err = -EAGAIN;
+		goto fail;
+	}
+	LIST_APPEND(&entry->list, &cache->entries);
+	cache->size += entry->size;
+	xSemaphoreGive(cache->lock);
+
+	ESP_LOGD(TAG, "Cached '%s', %u bytes", path, (unsigned int)st.st_size);
+	return 0;
+
+fail:
+	heap_caps_free(data);
+	free(path_copy);
+	free(entry);
+	return err;
+}
+
+void animation_cache_invalidate(const char *path) {
+	animation_cache_t *cache = &animation_cache;
+	animation_cache_entry_t *entry;
+
+	xSemaphoreTake(cache->lock, portMAX_DELAY);
+	cache->generation++;
+	entry = animation_cache_find_entry_(path);
+	if (entry) {
+		cache->size -= entry->size;
+		if (entry->refcount) {
+			LIST_DELETE(&entry->list);
+			LIST_APPEND(&entry->list, &cache->stale_entries);
+		} else {
+			animation_cache_free_entry_(entry);
+		}
+	}
+	xSemaphoreGive(cache->lock);
+}
+
+void animation_cache_set_budget(size_t budget) {
+	animation_cache_t *cache = &animation_cache;
+
+	xSemaphoreTake(cache->lock, portMAX_DELAY);
+	cache->budget = budget;
+	animation_cache_make_room_(0);
+	xSemaphoreGive(cache->lock);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * RAM cache of raw animation files, keyed by path
+ *
+ * Entries are handed out reference counted. Invalidated entries are no
+ * longer found but stay allocated until the last reference is dropped.
+ */
+
+// Init only
+void animation_cache_init(size_t budget);
+
+/* Threadsafe */
+// Returns -ENOENT if path is not cached. Data stays valid until released
+int animation_cache_get(const char *path, const uint8_t **data, size_t *size);
+void animation_cache_release(const uint8_t *data);
+// Read file at path into cache unless cached already, may evict least recently used entries
+int animation_cache_load(const char *path);
+void animation_cache_invalidate(const char *path);
+void animation_cache_set_budget(size_t budget);
@@ -0,0 +1,278 @@
+#include "animation_index.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <esp_log.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "futil.h"
+#include "oan.h"
+
+#define INDEX_MAGIC		0x31584941 // AIX1
+#define INDEX_VERSION		2
+#define INDEX_SUFFIX		".idx"
+#define INDEX_MAX_FRAMES	UINT16_MAX
+
+#define GIF_BLOCK_EXTENSION	0x21
+#define GIF_BLOCK_IMAGE		0x2c
+#define GIF_BLOCK_TRAILER	0x3b
+#define GIF_EXT_GRAPHIC_CONTROL	0xf9
+#define GIF_FLAG_COLOR_TABLE	0x80
+#define GIF_COLOR_TABLE_SIZE(flags_) (3 * (1 << (((flags_) & 0x07) + 1)))
+
+static const char *TAG = "animation_index";
+
+// Serializes writers, player, uploads and transcoder may index the same file at once
+static SemaphoreHandle_t write_lock;
+static StaticSemaphore_t write_lock_buffer;
+
+void animation_index_init(void) {
+	write_lock = xSemaphoreCreateMutexStatic(&write_lock_buffer);
+	if (futil_dir_exists(ANIMATION_INDEX_DIR)) {
+		remove(ANIMATION_INDEX_DIR);
+		if (mkdir(ANIMATION_INDEX_DIR, 0)) {
+			ESP_LOGE(TAG, "Failed to create index directory: %d", errno);
+		}
+	}
+}
+
+static char *animation_index_path(const char *path) {
+	const char *name = futil_fname(path);
+	char *index_path = malloc(strlen(ANIMATION_INDEX_DIR) + 1 + strlen(name) + strlen(INDEX_SUFFIX) + 1);
+
+	if (index_path) {
+		sprintf(index_path, ANIMATION_INDEX_DIR "/%s" INDEX_SUFFIX, name);
+	}
+	return index_path;
+}
+
+static int gif_read(FILE *file, void *dst, size_t len) {
+	return fread(dst, 1, len, file) == len ? 0 : -EIO;
+}
+
+static uint16_t gif_u16(const uint8_t *data) {
+	return data[0] | (data[1] << 8);
+}
+
+static int gif_skip_sub_blocks(FILE *file) {
+	int len;
+
+	while ((len = fgetc(file)) > 0) {
+		if (fseek(file, len, SEEK_CUR)) {
+			return -EIO;
+		}
+	}
+
+	return len < 0 ? -EIO : 0;
+}
+
+// Walk GIF block structure without decompressing image data
+static int animation_index_scan_gif(animation_info_t *info, FILE *file) {
+	uint8_t buf[10];
+	// Graphic control extension applies to next image
+	unsigned int duration_ms = 0;
+	int err;
+
+	err = gif_read(file, buf, 6);
+	if (err) {
+		return err;
+	}
+	if (memcmp(buf, "GIF87a", 6) && memcmp(buf, "GIF89a", 6)) {
+		return -EINVAL;
+	}
+
+	// Logical screen descriptor
+	err = gif_read(file, buf, 7);
+	if (err) {
+		return err;
+	}
+	info->width = gif_u16(&buf[0]);
+	info->height = gif_u16(&buf[2]);
+	if ((buf[4] & GIF_FLAG_COLOR_TABLE) && fseek(file, GIF_COLOR_TABLE_SIZE(buf[4]), SEEK_CUR)) {
+		return -EIO;
+	}
+
+	while (1) {
+		int block = fgetc(file);
+
+		switch (block) {
+		case GIF_BLOCK_EXTENSION: {
+			int label = fgetc(file);
+
+			if (label == GIF_EXT_GRAPHIC_CONTROL) {
+				// Block size, flags, delay in 1/100 s, transparent index, terminator
+				err = gif_read(file, buf, 6);
+				if (err) {
+					return err;
+				}
+				duration_ms = gif_u16(&buf[2]) * 10;
+			} else if (label < 0) {
+				return -EIO;
+			} else {
+				err = gif_skip_sub_blocks(file);
+				if (err) {
+					return err;
+				}
+			}
+			break;
+		}
+		case GIF_BLOCK_IMAGE:
+			// Position, size and flags
+			err = gif_read(file, buf, 9);
+			if (err) {
+				return err;
+			}
+			if (info->num_frames >= INDEX_MAX_FRAMES) {
+				return -EFBIG;
+			}
+			info->num_frames++;
+			info->duration_ms += duration_ms;
+			duration_ms = 0;
+
+			if ((buf[8] & GIF_FLAG_COLOR_TABLE) && fseek(file, GIF_COLOR_TABLE_SIZE(buf[8]), SEEK_CUR)) {
+				return -EIO;
+			}
+			// LZW minimum code size
+			if (fgetc(file) < 0) {
+				return -EIO;
+			}
+			err = gif_skip_sub_blocks(file);
+			if (err) {
+				return err;
+			}
+			break;
+		case GIF_BLOCK_TRAILER:
+			return 0;
+		case EOF:
+			// Missing trailer, decoders tolerate it
+			return info->num_frames ? 0 : -EIO;
+		default:
+			return -EINVAL;
+		}
+	}
+}
+
+static int animation_index_scan_oan(animation_info_t *info, const char *path) {
+	oan_t oan;
+	int err;
+
+	err = oan_open(&oan, path);
+	if (err) {
+		return err;
+	}
+
+	info->width = oan.header.width;
+	info->height = oan.header.height;
+	info->num_frames = oan.header.num_frames;
+	for (unsigned int i = 0; i < oan.header.num_frames; i++) {
+		info->duration_ms += oan.index[i].duration_ms;
+	}
+
+	oan_close(&oan);
+	return 0;
+}
+
+int animation_index_build(const char *path) {
+	animation_info_t info = { 0 };
+	char *index_path;
+	struct stat st;
+	FILE *file;
+	int err;
+
+	if (stat(path, &st)) {
+		return -errno;
+	}
+
+	info.magic = INDEX_MAGIC;
+	info.version = INDEX_VERSION;
+	info.file_size = st.st_size;
+	info.file_mtime = st.st_mtime;
+	if (oan_probe(path)) {
+		info.format = ANIMATION_FORMAT_OAN;
+		info.error = animation_index_scan_oan(&info, path);
+	} else {
+		info.format = ANIMATION_FORMAT_GIF;
+		file = fopen(path, "r");
+		if (!file) {
+			return -errno;
+		}
+		info.error = animation_index_scan_gif(&info, file);
+		fclose(file);
+	}
+	if (info.error) {
+		ESP_LOGW(TAG, "Scan of '%s' stopped after %u frames: %d", path,
+			 (unsigned int)info.num_frames, (int)info.error);
+	}
+
+	index_path = animation_index_path(path);
+	if (!index_path) {
+		return -ENOMEM;
+	}
+
+	err = 0;
+	xSemaphoreTake(write_lock, portMAX_DELAY);
+	file = fopen(index_path, "w");
+	if (!file) {
+		err = -errno;
+		goto out_locked;
+	}
+	if (fwrite(&info, 1, sizeof(info), file) != sizeof(info)) {
+		err = -EIO;
+	}
+	if (fclose(file) && !err) {
+		err = -EIO;
+	}
+	if (err) {
+		unlink(index_path);
+	} else {
+		ESP_LOGI(TAG, "Indexed '%s': %u frames, %u ms", path, (unsigned int)info.num_frames,
+			 (unsigned int)info.duration_ms);
+	}
+
+out_locked:
+	xSemaphoreGive(write_lock);
+	free(index_path);
+	return err;
+}
+
+int animation_index_get_info(const char *path, animation_info_t *info) {
+	char *index_path = animation_index_path(path);
+	struct stat st;
+	size_t len;
+	FILE *file;
+
+	if (!index_path) {
+		return -ENOMEM;
+	}
+	file = fopen(index_path, "r");
+	free(index_path);
+	if (!file) {
+		return -ENOENT;
+	}
+	len = fread(info, 1, sizeof(*info), file);
+	fclose(file);
+
+	if (len != sizeof(*info) || info->magic != INDEX_MAGIC || info->version != INDEX_VERSION ||
+	    stat(path, &st) || info->file_size != st.st_size || info->file_mtime != (uint32_t)st.st_mtime) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
+void animation_index_remove(const char *path) {
+	char *index_path = animation_index_path(path);
+
+	if (index_path) {
+		xSemaphoreTake(write_lock, portMAX_DELAY);
+		unlink(index_path);
+		xSemaphoreGive(write_lock);
+		free(index_path);
+	}
+}
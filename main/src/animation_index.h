@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Sidecar index of animation files
+ *
+ * Built once after upload by scanning the file structure, without decoding
+ * any image data. Holds metadata of the whole animation only, no per frame
+ * data. Index files live outside of the animation directory and are
+ * validated against size and modification time of the animation.
+ */
+
+#define ANIMATION_INDEX_DIR	"/flash/animation_index"
+
+typedef enum animation_format {
+	ANIMATION_FORMAT_GIF = 0,
+	ANIMATION_FORMAT_OAN = 1,
+} animation_format_t;
+
+typedef struct animation_info {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t format;
+	uint8_t reserved;
+	uint16_t width;
+	uint16_t height;
+	uint32_t num_frames;
+	uint32_t duration_ms;
+	// Negative error code if scan stopped early, frames up to error are indexed
+	int32_t error;
+	uint32_t file_size;
+	uint32_t file_mtime;
+} __attribute__((packed)) animation_info_t;
+
+// Init only
+void animation_index_init(void);
+
+/* Threadsafe */
+int animation_index_build(const char *path);
+// Returns -ENOENT if there is no up to date index
+int animation_index_get_info(const char *path, animation_info_t *info);
+void animation_index_remove(const char *path);
@@ -0,0 +1,459 @@
+#include "animation_store.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "futil.h"
+#include "util.h"
+
+#define STORE_MAGIC		0x4e415342 // BSAN
+#define STORE_NAME_LEN		44
+// Two alternating index slots, a power loss while writing one keeps the other intact
+#define STORE_INDEX_SLOTS	2
+#define STORE_INDEX_SIZE	4096
+#define STORE_DATA_OFFSET	(STORE_INDEX_SLOTS * STORE_INDEX_SIZE)
+#define STORE_COPY_CHUNK_SIZE	4096
+
+typedef struct store_entry {
+	char name[STORE_NAME_LEN];
+	uint32_t offset;
+	uint32_t size;
+	uint32_t mtime;
+	// Of data, checked on first map after boot
+	uint32_t crc;
+	// In memory only
+	uint32_t last_used;
+	uint16_t map_count;
+	bool verified;
+} store_entry_t;
+
+typedef struct store_index_header {
+	uint32_t magic;
+	uint32_t sequence;
+	uint32_t num_entries;
+	uint32_t crc;
+} store_index_header_t;
+
+#define STORE_MAX_ENTRIES	((STORE_INDEX_SIZE - sizeof(store_index_header_t)) / sizeof(store_entry_t))
+
+typedef struct store_index {
+	store_index_header_t header;
+	// Sorted by offset
+	store_entry_t entries[STORE_MAX_ENTRIES];
+} store_index_t;
+
+_Static_assert(sizeof(store_index_t) <= STORE_INDEX_SIZE, "Store index must fit into index slot");
+
+static const char *TAG = "animation_store";
+
+// Erase granularity of partition
+#define STORE_SECTORS_SIZE(size_) (DIV_ROUND_UP((size_), partition->erase_size) * partition->erase_size)
+
+static const esp_partition_t *partition;
+static store_index_t store_index;
+static unsigned int index_slot;
+static uint32_t use_counter;
+static SemaphoreHandle_t store_lock;
+static StaticSemaphore_t store_lock_buffer;
+// Serializes adds, gap being copied to is free until copy has been committed
+static SemaphoreHandle_t add_lock;
+static StaticSemaphore_t add_lock_buffer;
+
+static uint32_t animation_store_index_crc(const store_index_t *index) {
+	return esp_rom_crc32_le(0, (const uint8_t *)index->entries,
+				index->header.num_entries * sizeof(store_entry_t));
+}
+
+static bool animation_store_index_valid(const store_index_t *index) {
+	return index->header.magic == STORE_MAGIC &&
+	       index->header.num_entries <= STORE_MAX_ENTRIES &&
+	       index->header.crc == animation_store_index_crc(index);
+}
+
+int animation_store_init(void) {
+	static store_index_t index;
+	bool index_found = false;
+
+	store_lock = xSemaphoreCreateMutexStatic(&store_lock_buffer);
+	add_lock = xSemaphoreCreateMutexStatic(&add_lock_buffer);
+	partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ANIMATION_STORE_PARTITION_SUBTYPE,
+					     ANIMATION_STORE_PARTITION_LABEL);
+	if (!partition) {
+		ESP_LOGW(TAG, "No animation store partition, playing from filesystem only");
+		return -ENODEV;
+	}
+
+	for (unsigned int slot = 0; slot < STORE_INDEX_SLOTS; slot++) {
+		esp_err_t err = esp_partition_read(partition, slot * STORE_INDEX_SIZE, &index, sizeof(index));
+
+		if (err || !animation_store_index_valid(&index)) {
+			continue;
+		}
+		if (!index_found || index.header.sequence > store_index.header.sequence) {
+			store_index = index;
+			index_slot = slot;
+			index_found = true;
+		}
+	}
+
+	if (!index_found) {
+		ESP_LOGI(TAG, "Animation store is empty");
+		memset(&store_index, 0, sizeof(store_index));
+		store_index.header.magic = STORE_MAGIC;
+		// Next commit goes to first slot
+		index_slot = STORE_INDEX_SLOTS - 1;
+	}
+
+	for (unsigned int i = 0; i < store_index.header.num_entries; i++) {
+		store_index.entries[i].last_used = 0;
+		store_index.entries[i].map_count = 0;
+		store_index.entries[i].verified = false;
+	}
+
+	ESP_LOGI(TAG, "Animation store with %u entries, %u bytes", (unsigned int)store_index.header.num_entries,
+		 (unsigned int)partition->size);
+	return 0;
+}
+
+static int animation_store_commit_index_(void) {
+	unsigned int slot = (index_slot + 1) % STORE_INDEX_SLOTS;
+	esp_err_t err;
+
+	store_index.header.sequence++;
+	store_index.header.crc = animation_store_index_crc(&store_index);
+	err = esp_partition_erase_range(partition, slot * STORE_INDEX_SIZE, STORE_INDEX_SIZE);
+	if (err) {
+		return -EIO;
+	}
+	err = esp_partition_write(partition, slot * STORE_INDEX_SIZE, &store_index,
+				  sizeof(store_index_header_t) + store_index.header.num_entries * sizeof(store_entry_t));
+	if (err) {
+		return -EIO;
+	}
+
+	index_slot = slot;
+	return 0;
+}
+
+static store_entry_t *animation_store_find_entry_(const char *name) {
+	for (unsigned int i = 0; i < store_index.header.num_entries; i++) {
+		store_entry_t *entry = &store_index.entries[i];
+
+		if (!strncmp(entry->name, name, sizeof(entry->name))) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void animation_store_delete_entry_(store_entry_t *entry) {
+	store_entry_t *end = &store_index.entries[store_index.header.num_entries];
+
+	memmove(entry, entry + 1, (end - entry - 1) * sizeof(*entry));
+	store_index.header.num_entries--;
+}
+
+// Find gap of at least size bytes, returns index to insert entry at
+static int animation_store_find_gap_(uint32_t size, uint32_t *offset) {
+	uint32_t gap_start = STORE_DATA_OFFSET;
+
+	for (unsigned int i = 0; i <= store_index.header.num_entries; i++) {
+		uint32_t gap_end = partition->size;
+
+		if (i < store_index.header.num_entries) {
+			gap_end = store_index.entries[i].offset;
+		}
+		if (gap_end - gap_start >= size) {
+			*offset = gap_start;
+			return i;
+		}
+		if (i < store_index.header.num_entries) {
+			const store_entry_t *entry = &store_index.entries[i];
+
+			gap_start = entry->offset + STORE_SECTORS_SIZE(entry->size);
+		}
+	}
+
+	return -ENOSPC;
+}
+
+// Returns false if all entries are in use
+static bool animation_store_evict_lru_(void) {
+	store_entry_t *lru = NULL;
+
+	for (unsigned int i = 0; i < store_index.header.num_entries; i++) {
+		store_entry_t *entry = &store_index.entries[i];
+
+		// Mapped entries are being played back
+		if (entry->map_count) {
+			continue;
+		}
+		if (!lru || entry->last_used < lru->last_used) {
+			lru = entry;
+		}
+	}
+
+	if (!lru) {
+		return false;
+	}
+	ESP_LOGI(TAG, "Evicting '%s'", lru->name);
+	animation_store_delete_entry_(lru);
+	return true;
+}
+
+static store_entry_t *animation_store_find_entry_by_offset_(uint32_t offset) {
+	for (unsigned int i = 0; i < store_index.header.num_entries; i++) {
+		store_entry_t *entry = &store_index.entries[i];
+
+		if (entry->offset == offset) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static int animation_store_copy(FILE *file, uint32_t offset, uint32_t size, uint32_t *crc) {
+	uint8_t *buf = malloc(STORE_COPY_CHUNK_SIZE);
+	uint32_t pos = 0;
+	int err = 0;
+
+	*crc = 0;
+	if (!buf) {
+		return -ENOMEM;
+	}
+
+	if (esp_partition_erase_range(partition, offset, STORE_SECTORS_SIZE(size))) {
+		err = -EIO;
+		goto out;
+	}
+
+	while (pos < size) {
+		size_t len = MIN(size - pos, STORE_COPY_CHUNK_SIZE);
+
+		if (fread(buf, 1, len, file) != len) {
+			err = -EIO;
+			goto out;
+		}
+		if (esp_partition_write(partition, offset + pos, buf, len)) {
+			err = -EIO;
+			goto out;
+		}
+		*crc = esp_rom_crc32_le(*crc, buf, len);
+		pos += len;
+	}
+
+out:
+	free(buf);
+	return err;
+}
+
+// Insert entry keeping index sorted by offset
+static store_entry_t *animation_store_insert_entry_(uint32_t offset) {
+	unsigned int idx = 0;
+	store_entry_t *entry;
+
+	while (idx < store_index.header.num_entries && store_index.entries[idx].offset < offset) {
+		idx++;
+	}
+	entry = &store_index.entries[idx];
+	memmove(entry + 1, entry, (store_index.header.num_entries - idx) * sizeof(*entry));
+	memset(entry, 0, sizeof(*entry));
+	store_index.header.num_entries++;
+	return entry;
+}
+
+int animation_store_add(const char *path) {
+	const char *name = futil_fname(path);
+	bool index_changed = false;
+	store_entry_t *entry;
+	struct stat st;
+	uint32_t offset;
+	uint32_t crc;
+	FILE *file;
+	int err;
+
+	if (!partition) {
+		return -ENODEV;
+	}
+	if (strlen(name) >= STORE_NAME_LEN) {
+		return -ENAMETOOLONG;
+	}
+	if (stat(path, &st)) {
+		return -errno;
+	}
+	if (st.st_size > partition->size - STORE_DATA_OFFSET) {
+		return -EFBIG;
+	}
+
+	file = fopen(path, "r");
+	if (!file) {
+		return -errno;
+	}
+
+	xSemaphoreTake(add_lock, portMAX_DELAY);
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	entry = animation_store_find_entry_(name);
+	if (entry) {
+		if (entry->size == st.st_size && entry->mtime == (uint32_t)st.st_mtime) {
+			err = 0;
+			goto out_locked;
+		}
+		if (entry->map_count) {
+			err = -EBUSY;
+			goto out_locked;
+		}
+		animation_store_delete_entry_(entry);
+		index_changed = true;
+	}
+
+	while (store_index.header.num_entries >= STORE_MAX_ENTRIES ||
+	       animation_store_find_gap_(STORE_SECTORS_SIZE(st.st_size), &offset) < 0) {
+		if (!animation_store_evict_lru_()) {
+			err = -ENOSPC;
+			goto out_locked;
+		}
+		index_changed = true;
+	}
+
+	// Index on flash must not reference sectors that are about to be overwritten
+	if (index_changed) {
+		err = animation_store_commit_index_();
+		if (err) {
+			goto out_locked;
+		}
+	}
+	xSemaphoreGive(store_lock);
+
+	// Erasing and writing takes seconds, do not block playback meanwhile
+	err = animation_store_copy(file, offset, st.st_size, &crc);
+	if (err) {
+		ESP_LOGE(TAG, "Failed to copy '%s' to store: %d", name, err);
+		goto out;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	entry = animation_store_insert_entry_(offset);
+	strcpy(entry->name, name);
+	entry->offset = offset;
+	entry->size = st.st_size;
+	entry->mtime = st.st_mtime;
+	entry->crc = crc;
+	entry->last_used = ++use_counter;
+	entry->verified = true;
+	err = animation_store_commit_index_();
+	ESP_LOGI(TAG, "Stored '%s' at 0x%08x, %u bytes", name, (unsigned int)offset, (unsigned int)st.st_size);
+
+out_locked:
+	xSemaphoreGive(store_lock);
+out:
+	xSemaphoreGive(add_lock);
+	fclose(file);
+	return err;
+}
+
+void animation_store_remove(const char *path) {
+	store_entry_t *entry;
+
+	if (!partition) {
+		return;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	entry = animation_store_find_entry_(futil_fname(path));
+	if (entry) {
+		animation_store_delete_entry_(entry);
+		animation_store_commit_index_();
+	}
+	xSemaphoreGive(store_lock);
+}
+
+int animation_store_map(const char *path, animation_store_mapping_t *mapping) {
+	store_entry_t *entry;
+	struct stat st;
+	bool verified;
+	uint32_t crc;
+	esp_err_t err;
+
+	if (!partition) {
+		return -ENODEV;
+	}
+	if (stat(path, &st)) {
+		return -errno;
+	}
+
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	entry = animation_store_find_entry_(futil_fname(path));
+	if (!entry || entry->size != st.st_size || entry->mtime != (uint32_t)st.st_mtime) {
+		xSemaphoreGive(store_lock);
+		return -ENOENT;
+	}
+
+	err = esp_partition_mmap(partition, entry->offset, entry->size, ESP_PARTITION_MMAP_DATA,
+				 (const void **)&mapping->data, &mapping->handle);
+	if (err) {
+		ESP_LOGE(TAG, "Failed to map '%s': %d", entry->name, err);
+		xSemaphoreGive(store_lock);
+		return -ENOMEM;
+	}
+	mapping->size = entry->size;
+	mapping->offset = entry->offset;
+	entry->last_used = ++use_counter;
+	entry->map_count++;
+	verified = entry->verified;
+	crc = entry->crc;
+	xSemaphoreGive(store_lock);
+
+	if (verified) {
+		return 0;
+	}
+
+	// Copy might have been interrupted by a power loss, mapped entry can not be evicted meanwhile
+	if (esp_rom_crc32_le(0, mapping->data, mapping->size) == crc) {
+		xSemaphoreTake(store_lock, portMAX_DELAY);
+		entry = animation_store_find_entry_by_offset_(mapping->offset);
+		if (entry) {
+			entry->verified = true;
+		}
+		xSemaphoreGive(store_lock);
+		return 0;
+	}
+
+	ESP_LOGE(TAG, "CRC mismatch of '%s', dropping it", futil_fname(path));
+	esp_partition_munmap(mapping->handle);
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	entry = animation_store_find_entry_by_offset_(mapping->offset);
+	if (entry) {
+		animation_store_delete_entry_(entry);
+		animation_store_commit_index_();
+	}
+	xSemaphoreGive(store_lock);
+	mapping->data = NULL;
+	mapping->size = 0;
+	return -ENOENT;
+}
+
+void animation_store_unmap(animation_store_mapping_t *mapping) {
+	store_entry_t *entry;
+
+	esp_partition_munmap(mapping->handle);
+	xSemaphoreTake(store_lock, portMAX_DELAY);
+	entry = animation_store_find_entry_by_offset_(mapping->offset);
+	if (entry && entry->map_count) {
+		entry->map_count--;
+	}
+	xSemaphoreGive(store_lock);
+	mapping->data = NULL;
+	mapping->size = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_partition.h>
+
+/*
+ * Copies of animation files in a raw flash partition
+ *
+ * Files on the FAT partition remain the reference. The store keeps
+ * contiguous copies of them that can be memory mapped and read through
+ * the flash cache directly. Entries are validated against size and
+ * modification time of the original file, stale entries are ignored.
+ * Data is checked against a CRC stored in the index on first map after
+ * boot, sectors are only overwritten once the index no longer refers to
+ * them.
+ *
+ * The store takes space formerly used by NVS and the FAT partition. Devices
+ * flashed with an older partition table, including all that were updated
+ * over the air, have no store and play from the filesystem only.
+ */
+
+#define ANIMATION_STORE_PARTITION_LABEL		"animations"
+#define ANIMATION_STORE_PARTITION_SUBTYPE	0x40
+
+typedef struct animation_store_mapping {
+	const uint8_t *data;
+	size_t size;
+	uint32_t offset;
+	esp_partition_mmap_handle_t handle;
+} animation_store_mapping_t;
+
+// Init only
+int animation_store_init(void);
+
+/* Threadsafe */
+// Map copy of file at path, returns -ENOENT if there is no valid copy
+int animation_store_map(const char *path, animation_store_mapping_t *mapping);
+void animation_store_unmap(animation_store_mapping_t *mapping);
+// Copy file at path into store, evicting least recently used entries if required
+int animation_store_add(const char *path);
+void animation_store_remove(const char *path);
@@ -1,15 +1,27 @@
 #include "api.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <esp_heap_caps.h>
 #include <esp_log.h>
 
+#include "animation_cache.h"
+#include "animation_index.h"
+#include "animation_store.h"
 #include "futil.h"
 #include "gifplayer.h"
 #include "httpd_util.h"
+#include "oan.h"
+#include "oled.h"
+#include "transcoder.h"
+#include "upload.h"
 #include "util.h"
 #include "vendor.h"
 #include "wlan_station.h"
@@ -20,41 +32,141 @@ static const char *TAG = "api";
 #define HTTP_ANIMATION_SOCK_ERR "{ \"error\": \"Failed to read from socket\" }"
 #define HTTP_ANIMATION_HEX_ERR "{ \"error\": \"Failed to decode animation hex data\" }"
 #define HTTP_ANIMATION_WRITE_ERR "{ \"error\": \"Failed to write animation to file\" }"
+#define HTTP_ANIMATION_STORE_ERR "{ \"error\": \"Failed to store animation\" }"
 #define HTTP_DIRCACHE_UPDATE_ERR "{ \"error\": \"Failed to update list of animations\" }"
+#define HTTP_UPLOAD_RANGE_ERR "{ \"error\": \"Missing or invalid Content-Range header\" }"
+#define HTTP_UPLOAD_INCOMPLETE_ERR "{ \"error\": \"Upload is incomplete\" }"
+#define HTTP_UPLOAD_CHECKSUM_ERR "{ \"error\": \"Checksum mismatch, upload discarded\" }"
+#define HTTP_PREVIEW_SIZE_ERR "{ \"error\": \"Animation does not fit into memory\" }"
+#define HTTP_PREVIEW_PLAY_ERR "{ \"error\": \"Failed to play animation\" }"
+#define HTTP_PREVIEW_MISSING_ERR "{ \"error\": \"No preview to persist\" }"
+#define HTTP_PREVIEW_BUSY_ERR "{ \"error\": \"Preview is being stored, try again later\" }"
+
+#define ANIMATION_TMP_SUFFIX ".tmp"
+
+// Uploaded GIFs are converted to native format in the background
+static const transcoder_options_t api_transcoder_options = {
+	.filter = TRANSCODER_FILTER_BOX,
+	.scale = TRANSCODER_SCALE_FIT,
+	.dither = true,
+};
+
+// Internal heap left to network stack and decoder while a preview is held in internal memory
+#define API_PREVIEW_INTERNAL_RESERVE	KIB(64)
+
+typedef struct api_upload {
+	char *abspath;
+	// Animation is received here without holding the player lock
+	char *tmppath;
+	bool transcode_queued;
+} api_upload_t;
+
+// With staged set the animation is received into its staging file in multiple requests
+static int api_upload_init(api_upload_t *upload, const char *fname, bool staged) {
+	char *staging_path;
+
+	upload->transcode_queued = false;
+	upload->abspath = futil_path_concat(fname, GIFPLAYER_BASE_DIR);
+	if (!upload->abspath) {
+		return -ENOMEM;
+	}
+
+	staging_path = futil_path_concat(fname, UPLOAD_STAGING_DIR);
+	if (staging_path && !staged) {
+		// Must not collide with staging file of a ranged upload
+		upload->tmppath = malloc(strlen(staging_path) + strlen(ANIMATION_TMP_SUFFIX) + 1);
+		if (upload->tmppath) {
+			strcpy(upload->tmppath, staging_path);
+			strcat(upload->tmppath, ANIMATION_TMP_SUFFIX);
+		}
+		free(staging_path);
+	} else {
+		upload->tmppath = staging_path;
+	}
+	if (!upload->tmppath) {
+		free(upload->abspath);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void api_upload_free(api_upload_t *upload) {
+	free(upload->abspath);
+	free(upload->tmppath);
+}
+
+// Moves received file into place, on error an error response has been sent already
+static int api_upload_commit(api_upload_t *upload, struct httpd_request_ctx* ctx) {
+	int err;
+
+	// Only moving the file and updating the list of animations block the player
+	gifplayer_lock();
+	// Animation on display switches over to the new file
+	err = gifplayer_replace_animation_(upload->abspath, upload->tmppath);
+	if (err) {
+		gifplayer_unlock();
+		ESP_LOGE(TAG, "Failed to store animation: %d", err);
+		unlink(upload->tmppath);
+		httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_STORE_ERR);
+		return err;
+	}
+	err = gifplayer_add_available_animation_(futil_fname(upload->abspath));
+	if (!err && !gifplayer_is_animation_playing()) {
+		gifplayer_set_animation_(upload->abspath);
+	}
+	gifplayer_unlock();
+	if (err) {
+		ESP_LOGE(TAG, "Failed to update available animations after upload: %d", err);
+		httpd_send_error_msg(ctx, HTTPD_500, HTTP_DIRCACHE_UPDATE_ERR);
+		return err;
+	}
+
+	err = animation_index_build(upload->abspath);
+	if (err) {
+		ESP_LOGW(TAG, "Failed to index animation: %d", err);
+	}
+	if (!oan_probe(upload->abspath)) {
+		err = transcoder_enqueue(upload->abspath, &api_transcoder_options);
+		if (err) {
+			ESP_LOGW(TAG, "Failed to queue animation for transcoding: %d", err);
+		} else {
+			upload->transcode_queued = true;
+		}
+	}
+	// Transcoder adds result to store
+	if (!upload->transcode_queued) {
+		err = animation_store_add(upload->abspath);
+		if (err && err != -ENODEV) {
+			ESP_LOGW(TAG, "Failed to add animation to store: %d", err);
+		}
+	}
+	return 0;
+}
 
 static esp_err_t http_post_upload_animation(struct httpd_request_ctx* ctx, void* priv) {
 	httpd_req_t *req = ctx->req;
+	api_upload_t upload;
 	int ret;
 	FILE *fhndl;
 	ssize_t param_len;
 	esp_err_t err;
 	char* fname;
-	char* abspath;
-	bool animation_switch_required = false;
-	const char *current_animation_name;
 
 	if((param_len = httpd_query_string_get_param(ctx, "filename", &fname)) <= 0) {
 		return httpd_send_error(ctx, HTTPD_400);
 	}
 
-	abspath = futil_path_concat(fname, GIFPLAYER_BASE_DIR);
-	if (!abspath) {
+	if (api_upload_init(&upload, fname, false)) {
 		return httpd_send_error(ctx, HTTPD_500);
 	}
 
-	gifplayer_lock();
-	fhndl = fopen(abspath, "w");
+	// Result of converting previous upload must not replace this one
+	transcoder_cancel(upload.abspath);
+	fhndl = fopen(upload.tmppath, "w");
 	if (!fhndl) {
 		ESP_LOGE(TAG, "Failed to open animation file for writing: %d", errno);
 		err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_OPEN_ERR);
-		goto out_locked;
-	}
-
-	current_animation_name = gifplayer_get_name_of_playing_animation_();
-	if (!current_animation_name || !strcmp(fname, current_animation_name)) {
-		ESP_LOGI(TAG, "Modifying currently active animation!");
-		gifplayer_stop_playback();
-		animation_switch_required = true;
+		goto out;
 	}
 
 	ESP_LOGI(TAG, "POST data size: %u", req->content_len);
@@ -66,10 +178,10 @@ static esp_err_t http_post_upload_animation(struct httpd_request_ctx* ctx, void*
 
 		ret = httpd_req_recv(req, (char *)read_buff, sizeof(read_buff));
 		if (ret < 0) {
-			free(abspath);
 			fclose(fhndl);
+			unlink(upload.tmppath);
 			err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_SOCK_ERR);
-			goto out_locked;
+			goto out;
 		}
 		if (!ret) {
 			break;
@@ -79,71 +191,492 @@ static esp_err_t http_post_upload_animation(struct httpd_request_ctx* ctx, void*
 		res = hex_decode_inplace(read_buff, len);
 		if (res < 0) {
 			ESP_LOGE(TAG, "Invalid hex data in request");
-			free(abspath);
 			fclose(fhndl);
+			unlink(upload.tmppath);
 			err = httpd_send_error_msg(ctx, HTTPD_400, HTTP_ANIMATION_HEX_ERR);
-			goto out_locked;
+			goto out;
 		}
 		len = res;
 
 		ESP_LOG_BUFFER_HEXDUMP(TAG, read_buff, ret, ESP_LOG_VERBOSE);
 		if (fwrite(read_buff, 1, len, fhndl) != len) {
 			ESP_LOGE(TAG, "Failed to write to animation file: %d", ferror(fhndl));
-			free(abspath);
 			fclose(fhndl);
+			unlink(upload.tmppath);
 			err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_WRITE_ERR);
-			goto out_locked;
+			goto out;
 		}
 	}
 
 	fclose(fhndl);
 
-	if (animation_switch_required) {
-		gifplayer_set_animation_(abspath);
+	err = api_upload_commit(&upload, ctx);
+	if (!err) {
+		const char *resp = upload.transcode_queued ? "{ \"transcode\": \"queued\" }" : "{}";
+
+		httpd_resp_send_chunk(req, resp, strlen(resp));
+		httpd_finalize_response(ctx);
+	}
+
+out:
+	api_upload_free(&upload);
+	return err;
+}
+
+// Body is the raw animation file, received and written to flash concurrently
+static esp_err_t http_post_upload_animation_raw(struct httpd_request_ctx* ctx, void* priv) {
+	httpd_req_t *req = ctx->req;
+	api_upload_t upload;
+	upload_stats_t stats;
+	char strbuf[160];
+	ssize_t param_len;
+	esp_err_t err;
+	char* fname;
+	int fd;
+
+	if((param_len = httpd_query_string_get_param(ctx, "filename", &fname)) <= 0) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+	if (!req->content_len) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+
+	if (api_upload_init(&upload, fname, false)) {
+		return httpd_send_error(ctx, HTTPD_500);
+	}
+
+	// Result of converting previous upload must not replace this one
+	transcoder_cancel(upload.abspath);
+	fd = open(upload.tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ESP_LOGE(TAG, "Failed to open animation file for writing: %d", errno);
+		err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_OPEN_ERR);
+		goto out;
+	}
+
+	ESP_LOGI(TAG, "POST data size: %u", (unsigned int)req->content_len);
+	err = upload_receive_to_fd(req, fd, &stats);
+	if (close(fd) && err >= 0) {
+		err = -errno;
+	}
+	if (err < 0) {
+		ESP_LOGE(TAG, "Failed to receive animation: %d", err);
+		unlink(upload.tmppath);
+		if (err == -ECONNABORTED) {
+			err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_SOCK_ERR);
+		} else {
+			err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_WRITE_ERR);
+		}
+		goto out;
+	}
+
+	err = api_upload_commit(&upload, ctx);
+	if (!err) {
+		snprintf(strbuf, sizeof(strbuf),
+			 "{ \"bytes\": %u, \"duration_ms\": %u, \"throughput_kib_s\": %u, "
+			 "\"recv_ms\": %u, \"write_ms\": %u%s }",
+			 (unsigned int)stats.bytes, (unsigned int)(stats.duration_us / 1000),
+			 upload_stats_get_throughput(&stats), (unsigned int)(stats.recv_us / 1000),
+			 (unsigned int)(stats.write_us / 1000),
+			 upload.transcode_queued ? ", \"transcode\": \"queued\"" : "");
+		httpd_resp_send_chunk(req, strbuf, strlen(strbuf));
+		httpd_finalize_response(ctx);
+	}
+
+out:
+	api_upload_free(&upload);
+	return err;
+}
+
+// Without PSRAM the preview competes with everything else for internal memory
+static uint8_t *api_preview_alloc(size_t size) {
+	if (heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) < size &&
+	    heap_caps_get_free_size(MALLOC_CAP_INTERNAL) < size + API_PREVIEW_INTERNAL_RESERVE) {
+		return NULL;
+	}
+	return heap_caps_malloc_prefer(size, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT);
+}
+
+// Body is the raw animation file, played from RAM without touching flash
+static esp_err_t http_post_preview_animation(struct httpd_request_ctx* ctx, void* priv) {
+	httpd_req_t *req = ctx->req;
+	upload_stats_t stats;
+	char strbuf[128];
+	uint8_t *data;
+	int err;
+
+	if (!req->content_len) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+
+	// Do not receive a body that can not replace the preview on display
+	gifplayer_lock();
+	if (gifplayer_is_preview_held_()) {
+		gifplayer_unlock();
+		return httpd_send_error_msg(ctx, HTTPD_409, HTTP_PREVIEW_BUSY_ERR);
 	}
-	free(abspath);
-	err = gifplayer_update_available_animations_();
 	gifplayer_unlock();
 
+	data = api_preview_alloc(req->content_len);
+	if (!data) {
+		// Previous preview is replaced anyway, player frees it once it stops playing it
+		gifplayer_lock();
+		if (gifplayer_is_preview_playing_() && !gifplayer_is_preview_held_()) {
+			gifplayer_set_animation_(NULL);
+		}
+		gifplayer_unlock();
+		data = api_preview_alloc(req->content_len);
+	}
+	if (!data) {
+		return httpd_send_error_msg(ctx, HTTPD_413, HTTP_PREVIEW_SIZE_ERR);
+	}
+
+	err = upload_receive_to_memory(req, data, &stats);
+	if (err < 0) {
+		heap_caps_free(data);
+		return httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_SOCK_ERR);
+	}
+
+	// Player owns data from here on
+	gifplayer_lock();
+	err = gifplayer_set_preview_(data, req->content_len);
+	gifplayer_unlock();
+	if (err == -EBUSY) {
+		heap_caps_free(data);
+		return httpd_send_error_msg(ctx, HTTPD_409, HTTP_PREVIEW_BUSY_ERR);
+	}
 	if (err) {
-		ESP_LOGE(TAG, "Failed to update available animations after upload: %d", err);
-		httpd_send_error_msg(ctx, HTTPD_500, HTTP_DIRCACHE_UPDATE_ERR);
-	} else {
-		httpd_resp_send_chunk(req, "{}", strlen("{}"));
+		heap_caps_free(data);
+		return httpd_send_error_msg(ctx, HTTPD_400, HTTP_PREVIEW_PLAY_ERR);
+	}
+
+	snprintf(strbuf, sizeof(strbuf), "{ \"bytes\": %u, \"duration_ms\": %u, \"throughput_kib_s\": %u }",
+		 (unsigned int)stats.bytes, (unsigned int)(stats.duration_us / 1000), upload_stats_get_throughput(&stats));
+	httpd_resp_send_chunk(req, strbuf, strlen(strbuf));
+	httpd_finalize_response(ctx);
+	return ESP_OK;
+}
+
+// Stores preview on display as animation file
+static esp_err_t http_get_persist_preview(struct httpd_request_ctx* ctx, void* priv) {
+	const uint8_t *data;
+	api_upload_t upload;
+	ssize_t param_len, res;
+	size_t size;
+	char* fname;
+	int err, fd;
+
+	if((param_len = httpd_query_string_get_param(ctx, "filename", &fname)) <= 0) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+
+	// Data stays valid while it is written, even if a button press switches animations
+	gifplayer_lock();
+	data = gifplayer_get_preview_(&size);
+	gifplayer_unlock();
+	if (!data) {
+		return httpd_send_error_msg(ctx, HTTPD_404, HTTP_PREVIEW_MISSING_ERR);
+	}
+
+	if (api_upload_init(&upload, fname, false)) {
+		err = httpd_send_error(ctx, HTTPD_500);
+		goto out_release;
+	}
+
+	// Result of converting previous upload must not replace this one
+	transcoder_cancel(upload.abspath);
+	fd = open(upload.tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		ESP_LOGE(TAG, "Failed to open animation file for writing: %d", errno);
+		err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_OPEN_ERR);
+		goto out;
+	}
+	res = write(fd, data, size);
+	err = res < 0 ? -errno : 0;
+	if (close(fd) && !err) {
+		err = -errno;
+	}
+	if (err || res != size) {
+		ESP_LOGE(TAG, "Failed to write preview to animation file: %d", err);
+		unlink(upload.tmppath);
+		err = httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_WRITE_ERR);
+		goto out;
+	}
+
+	err = api_upload_commit(&upload, ctx);
+	if (!err) {
+		const char *resp = upload.transcode_queued ? "{ \"transcode\": \"queued\" }" : "{}";
+
+		// Animation on display is the one just stored
+		gifplayer_lock();
+		if (gifplayer_is_preview_playing_()) {
+			gifplayer_set_animation_(upload.abspath);
+		}
+		gifplayer_unlock();
+		httpd_resp_send_chunk(ctx->req, resp, strlen(resp));
 		httpd_finalize_response(ctx);
 	}
-	return err;
 
-out_locked:
+out:
+	api_upload_free(&upload);
+out_release:
+	gifplayer_lock();
+	gifplayer_release_preview_();
 	gifplayer_unlock();
 	return err;
 }
 
+// Parses "bytes <first>-<last>/<total>"
+static int api_parse_content_range(httpd_req_t *req, size_t *offset) {
+	char hdr[64];
+	unsigned int first, last, total;
+
+	if (httpd_req_get_hdr_value_str(req, "Content-Range", hdr, sizeof(hdr)) != ESP_OK) {
+		return -EINVAL;
+	}
+	if (sscanf(hdr, "bytes %u-%u/%u", &first, &last, &total) != 3) {
+		return -EINVAL;
+	}
+	if (last < first || last >= total || last - first + 1 != req->content_len) {
+		return -EINVAL;
+	}
+	// Keeps writes aligned to FAT sectors
+	if (first % UPLOAD_BUFFER_SIZE) {
+		return -EINVAL;
+	}
+
+	*offset = first;
+	return 0;
+}
+
+// Body is the range of the animation file given by the Content-Range header
+static esp_err_t http_post_upload_chunk(struct httpd_request_ctx* ctx, void* priv) {
+	httpd_req_t *req = ctx->req;
+	upload_stats_t stats;
+	char strbuf[96];
+	ssize_t param_len;
+	size_t offset;
+	char* fname;
+	char* path;
+	int ret;
+
+	if((param_len = httpd_query_string_get_param(ctx, "filename", &fname)) <= 0) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+	if (api_parse_content_range(req, &offset)) {
+		return httpd_send_error_msg(ctx, HTTPD_400, HTTP_UPLOAD_RANGE_ERR);
+	}
+
+	path = futil_path_concat(fname, UPLOAD_STAGING_DIR);
+	if (!path) {
+		return httpd_send_error(ctx, HTTPD_500);
+	}
+
+	// Staging directory is not visible to the player, no lock required
+	ret = upload_receive_range(req, path, offset, &stats);
+	if (ret == -ERANGE) {
+		ret = upload_get_resume_offset(path);
+		free(path);
+		snprintf(strbuf, sizeof(strbuf), "{ \"error\": \"Range starts past received data\", \"offset\": %d }",
+			 MAX(ret, 0));
+		return httpd_send_error_msg(ctx, HTTPD_416, strbuf);
+	}
+	free(path);
+	if (ret < 0) {
+		ESP_LOGE(TAG, "Failed to receive upload range: %d", ret);
+		if (ret == -ECONNABORTED) {
+			return httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_SOCK_ERR);
+		}
+		return httpd_send_error_msg(ctx, HTTPD_500, HTTP_ANIMATION_WRITE_ERR);
+	}
+
+	snprintf(strbuf, sizeof(strbuf), "{ \"offset\": %d, \"throughput_kib_s\": %u }",
+		 ret, upload_stats_get_throughput(&stats));
+	httpd_resp_send_chunk(req, strbuf, strlen(strbuf));
+	httpd_finalize_response(ctx);
+	return ESP_OK;
+}
+
+static esp_err_t http_get_upload_status(struct httpd_request_ctx* ctx, void* priv) {
+	char strbuf[32];
+	ssize_t param_len;
+	char* fname;
+	char* path;
+	int size;
+
+	if((param_len = httpd_query_string_get_param(ctx, "filename", &fname)) <= 0) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+
+	path = futil_path_concat(fname, UPLOAD_STAGING_DIR);
+	if (!path) {
+		return httpd_send_error(ctx, HTTPD_500);
+	}
+	size = upload_get_resume_offset(path);
+	free(path);
+	if (size < 0) {
+		return httpd_send_error(ctx, HTTPD_404);
+	}
+
+	snprintf(strbuf, sizeof(strbuf), "{ \"offset\": %d }", size);
+	httpd_resp_send_chunk(ctx->req, strbuf, strlen(strbuf));
+	httpd_finalize_response(ctx);
+	return ESP_OK;
+}
+
+// Moves staged upload into place if it is complete and intact
+static esp_err_t http_get_upload_commit(struct httpd_request_ctx* ctx, void* priv) {
+	api_upload_t upload;
+	unsigned long size, crc;
+	ssize_t param_len;
+	char *fname, *size_str, *crc_str, *end;
+	uint32_t staged_crc;
+	esp_err_t err;
+	int staged_size;
+
+	if((param_len = httpd_query_string_get_param(ctx, "filename", &fname)) <= 0 ||
+	   (param_len = httpd_query_string_get_param(ctx, "size", &size_str)) <= 0 ||
+	   (param_len = httpd_query_string_get_param(ctx, "crc32", &crc_str)) <= 0) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+	size = strtoul(size_str, &end, 10);
+	if (*end) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+	crc = strtoul(crc_str, &end, 16);
+	if (*end) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+
+	if (api_upload_init(&upload, fname, true)) {
+		return httpd_send_error(ctx, HTTPD_500);
+	}
+
+	staged_size = upload_get_committed_size(upload.tmppath);
+	if (staged_size < 0) {
+		api_upload_free(&upload);
+		return httpd_send_error(ctx, HTTPD_404);
+	}
+	// Client may resume from committed offset
+	if (staged_size != size) {
+		api_upload_free(&upload);
+		return httpd_send_error_msg(ctx, HTTPD_400, HTTP_UPLOAD_INCOMPLETE_ERR);
+	}
+	err = upload_get_crc32(upload.tmppath, &staged_crc);
+	if (err) {
+		ESP_LOGE(TAG, "Failed to checksum staged upload: %d", err);
+		api_upload_free(&upload);
+		return httpd_send_error(ctx, HTTPD_500);
+	}
+	if (staged_crc != crc) {
+		ESP_LOGW(TAG, "Checksum mismatch for '%s': 0x%08lx != 0x%08lx", fname, (unsigned long)staged_crc, crc);
+		unlink(upload.tmppath);
+		api_upload_free(&upload);
+		return httpd_send_error_msg(ctx, HTTPD_400, HTTP_UPLOAD_CHECKSUM_ERR);
+	}
+
+	// Result of converting previous upload must not replace this one
+	transcoder_cancel(upload.abspath);
+	err = api_upload_commit(&upload, ctx);
+	api_upload_free(&upload);
+	if (!err) {
+		const char *resp = upload.transcode_queued ? "{ \"transcode\": \"queued\" }" : "{}";
+
+		httpd_resp_send_chunk(ctx->req, resp, strlen(resp));
+		httpd_finalize_response(ctx);
+	}
+	return err;
+}
+
 #define append_or_flush_dir(...)								\
 	do {											\
 		int err = append_or_flush_(ctx, strbuf, sizeof(strbuf), &offset, __VA_ARGS__);	\
 		if (err < 0) {									\
-			gifplayer_unlock();							\
+			free(names);								\
 			return httpd_send_error(ctx, HTTPD_500);				\
 		}										\
 	} while (0)
 
+// Copy of all animation names, NUL separated and terminated by an empty name
+static char *http_copy_animation_names_(const char **active) {
+	const char *current_animation_name = gifplayer_get_name_of_playing_animation_();
+	const char *cursor;
+	size_t len = 1;
+	char *names, *pos;
+
+	GIFPLAYER_FOR_EACH_ANIMATION(cursor) {
+		len += strlen(cursor) + 1;
+	}
+	names = malloc(len);
+	if (!names) {
+		return NULL;
+	}
+
+	*active = NULL;
+	pos = names;
+	GIFPLAYER_FOR_EACH_ANIMATION(cursor) {
+		if (current_animation_name && !strcmp(cursor, current_animation_name)) {
+			*active = pos;
+		}
+		pos = stpcpy(pos, cursor) + 1;
+	}
+	*pos = '\0';
+	return names;
+}
+
 static esp_err_t http_get_animations(struct httpd_request_ctx* ctx, void* priv) {
 	char strbuf[64] = { 0 };
 	off_t offset = 0;
-	const char *current_animation_name, *cursor;
+	const char *active, *name;
+	animation_info_t info;
+	transcoder_status_t transcode;
+	bool has_info, has_transcode;
+	char *names, *path;
 
 	(void)priv;
+	// Index and transcoder status reads hit the file system, do not hold up playback with them
 	gifplayer_lock();
-	current_animation_name = gifplayer_get_name_of_playing_animation_();
+	names = http_copy_animation_names_(&active);
+	gifplayer_unlock();
+	if (!names) {
+		return httpd_send_error(ctx, HTTPD_500);
+	}
+
 	append_or_flush_dir("{ \"animations\": [");
-	GIFPLAYER_FOR_EACH_ANIMATION(cursor) {
-		if (cursor != gifplayer_get_first_animation_name_()) {
+	for (name = names; *name; name += strlen(name) + 1) {
+		if (name != names) {
 			append_or_flush_dir(", ");
 		}
-		append_or_flush_dir("{ \"name\": \"%s\"", cursor);
-		if (current_animation_name && !strcmp(cursor, current_animation_name)) {
+		append_or_flush_dir("{ \"name\": \"%s\"", name);
+		path = futil_path_concat(name, GIFPLAYER_BASE_DIR);
+		// Index only, animations are not opened for listing
+		has_info = path && !animation_index_get_info(path, &info);
+		has_transcode = path && !transcoder_get_status(path, &transcode);
+		free(path);
+		if (has_info) {
+			append_or_flush_dir(", \"frames\": %u", (unsigned int)info.num_frames);
+			append_or_flush_dir(", \"duration_ms\": %u", (unsigned int)info.duration_ms);
+			if (info.error) {
+				append_or_flush_dir(", \"scan_error\": %d", (int)info.error);
+			}
+		}
+		if (has_transcode) {
+			append_or_flush_dir(", \"transcode\": \"%s\"", transcoder_state_to_str(transcode.state));
+		}
+		if (name == active) {
+			gui_gifplayer_stats_t stats;
+
+			gifplayer_get_stats(&stats);
 			append_or_flush_dir(", \"active\": true");
+			append_or_flush_dir(", \"cache\": \"%s\"", gui_gifplayer_cache_state_to_str(stats.cache_state));
+			append_or_flush_dir(", \"cache_frames\": %u", stats.cache_frames);
+			append_or_flush_dir(", \"cache_bytes\": %u", (unsigned int)stats.cache_size);
+			append_or_flush_dir(", \"fps_nominal\": %.1f", stats.fps_nominal);
+			append_or_flush_dir(", \"fps_achieved\": %.1f", stats.fps_achieved);
+			// Display link usage, shows how much damage tracking saves on the SPI bus
+			append_or_flush_dir(", \"display_tx_bytes_per_second\": %u", oled_get_tx_bytes_per_second());
+			append_or_flush_dir(", \"display_tx_bytes_total\": %"PRIu64, oled_get_tx_bytes_total());
+			append_or_flush_dir(", \"frames_skipped\": %u", stats.frames_skipped);
 		}
 		append_or_flush_dir("}");
 	}
@@ -151,7 +684,7 @@ static esp_err_t http_get_animations(struct httpd_request_ctx* ctx, void* priv)
 	if (offset) {
 		httpd_resp_send_chunk(ctx->req, strbuf, offset);
 	}
-	gifplayer_unlock();
+	free(names);
 	httpd_finalize_response(ctx);
 	return ESP_OK;
 }
@@ -200,12 +733,16 @@ static esp_err_t http_get_delete_animation(struct httpd_request_ctx* ctx, void*
 	}
 
 	gifplayer_lock();
+	transcoder_cancel(abspath);
 	current_animation_name = gifplayer_get_name_of_playing_animation_();
 	if (current_animation_name && !strcmp(fname, current_animation_name)) {
 		ESP_LOGI(TAG, "Deleting currently active animation!");
 		gifplayer_stop_playback();
 	}
 
+	animation_cache_invalidate(abspath);
+	animation_index_remove(abspath);
+	animation_store_remove(abspath);
 	unlink(abspath);
 	free(abspath);
 	err = gifplayer_update_available_animations_();
@@ -218,6 +755,44 @@ static esp_err_t http_get_delete_animation(struct httpd_request_ctx* ctx, void*
 	return ESP_OK;
 }
 
+static esp_err_t http_get_transcode_status(struct httpd_request_ctx* ctx, void* priv) {
+	transcoder_status_t status;
+	char strbuf[160];
+	unsigned int progress = 0;
+	ssize_t param_len;
+	char* fname;
+	char* abspath;
+	int err;
+
+	if((param_len = httpd_query_string_get_param(ctx, "filename", &fname)) <= 0) {
+		return httpd_send_error(ctx, HTTPD_400);
+	}
+
+	abspath = futil_path_concat(fname, GIFPLAYER_BASE_DIR);
+	if (!abspath) {
+		return httpd_send_error(ctx, HTTPD_500);
+	}
+	err = transcoder_get_status(abspath, &status);
+	free(abspath);
+	if (err) {
+		return httpd_send_error(ctx, HTTPD_404);
+	}
+
+	if (status.state == TRANSCODER_STATE_DONE) {
+		progress = 100;
+	} else if (status.frames_total) {
+		progress = MIN(status.frames_done * 100 / status.frames_total, 99);
+	}
+	snprintf(strbuf, sizeof(strbuf),
+		 "{ \"state\": \"%s\", \"progress\": %u, \"frames_done\": %u, \"frames_total\": %u, "
+		 "\"frames_dropped\": %u, \"error\": %d }",
+		 transcoder_state_to_str(status.state), progress, status.frames_done, status.frames_total,
+		 status.frames_dropped, status.error);
+	httpd_resp_send_chunk(ctx->req, strbuf, strlen(strbuf));
+	httpd_finalize_response(ctx);
+	return ESP_OK;
+}
+
 static esp_err_t http_get_set_wlan_station_ssid_psk(struct httpd_request_ctx* ctx, void *priv) {
 	ssize_t param_len;
 	char *ssid, *psk;
@@ -255,9 +830,16 @@ static esp_err_t http_get_set_serial(struct httpd_request_ctx* ctx, void *priv)
 
 void api_init(httpd_t *httpd) {
 	ESP_ERROR_CHECK(httpd_add_post_handler(httpd, "/api/v1/upload_animation", http_post_upload_animation, NULL, 1, "filename"));
+	ESP_ERROR_CHECK(httpd_add_post_handler(httpd, "/api/v1/upload_animation_raw", http_post_upload_animation_raw, NULL, 1, "filename"));
+	ESP_ERROR_CHECK(httpd_add_post_handler(httpd, "/api/v1/preview_animation", http_post_preview_animation, NULL, 0));
+	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/persist_preview", http_get_persist_preview, NULL, 1, "filename"));
+	ESP_ERROR_CHECK(httpd_add_post_handler(httpd, "/api/v1/upload_chunk", http_post_upload_chunk, NULL, 1, "filename"));
+	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/upload_status", http_get_upload_status, NULL, 1, "filename"));
+	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/upload_commit", http_get_upload_commit, NULL, 3, "filename", "size", "crc32"));
 	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/animations", http_get_animations, NULL, 0));
 	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/set_animation", http_get_set_animation, NULL, 1, "filename"));
 	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/delete_animation", http_get_delete_animation, NULL, 1, "filename"));
+	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/transcode_status", http_get_transcode_status, NULL, 1, "filename"));
 
 	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/wlan/set_station_ssid_psk", http_get_set_wlan_station_ssid_psk, NULL, 2, "ssid", "psk"));
 	ESP_ERROR_CHECK(httpd_add_get_handler(httpd, "/api/v1/vendor/set_serial", http_get_set_serial, NULL, 1, "serial"));
@@ -96,6 +96,24 @@ int dirent_cache_update_(dirent_cache_t *cache, const char *path) {
 	return 0;
 }
 
+int dirent_cache_add_entry_(dirent_cache_t *cache, const char *name) {
+	size_t entry_size = strlen(name) + 1;
+	char *cache_data;
+
+	if (dirent_cache_find_entry_(cache, name)) {
+		return 0;
+	}
+
+	cache_data = realloc(cache->cache, cache->cache_size + entry_size);
+	if (!cache_data) {
+		return -ENOMEM;
+	}
+	strcpy(cache_data + cache->cache_size, name);
+	cache->cache = cache_data;
+	cache->cache_size += entry_size;
+	return 0;
+}
+
 int dirent_cache_update(dirent_cache_t *cache, const char *path) {
 	int err;
 
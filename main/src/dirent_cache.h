@@ -28,6 +28,8 @@ void dirent_cache_unlock(dirent_cache_t *cache);
 
 // Non-threadsafe methods, call only with cache lock held
 int dirent_cache_update_(dirent_cache_t *cache, const char *path);
+// Appends entry without rescanning the directory, no-op if it exists already
+int dirent_cache_add_entry_(dirent_cache_t *cache, const char *name);
 
 // Execution and result not threadsafe, obtain and use result only with cache lock held
 bool dirent_cache_iter_valid_(dirent_cache_t *cache, const char *iter);
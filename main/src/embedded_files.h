@@ -20,17 +20,25 @@
 	extern const uint8_t binary_ ## name_ ## _start[] asm("_binary_"STR(name_)"_start"); \
 	extern const uint8_t binary_ ## name_ ## _end[] asm("_binary_"STR(name_)"_end")
 
-DECLARE_EMBEDDED_FILE(animation_js);
-DECLARE_EMBEDDED_FILE(animation_thtml);
-DECLARE_EMBEDDED_FILE(bootstrap_bundle_min_js);
-DECLARE_EMBEDDED_FILE(bootstrap_min_css);
-DECLARE_EMBEDDED_FILE(datatables_min_css);
-DECLARE_EMBEDDED_FILE(favicon_ico);
-DECLARE_EMBEDDED_FILE(jquery_3_3_1_min_js);
-DECLARE_EMBEDDED_FILE(navbar_thtml);
-DECLARE_EMBEDDED_FILE(ota_js);
-DECLARE_EMBEDDED_FILE(ota_thtml);
-DECLARE_EMBEDDED_FILE(resources_html);
+// Quoted ETag generated by tools/embedded_etags.py, weak for templates
+#define EMBEDDED_FILE_ETAG(name_) \
+	embedded_file_etag_ ## name_
+
+#define DECLARE_EMBEDDED_WEB_FILE(name_) \
+	DECLARE_EMBEDDED_FILE(name_); \
+	extern const char embedded_file_etag_ ## name_[]
+
+DECLARE_EMBEDDED_WEB_FILE(animation_js);
+DECLARE_EMBEDDED_WEB_FILE(animation_thtml);
+DECLARE_EMBEDDED_WEB_FILE(bootstrap_bundle_min_js);
+DECLARE_EMBEDDED_WEB_FILE(bootstrap_min_css);
+DECLARE_EMBEDDED_WEB_FILE(datatables_min_css);
+DECLARE_EMBEDDED_WEB_FILE(favicon_ico);
+DECLARE_EMBEDDED_WEB_FILE(jquery_3_3_1_min_js);
+DECLARE_EMBEDDED_WEB_FILE(navbar_thtml);
+DECLARE_EMBEDDED_WEB_FILE(ota_js);
+DECLARE_EMBEDDED_WEB_FILE(ota_thtml);
+DECLARE_EMBEDDED_WEB_FILE(resources_html);
 
 DECLARE_EMBEDDED_FILE(battery_21x10_raw);
 DECLARE_EMBEDDED_FILE(wlan_ap_15x12_raw);
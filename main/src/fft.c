@@ -12,9 +12,15 @@
 
 static int gui_fft_render(gui_element_t *element, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size) {
 	gui_fft_t *fft = container_of(element, gui_fft_t, element);
-	int width = destination_size->x;
-	int height = destination_size->y;
+	int width = element->area.size.x;
+	int height = element->area.size.y;
+	gui_point_t clear_size = {
+		.x = MIN(width - source_offset->x, destination_size->x),
+		.y = MIN(height - source_offset->y, destination_size->y)
+	};
 
+	// Draw background, allows skipping everything below the FFT view
+	gui_fb_memset(fb, GUI_COLOR_BLACK, &clear_size);
 	microphone_get_last_fft(fft->fft_data, ARRAY_SIZE(fft->fft_data));
 	for (int i = 0; i < MIN(width, ARRAY_SIZE(fft->fft_data)); i++) {
 		float min_level = LEVEL_MIN;
@@ -26,10 +32,19 @@ static int gui_fft_render(gui_element_t *element, const gui_point_t *source_offs
 		float level = offset / delta_level;
 		float pos = level * (float)height;
 		pos = MIN(MAX(0, pos), (float)(height - 1));
-		int y = (height - 1) - (int)roundf(pos);
-		fb->pixels[y * fb->stride + i] = 255;
+		int x = i - source_offset->x;
+		int y = (height - 1) - (int)roundf(pos) - source_offset->y;
+
+		// Skip points outside of area being rendered
+		if (x < 0 || x >= destination_size->x || y < 0 || y >= destination_size->y) {
+			continue;
+		}
+		gui_fb_set_pixel(fb, x, y, 255);
 	}
 
+	// Whole view changes on next update
+	gui_element_invalidate(element);
+
 	// Update FFT view 50 times per second
 	return 20;
 }
@@ -39,7 +54,9 @@ static const gui_element_ops_t gui_fft_ops = {
 };
 
 gui_element_t *gui_fft_init(gui_fft_t *fft) {
-	return gui_element_init(&fft->element, &gui_fft_ops);
+	gui_element_init(&fft->element, &gui_fft_ops);
+	fft->element.opaque = true;
+	return &fft->element;
 }
 
 
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "util.h"
+
+// Pre-rasterized glyphs in display format, generated by tools/font_tables.py
+
+#define FONT_TABLE_GLYPH_MISSING	UINT32_MAX
+
+typedef struct font_table_glyph {
+	// Advance in 1/64 pixels
+	int16_t advance_x;
+	int8_t left;
+	int8_t top;
+	uint8_t width;
+	uint8_t rows;
+	uint32_t bitmap_offset;
+} font_table_glyph_t;
+
+typedef struct font_table {
+	unsigned int char_height_px;
+	unsigned int first_codepoint;
+	unsigned int num_glyphs;
+	const font_table_glyph_t *glyphs;
+	const uint8_t *bitmaps;
+} font_table_t;
+
+#if FONTS_HAVE_TABLES
+extern const font_table_t font_tables_droidsans_bold[];
+extern const unsigned int font_tables_droidsans_bold_num;
+#endif
@@ -1,12 +1,21 @@
 #include "fonts.h"
 
+#include <stdlib.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
 #include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 
 #include <esp_log.h>
 #include <esp_debug_helpers.h>
 
 #include "embedded_files.h"
+#include "font_tables.h"
+#include "list.h"
+#include "pixel_ops.h"
 #include "util.h"
 
 #define DPI			85
@@ -14,39 +23,258 @@
 #define PIXELS_TO_DOTS(x)	((x) * DOTSIZE)
 #define DOTS_TO_PIXELS(x)	DIV_ROUND((x), DOTSIZE)
 
+#define GLYPH_CACHE_BUDGET_DEFAULT	KIB(16)
+#define GLYPH_CACHE_NUM_BUCKETS		64
+
+struct font {
+	const uint8_t *ttf;
+	size_t ttf_size;
+	const font_table_t *tables;
+	unsigned int num_tables;
+	// Loaded on first use only
+	FT_Face face;
+	bool load_failed;
+};
+
+// Rasterized glyph in display format
+typedef struct font_glyph {
+	int left;
+	int top;
+	unsigned int width;
+	unsigned int rows;
+	unsigned int stride;
+	FT_Vector advance;
+	const uint8_t *bitmap;
+} font_glyph_t;
+
+typedef struct font_glyph_cache_entry {
+	list_head_t bucket;
+	list_head_t lru;
+	font_t font;
+	unsigned int char_height_px;
+	unsigned int codepoint;
+	font_glyph_t glyph;
+	uint8_t bitmap[];
+} font_glyph_cache_entry_t;
+
 static const char *TAG = "fonts";
 
 static FT_Library ftlib = NULL;
-static font_t ftface_default = NULL;
+static struct font font_default = { 0 };
+
+static StaticSemaphore_t fonts_lock_buffer;
+static SemaphoreHandle_t fonts_lock;
+
+static list_head_t glyph_cache_buckets[GLYPH_CACHE_NUM_BUCKETS];
+// Least recently used glyph first
+static DECLARE_LIST_HEAD(glyph_cache_lru);
+static font_glyph_cache_stats_t glyph_cache_stats = {
+	.budget = GLYPH_CACHE_BUDGET_DEFAULT
+};
 
 void fonts_init(void) {
+	fonts_lock = xSemaphoreCreateMutexStatic(&fonts_lock_buffer);
+	for (int i = 0; i < ARRAY_SIZE(glyph_cache_buckets); i++) {
+		INIT_LIST_HEAD(glyph_cache_buckets[i]);
+	}
+
+	font_default.ttf = EMBEDDED_FILE_PTR(droidsans_bold_ttf);
+	font_default.ttf_size = EMBEDDED_FILE_PTR_END(droidsans_bold_ttf) - EMBEDDED_FILE_PTR(droidsans_bold_ttf);
+#if FONTS_HAVE_TABLES
+	font_default.tables = font_tables_droidsans_bold;
+	font_default.num_tables = font_tables_droidsans_bold_num;
+#endif
+	ESP_LOGI(TAG, "Default font has %u pre-rasterized sizes", font_default.num_tables);
+}
+
+font_t fonts_get_default_font(void) {
+	return &font_default;
+}
+
+// FreeType is only needed for glyphs not covered by the tables, load it on demand
+static FT_Error fonts_load_freetype_(font_t font) {
 	FT_Error fterr;
 
-	fterr = FT_Init_FreeType(&ftlib);
-	if (fterr) {
-		ESP_LOGE(TAG, "Failed to initialize libfreetype: %s (%d)", FT_Error_String(fterr), fterr);
-	} else {
-		fterr = FT_New_Memory_Face(ftlib, EMBEDDED_FILE_PTRS_SIZE(droidsans_bold_ttf), 0, &ftface_default);
+	if (font->face) {
+		return 0;
+	}
+	if (font->load_failed) {
+		return FT_Err_Invalid_Face_Handle;
+	}
+
+	if (!ftlib) {
+		fterr = FT_Init_FreeType(&ftlib);
 		if (fterr) {
-			ESP_LOGE(TAG, "Failed to load font from memory: %s (%d)", FT_Error_String(fterr), fterr);
-		} else {
-			ESP_LOGI(TAG, "Font %s loaded", STR_NULL(FT_Get_Postscript_Name(ftface_default)));
+			ESP_LOGE(TAG, "Failed to initialize libfreetype: %s (%d)", FT_Error_String(fterr), fterr);
+			font->load_failed = true;
+			return fterr;
 		}
 	}
+
+	fterr = FT_New_Memory_Face(ftlib, font->ttf, font->ttf_size, 0, &font->face);
+	if (fterr) {
+		ESP_LOGE(TAG, "Failed to load font from memory: %s (%d)", FT_Error_String(fterr), fterr);
+		font->load_failed = true;
+		return fterr;
+	}
+	ESP_LOGI(TAG, "Font %s loaded", STR_NULL(FT_Get_Postscript_Name(font->face)));
+	return 0;
 }
 
-font_t fonts_get_default_font(void) {
-	return ftface_default;
+static bool glyph_from_table(font_t font, unsigned int char_height_px, unsigned int codepoint, font_glyph_t *glyph) {
+	for (unsigned int i = 0; i < font->num_tables; i++) {
+		const font_table_t *table = &font->tables[i];
+		const font_table_glyph_t *table_glyph;
+
+		if (table->char_height_px != char_height_px) {
+			continue;
+		}
+		if (codepoint < table->first_codepoint || codepoint - table->first_codepoint >= table->num_glyphs) {
+			return false;
+		}
+		table_glyph = &table->glyphs[codepoint - table->first_codepoint];
+		if (table_glyph->bitmap_offset == FONT_TABLE_GLYPH_MISSING) {
+			return false;
+		}
+
+		glyph->left = table_glyph->left;
+		glyph->top = table_glyph->top;
+		glyph->width = table_glyph->width;
+		glyph->rows = table_glyph->rows;
+		glyph->stride = DIV_ROUND_UP(table_glyph->width, 2);
+		glyph->advance.x = table_glyph->advance_x;
+		glyph->advance.y = 0;
+		glyph->bitmap = &table->bitmaps[table_glyph->bitmap_offset];
+		return true;
+	}
+
+	return false;
 }
 
-int fonts_calculate_text_params(font_t font, unsigned int char_height_px, const char *str, font_text_params_t *params) {
+static size_t glyph_cache_entry_size(const font_glyph_cache_entry_t *entry) {
+	return sizeof(*entry) + entry->glyph.stride * entry->glyph.rows;
+}
+
+static list_head_t *glyph_cache_bucket(font_t font, unsigned int char_height_px, unsigned int codepoint) {
+	uintptr_t hash = (uintptr_t)font ^ (char_height_px * 31) ^ (codepoint * 131);
+
+	return &glyph_cache_buckets[hash % GLYPH_CACHE_NUM_BUCKETS];
+}
+
+static void glyph_cache_evict_(size_t required_size) {
+	while (!LIST_IS_EMPTY(&glyph_cache_lru) &&
+	       glyph_cache_stats.size + required_size > glyph_cache_stats.budget) {
+		font_glyph_cache_entry_t *entry = LIST_GET_ENTRY(glyph_cache_lru.next, font_glyph_cache_entry_t, lru);
+
+		LIST_DELETE(&entry->lru);
+		LIST_DELETE(&entry->bucket);
+		glyph_cache_stats.size -= glyph_cache_entry_size(entry);
+		glyph_cache_stats.num_glyphs--;
+		glyph_cache_stats.evictions++;
+		free(entry);
+	}
+}
+
+static FT_Error glyph_rasterize_(font_t font, unsigned int char_height_px, unsigned int codepoint, font_glyph_t *glyph) {
+	FT_Error fterr;
+	FT_GlyphSlotRec *slot;
+	font_glyph_cache_entry_t *entry;
+	unsigned int stride;
+
+	fterr = fonts_load_freetype_(font);
+	if (fterr) {
+		return fterr;
+	}
+
+	fterr = FT_Set_Char_Size(font->face, 0, PIXELS_TO_DOTS(char_height_px), DPI, DPI);
+	if (fterr) {
+		ESP_LOGE(TAG, "Failed to set font char size: %s (%d)", FT_Error_String(fterr), fterr);
+		return fterr;
+	}
+
+	fterr = FT_Load_Char(font->face, codepoint, FT_LOAD_RENDER);
+	if (fterr) {
+		ESP_LOGE(TAG, "Failed to load char '%c': %s (%d)", codepoint, FT_Error_String(fterr), fterr);
+		return fterr;
+	}
+	slot = font->face->glyph;
+
+	stride = DIV_ROUND_UP(slot->bitmap.width, 2);
+	// Always cache the new glyph, budget may be exceeded by a single glyph
+	glyph_cache_evict_(sizeof(*entry) + stride * slot->bitmap.rows);
+	entry = malloc(sizeof(*entry) + stride * slot->bitmap.rows);
+	if (!entry) {
+		ESP_LOGE(TAG, "Failed to allocate glyph cache entry");
+		return FT_Err_Out_Of_Memory;
+	}
+
+	entry->font = font;
+	entry->char_height_px = char_height_px;
+	entry->codepoint = codepoint;
+	entry->glyph.left = slot->bitmap_left;
+	entry->glyph.top = slot->bitmap_top;
+	entry->glyph.width = slot->bitmap.width;
+	entry->glyph.rows = slot->bitmap.rows;
+	entry->glyph.stride = stride;
+	entry->glyph.advance = slot->advance;
+	entry->glyph.bitmap = entry->bitmap;
+	for (unsigned int y = 0; y < entry->glyph.rows; y++) {
+		pixel_pack_8bpp(&entry->bitmap[y * stride], 0, &slot->bitmap.buffer[y * slot->bitmap.pitch], entry->glyph.width);
+	}
+
+	LIST_APPEND(&entry->bucket, glyph_cache_bucket(font, char_height_px, codepoint));
+	LIST_APPEND_TAIL(&entry->lru, &glyph_cache_lru);
+	glyph_cache_stats.size += glyph_cache_entry_size(entry);
+	glyph_cache_stats.num_glyphs++;
+	*glyph = entry->glyph;
+	return 0;
+}
+
+static FT_Error glyph_get_(font_t font, unsigned int char_height_px, unsigned int codepoint, font_glyph_t *glyph) {
+	list_head_t *bucket;
+	font_glyph_cache_entry_t *entry;
+
+	if (glyph_from_table(font, char_height_px, codepoint, glyph)) {
+		glyph_cache_stats.table_hits++;
+		return 0;
+	}
+
+	bucket = glyph_cache_bucket(font, char_height_px, codepoint);
+	LIST_FOR_EACH_ENTRY(entry, bucket, bucket) {
+		if (entry->font == font && entry->char_height_px == char_height_px && entry->codepoint == codepoint) {
+			// Move to most recently used position
+			LIST_DELETE(&entry->lru);
+			LIST_APPEND_TAIL(&entry->lru, &glyph_cache_lru);
+			glyph_cache_stats.hits++;
+			*glyph = entry->glyph;
+			return 0;
+		}
+	}
+
+	glyph_cache_stats.misses++;
+	return glyph_rasterize_(font, char_height_px, codepoint, glyph);
+}
+void fonts_set_glyph_cache_budget(size_t budget) {
+	xSemaphoreTake(fonts_lock, portMAX_DELAY);
+	glyph_cache_stats.budget = budget;
+	glyph_cache_evict_(0);
+	xSemaphoreGive(fonts_lock);
+}
+
+void fonts_get_glyph_cache_stats(font_glyph_cache_stats_t *stats) {
+	xSemaphoreTake(fonts_lock, portMAX_DELAY);
+	*stats = glyph_cache_stats;
+	xSemaphoreGive(fonts_lock);
+}
+
+static int fonts_calculate_text_params_(font_t font, unsigned int char_height_px, const char *str, font_text_params_t *params) {
 	FT_Error fterr;
 	FT_Vector pos = { .x = 0, .y = 0 };
 	int width = 0;
-	int height = 0;
+	int max_bottom = INT_MIN;
 	int max_top = INT_MIN;
-	int min_top = INT_MAX;
 
+	params->char_height_px = char_height_px;
 	str = STR_NULL(str);
 	if (!*str) {
 		params->max_top = 0;
@@ -55,42 +283,42 @@ int fonts_calculate_text_params(font_t font, unsigned int char_height_px, const
 		return 0;
 	}
 
-	fterr = FT_Set_Char_Size(font, 0, PIXELS_TO_DOTS(char_height_px), DPI, DPI);
-	if (fterr) {
-		ESP_LOGE(TAG, "Failed to set font char size: %s (%d)", FT_Error_String(fterr), fterr);
-		return fterr;
-	}
-
 	while (*str) {
-		char c = *str++;
+		unsigned char c = *str++;
 		int glyph_pos_x = DOTS_TO_PIXELS(pos.x);
 		int glyph_pos_y = DOTS_TO_PIXELS(pos.y);
-		FT_GlyphSlotRec *glyph;
+		font_glyph_t glyph;
 
-		fterr = FT_Load_Char(font, c, FT_LOAD_RENDER);
+		fterr = glyph_get_(font, char_height_px, c, &glyph);
 		if (fterr) {
-			ESP_LOGE(TAG, "Failed to load char '%c': %s (%d)", c, FT_Error_String(fterr), fterr);
 			return fterr;
 		}
-		glyph = font->glyph;
-
-		width = MAX(width, glyph_pos_x + glyph->bitmap.width + glyph->bitmap_left);
-		height = MAX(height, glyph_pos_y + glyph->bitmap.rows + glyph->bitmap_top);
 
-		min_top = MIN(min_top, glyph->bitmap_top);
-		max_top = MAX(max_top, glyph->bitmap_top);
+		width = MAX(width, glyph_pos_x + (int)glyph.width + glyph.left);
+		// Bottom edge relative to baseline
+		max_bottom = MAX(max_bottom, glyph_pos_y + (int)glyph.rows - glyph.top);
+		max_top = MAX(max_top, glyph.top);
 
-		pos.x += font->glyph->advance.x;
-		pos.y += font->glyph->advance.y;
+		pos.x += glyph.advance.x;
+		pos.y += glyph.advance.y;
 	}
 
 	params->max_top = max_top;
 	params->effective_size.x = width;
-	params->effective_size.y = height - min_top;
+	params->effective_size.y = MAX(max_top + max_bottom, 0);
 	return 0;
 }
 
-int fonts_render_string(font_t font, const char *str, const font_text_params_t *params, const font_vec_t *source_offset, const font_fb_t *fb) {
+int fonts_calculate_text_params(font_t font, unsigned int char_height_px, const char *str, font_text_params_t *params) {
+	int err;
+
+	xSemaphoreTake(fonts_lock, portMAX_DELAY);
+	err = fonts_calculate_text_params_(font, char_height_px, str, params);
+	xSemaphoreGive(fonts_lock);
+	return err;
+}
+
+static int fonts_render_string_(font_t font, const char *str, const font_text_params_t *params, const font_vec_t *source_offset, const font_fb_t *fb) {
 	FT_Error fterr;
 	FT_Vector pos = { .x = 0, .y = 0 };
 	int max_top = params->max_top;
@@ -98,41 +326,48 @@ int fonts_render_string(font_t font, const char *str, const font_text_params_t *
 	str = STR_NULL(str);
 
 	while (*str) {
-		char c = *str++;
+		unsigned char c = *str++;
 		int dst_x = DOTS_TO_PIXELS(pos.x) - source_offset->x;
 		int dst_y = DOTS_TO_PIXELS(pos.y) - source_offset->y;
 		unsigned int offset_x = 0;
-		FT_GlyphSlotRec *glyph;
+		font_glyph_t glyph;
 
-		fterr = FT_Load_Char(font, c, FT_LOAD_RENDER);
+		fterr = glyph_get_(font, params->char_height_px, c, &glyph);
 		if (fterr) {
-			ESP_LOGE(TAG, "Failed to load char '%c': %s (%d)", c, FT_Error_String(fterr), fterr);
 			return fterr;
 		}
-		glyph = font->glyph;
 
-		dst_x += glyph->bitmap_left;
-		dst_y += max_top - glyph->bitmap_top;
+		dst_x += glyph.left;
+		dst_y += max_top - glyph.top;
 		if (dst_x < 0) {
 			offset_x += -dst_x;
 			dst_x = 0;
 		}
-		if (dst_x < fb->size.x && dst_y < fb->size.y && offset_x < font->glyph->bitmap.width) {
-			unsigned int draw_width = MIN(font->glyph->bitmap.width, fb->size.x - dst_x);
-			unsigned int draw_height = MIN(font->glyph->bitmap.rows, fb->size.y - dst_y);
+		if (dst_x < fb->size.x && dst_y < fb->size.y && offset_x < glyph.width) {
+			unsigned int draw_width = MIN(glyph.width - offset_x, fb->size.x - dst_x);
+			unsigned int draw_height = MIN(glyph.rows, fb->size.y - dst_y);
 			unsigned int y = 0;
 
 			if (dst_y < 0) {
 				y = -dst_y;
 			}
 			for (; y < draw_height; y++) {
-				memcpy(&fb->pixels[(dst_y + y) * fb->stride + dst_x], &glyph->bitmap.buffer[glyph->bitmap.width * y + offset_x], draw_width - offset_x);
+				pixel_copy_4bpp(&fb->pixels[(dst_y + y) * fb->stride], fb->x + dst_x, &glyph.bitmap[y * glyph.stride], offset_x, draw_width);
 			}
 		}
 
-		pos.x += glyph->advance.x;
-		pos.y += glyph->advance.y;
+		pos.x += glyph.advance.x;
+		pos.y += glyph.advance.y;
 	}
 
 	return 0;
 }
+
+int fonts_render_string(font_t font, const char *str, const font_text_params_t *params, const font_vec_t *source_offset, const font_fb_t *fb) {
+	int err;
+
+	xSemaphoreTake(fonts_lock, portMAX_DELAY);
+	err = fonts_render_string_(font, str, params, source_offset, fb);
+	xSemaphoreGive(fonts_lock);
+	return err;
+}
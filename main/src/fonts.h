@@ -3,30 +3,45 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
-
-typedef FT_Face font_t;
+typedef struct font *font_t;
 
 typedef struct font_vec {
 	int x;
 	int y;
 } font_vec_t;
 
+// Display format, two 4 bit pixels per byte, first pixel in upper nibble
 typedef struct font_fb {
 	uint8_t *pixels;
 	unsigned int stride;
+	// Pixel offset of first column relative to pixels
+	unsigned int x;
 	font_vec_t size;
 } font_fb_t;
 
 typedef struct font_text_params {
+	unsigned int char_height_px;
 	int max_top;
 	font_vec_t effective_size;
 } font_text_params_t;
 
+typedef struct font_glyph_cache_stats {
+	// Glyphs served from pre-rasterized tables
+	unsigned int table_hits;
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+	unsigned int num_glyphs;
+	size_t size;
+	size_t budget;
+} font_glyph_cache_stats_t;
+
 void fonts_init(void);
 font_t fonts_get_default_font(void);
 
 int fonts_calculate_text_params(font_t font, unsigned int char_height_px, const char *str, font_text_params_t *params);
 
 int fonts_render_string(font_t font, const char *str, const font_text_params_t *params, const font_vec_t *source_offset, const font_fb_t *fb);
+
+void fonts_set_glyph_cache_budget(size_t budget);
+void fonts_get_glyph_cache_stats(font_glyph_cache_stats_t *stats);
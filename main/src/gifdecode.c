@@ -0,0 +1,113 @@
+#include "gifdecode.h"
+
+#include <string.h>
+
+#include "pixel_ops.h"
+#include "util.h"
+
+// ITU-R BT.601 luma weights, scaled to 256
+#define LUMA_WEIGHT_R	77
+#define LUMA_WEIGHT_G	150
+#define LUMA_WEIGHT_B	29
+
+void gifdecode_canvas_init(gifdecode_canvas_t *canvas, uint8_t *pixels, unsigned int stride, unsigned int width, unsigned int height) {
+	canvas->pixels = pixels;
+	canvas->stride = stride;
+	canvas->width = width;
+	canvas->height = height;
+	canvas->gray_lut_palette = NULL;
+	gifdecode_canvas_reset_damage(canvas);
+}
+
+void gifdecode_canvas_reset_damage(gifdecode_canvas_t *canvas) {
+	canvas->damage_x0 = canvas->width;
+	canvas->damage_y0 = canvas->height;
+	canvas->damage_x1 = 0;
+	canvas->damage_y1 = 0;
+}
+
+void gifdecode_build_luma_lut(uint8_t *luma_lut, const uint8_t *palette24) {
+	for (unsigned int i = 0; i < 256; i++) {
+		luma_lut[i] = (palette24[0] * LUMA_WEIGHT_R +
+			       palette24[1] * LUMA_WEIGHT_G +
+			       palette24[2] * LUMA_WEIGHT_B) >> 8;
+		palette24 += 3;
+	}
+}
+
+static void gifdecode_build_gray_lut(gifdecode_canvas_t *canvas, GIFDRAW *draw) {
+	gifdecode_build_luma_lut(canvas->gray_lut, draw->pPalette24);
+	for (unsigned int i = 0; i < 256; i++) {
+		canvas->gray_lut[i] = PIXEL_TO_4BPP(canvas->gray_lut[i]);
+	}
+
+	// Transparent pixels are replaced by background, no need to handle them while drawing
+	if (draw->ucDisposalMethod == 2) {
+		canvas->gray_lut[draw->ucTransparent] = canvas->gray_lut[draw->ucBackground];
+	}
+	canvas->gray_lut_palette = draw->pPalette24;
+}
+
+// Draw span of palette indices, two pixels at a time
+static void gifdecode_draw_span(uint8_t *row, unsigned int x, const uint8_t *src, unsigned int width, const uint8_t *lut) {
+	uint8_t *dst;
+
+	if (x % 2 && width) {
+		pixel_set_4bpp(row, x, lut[*src++]);
+		x++;
+		width--;
+	}
+
+	dst = &row[x / 2];
+	while (width >= 2) {
+		*dst++ = (lut[src[0]] << 4) | lut[src[1]];
+		src += 2;
+		width -= 2;
+	}
+
+	if (width) {
+		*dst = (*dst & 0x0f) | (lut[*src] << 4);
+	}
+}
+
+// Draw span of palette indices, keeping pixels below transparent ones
+static void gifdecode_draw_span_transparent(uint8_t *row, unsigned int x, const uint8_t *src, unsigned int width, const uint8_t *lut, uint8_t transparent) {
+	for (unsigned int i = 0; i < width; i++) {
+		if (src[i] != transparent) {
+			pixel_set_4bpp(row, x + i, lut[src[i]]);
+		}
+	}
+}
+
+void gifdecode_draw_line(GIFDRAW *draw) {
+	gifdecode_canvas_t *canvas = draw->pUser;
+	int y = draw->iY + draw->y;
+	uint8_t *row;
+	int draw_width;
+
+	if (y >= (int)canvas->height) {
+		return;
+	}
+
+	// Palette, transparency and disposal only change between frames
+	if (!draw->y || draw->pPalette24 != canvas->gray_lut_palette) {
+		gifdecode_build_gray_lut(canvas, draw);
+	}
+
+	row = &canvas->pixels[y * canvas->stride];
+	draw_width = MIN(draw->iX + draw->iWidth, (int)canvas->width) - draw->iX;
+	if (draw_width <= 0) {
+		return;
+	}
+
+	canvas->damage_x0 = MIN(canvas->damage_x0, draw->iX);
+	canvas->damage_x1 = MAX(canvas->damage_x1, draw->iX + draw_width);
+	canvas->damage_y0 = MIN(canvas->damage_y0, y);
+	canvas->damage_y1 = MAX(canvas->damage_y1, y + 1);
+
+	if (!draw->ucHasTransparency || draw->ucDisposalMethod == 2) {
+		gifdecode_draw_span(row, draw->iX, draw->pPixels, draw_width, canvas->gray_lut);
+	} else {
+		gifdecode_draw_span_transparent(row, draw->iX, draw->pPixels, draw_width, canvas->gray_lut, draw->ucTransparent);
+	}
+}
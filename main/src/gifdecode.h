@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <gif.h>
+
+// Target for decoded GIF frames in display format, two 4 bit pixels per byte
+typedef struct gifdecode_canvas {
+	uint8_t *pixels;
+	unsigned int stride;
+	unsigned int width;
+	unsigned int height;
+
+	// Managed properties
+	// 4 bit gray level of each palette entry of current frame
+	uint8_t gray_lut[256];
+	const uint8_t *gray_lut_palette;
+	// Bounding box of pixels drawn since last reset, end exclusive, empty if start >= end
+	int damage_x0, damage_y0, damage_x1, damage_y1;
+} gifdecode_canvas_t;
+
+void gifdecode_canvas_init(gifdecode_canvas_t *canvas, uint8_t *pixels, unsigned int stride, unsigned int width, unsigned int height);
+void gifdecode_canvas_reset_damage(gifdecode_canvas_t *canvas);
+// 8 bit luma of each of the 256 RGB888 palette entries
+void gifdecode_build_luma_lut(uint8_t *luma_lut, const uint8_t *palette24);
+
+// GIF draw callback, pUser passed to GIF_playFrame must point to a gifdecode_canvas_t
+void gifdecode_draw_line(GIFDRAW *draw);
@@ -4,27 +4,80 @@
 #include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <esp_heap_caps.h>
 #include <esp_log.h>
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 
+#include <sdkconfig.h>
+
+#include "animation_cache.h"
+#include "animation_index.h"
+#include "animation_store.h"
 #include "dirent_cache.h"
 #include "futil.h"
 #include "gui_priv.h"
+#include "pixel_ops.h"
+#include "scheduler.h"
 #include "settings.h"
 #include "util.h"
 
+#define GIF_DECODE_TASK_STACK_DEPTH	8192
+#define GIF_DECODE_TASK_PRIORITY	5
+// Decode on second core, away from the GUI and network stack
+#if CONFIG_FREERTOS_UNICORE
+#define GIF_DECODE_TASK_CORE		tskNO_AFFINITY
+#else
+#define GIF_DECODE_TASK_CORE		1
+#endif
+// Timeline is moved instead of skipping frames when falling behind further
+#define GIF_MAX_LAG_MS			500
+// Interval between steps of transitions between animations
+#define GIF_TRANSITION_STEP_MS		25
+
+#define GIFPLAYER_FRAME_SIZE		(GUI_FB_STRIDE(GIFPLAYER_WIDTH) * GIFPLAYER_HEIGHT)
+// Budget for caching decoded loops, depending on availability of PSRAM
+#define GIFPLAYER_CACHE_BUDGET_SPIRAM	KIB(1024)
+#define GIFPLAYER_CACHE_BUDGET_INTERNAL	KIB(CONFIG_GIFPLAYER_LOOP_CACHE_INTERNAL_KIB)
+// Copy animations to store and index them once playback has settled
+#define GIFPLAYER_SYNC_DELAY_US		5000000
+// RAM cache of animation files for fast switching, only worth it with PSRAM
+#define GIFPLAYER_FILE_CACHE_BUDGET_SPIRAM	KIB(2048)
+// Load neighbours of current animation into RAM cache after switching
+#define GIFPLAYER_PREFETCH_DELAY_US	500000
+// Animation being replaced, restored on boot if its replacement did not make it into place
+#define GIFPLAYER_BACKUP_DIR		"/flash/animation_backup"
+
 static const char *TAG = "gifplayer";
 
 static gui_gifplayer_t gifplayer;
-static gui_pixel_t render_fb[256 * 64];
+static uint8_t __attribute__((aligned(16))) render_fb[GIFPLAYER_FRAME_SIZE];
+static uint8_t __attribute__((aligned(16))) frame_fbs[GUI_GIFPLAYER_NUM_FRAMES][GIFPLAYER_FRAME_SIZE];
+// Allocated at init if a transition is configured, NULL otherwise
+static uint8_t *transition_fbs = NULL;
 static char *current_animation_path = NULL;
+static animation_store_mapping_t current_animation_mapping = { 0 };
+static const uint8_t *current_animation_cached = NULL;
+// Animation played from RAM buffer owned by player, not backed by a file
+static struct {
+	uint8_t *data;
+	size_t size;
+	bool playing;
+	// Referenced by gifplayer_get_preview_(), freed on release once not playing anymore
+	bool held;
+} preview;
+static scheduler_task_t sync_task;
+static scheduler_task_t prefetch_task;
+// Zero without PSRAM, animation files are not cached then
+static size_t file_cache_budget;
 static bool has_animation_changed = false;
 static gui_t *gui_root;
 
@@ -58,8 +111,91 @@ static bool on_button_event(const button_event_t *event, void *priv) {
 	return false;
 }
 
+// Add missing store copy and index of current animation
+static void gifplayer_sync_animation(void *ctx) {
+	animation_info_t info;
+	char *path = NULL;
+	bool mapped = false;
+	int err;
+
+	gifplayer_lock();
+	if (current_animation_path) {
+		path = strdup(current_animation_path);
+		mapped = !!current_animation_mapping.data;
+	}
+	gifplayer_unlock();
+
+	if (!path) {
+		return;
+	}
+
+	if (!mapped) {
+		err = animation_store_add(path);
+		if (err && err != -ENODEV) {
+			ESP_LOGW(TAG, "Failed to add '%s' to animation store: %d", path, err);
+		}
+	}
+	if (animation_index_get_info(path, &info)) {
+		err = animation_index_build(path);
+		if (err) {
+			ESP_LOGW(TAG, "Failed to index '%s': %d", path, err);
+		}
+	}
+	free(path);
+}
+
+static void gifplayer_prefetch(void *ctx);
+
+static void gifplayer_unmap_animation_(void) {
+	if (current_animation_mapping.data) {
+		animation_store_unmap(&current_animation_mapping);
+	}
+	if (current_animation_cached) {
+		animation_cache_release(current_animation_cached);
+		current_animation_cached = NULL;
+	}
+}
+
 static int gifplayer_load_animation_(void) {
-	int err = gui_gifplayer_load_animation_from_file(&gifplayer, current_animation_path);
+	animation_info_t info;
+	size_t size;
+	int err;
+
+	if (file_cache_budget) {
+		scheduler_schedule_task_relative(&prefetch_task, gifplayer_prefetch, NULL, GIFPLAYER_PREFETCH_DELAY_US);
+	}
+	if (!animation_index_get_info(current_animation_path, &info)) {
+		// Decide on caching upfront instead of finding out after decoding a loop
+		gui_gifplayer_set_frame_count_hint(&gifplayer, info.num_frames);
+	} else {
+		gui_gifplayer_set_frame_count_hint(&gifplayer, 0);
+		scheduler_schedule_task_relative(&sync_task, gifplayer_sync_animation, NULL, GIFPLAYER_SYNC_DELAY_US);
+	}
+	if (!animation_cache_get(current_animation_path, &current_animation_cached, &size)) {
+		err = gui_gifplayer_load_animation_from_memory(&gifplayer, current_animation_cached,
+							       current_animation_cached + size);
+		if (!err) {
+			return 0;
+		}
+		ESP_LOGW(TAG, "Failed to play '%s' from RAM cache: %d", current_animation_path, err);
+		gifplayer_unmap_animation_();
+	}
+
+	// Prefer mapped copy, no VFS layers in between flash and decoder
+	if (!animation_store_map(current_animation_path, &current_animation_mapping)) {
+		const uint8_t *data = current_animation_mapping.data;
+
+		err = gui_gifplayer_load_animation_from_memory(&gifplayer, data, data + current_animation_mapping.size);
+		if (!err) {
+			return 0;
+		}
+		ESP_LOGW(TAG, "Failed to play '%s' from store: %d", current_animation_path, err);
+		gifplayer_unmap_animation_();
+	} else {
+		scheduler_schedule_task_relative(&sync_task, gifplayer_sync_animation, NULL, GIFPLAYER_SYNC_DELAY_US);
+	}
+
+	err = gui_gifplayer_load_animation_from_file(&gifplayer, current_animation_path);
 	if (err) {
 		ESP_LOGE(TAG, "Failed to open GIF file '%s': %d", current_animation_path, err);
 		free(current_animation_path);
@@ -69,13 +205,31 @@ static int gifplayer_load_animation_(void) {
 	return err;
 }
 
-static int gifplayer_set_animation__(const char *path, const char *dir_prefix) {
-	gui_lock(gui_root);
-	if (current_animation_path) {
-		gui_gifplayer_load_animation_from_file(&gifplayer, NULL);
+static void gifplayer_free_preview_(void) {
+	if (preview.data && !preview.playing && !preview.held) {
+		heap_caps_free(preview.data);
+		preview.data = NULL;
+		preview.size = 0;
+	}
+}
+
+// Call with gui lock held
+static void gifplayer_close_animation_(bool keep_frame) {
+	if (current_animation_path || preview.playing) {
+		gui_gifplayer_close_animation(&gifplayer, keep_frame);
+		gifplayer_unmap_animation_();
 		free(current_animation_path);
 		current_animation_path = NULL;
+		// Decoder does not reference preview data anymore
+		preview.playing = false;
+		gifplayer_free_preview_();
 	}
+}
+
+static int gifplayer_set_animation__(const char *path, const char *dir_prefix) {
+	gui_lock(gui_root);
+	// Next animation transitions from frame on display
+	gifplayer_close_animation_(!!path);
 
 	if (path) {
 		int err;
@@ -102,6 +256,113 @@ static int gifplayer_set_animation__(const char *path, const char *dir_prefix) {
 	return 0;
 }
 
+int gifplayer_set_preview_(uint8_t *data, size_t size) {
+	int err;
+
+	gui_lock(gui_root);
+	// Only one preview buffer is tracked, keep playing whatever is on display if it can not be replaced
+	if (preview.held) {
+		gui_unlock(gui_root);
+		return -EBUSY;
+	}
+	gifplayer_close_animation_(true);
+	gui_gifplayer_set_frame_count_hint(&gifplayer, 0);
+	err = gui_gifplayer_load_animation_from_memory(&gifplayer, data, data + size);
+	if (err) {
+		ESP_LOGE(TAG, "Failed to play preview: %d", err);
+		gui_gifplayer_close_animation(&gifplayer, false);
+	} else {
+		preview.data = data;
+		preview.size = size;
+		preview.playing = true;
+	}
+	gui_unlock(gui_root);
+	return err;
+}
+
+bool gifplayer_is_preview_playing_(void) {
+	return preview.playing;
+}
+
+bool gifplayer_is_preview_held_(void) {
+	return preview.held;
+}
+
+const uint8_t *gifplayer_get_preview_(size_t *size) {
+	if (!preview.playing) {
+		return NULL;
+	}
+	preview.held = true;
+	*size = preview.size;
+	return preview.data;
+}
+
+void gifplayer_release_preview_(void) {
+	preview.held = false;
+	gifplayer_free_preview_();
+}
+
+// Old file is moved aside instead of being deleted, path refers to either file at all times
+static int gifplayer_move_into_place(const char *new_path, const char *path) {
+	char *backup_path = futil_path_concat(futil_fname(path), GIFPLAYER_BACKUP_DIR);
+	bool has_backup;
+	int err = 0;
+
+	if (!backup_path) {
+		return -ENOMEM;
+	}
+
+	has_backup = !rename(path, backup_path);
+	if (!has_backup && errno != ENOENT) {
+		err = -errno;
+		ESP_LOGE(TAG, "Failed to move '%s' aside: %d", path, err);
+		goto out;
+	}
+	if (rename(new_path, path)) {
+		err = -errno;
+		ESP_LOGE(TAG, "Failed to move '%s' to '%s': %d", new_path, path, err);
+		if (has_backup && rename(backup_path, path)) {
+			ESP_LOGE(TAG, "Failed to restore '%s': %d", path, errno);
+		}
+		goto out;
+	}
+	if (has_backup) {
+		unlink(backup_path);
+	}
+
+out:
+	free(backup_path);
+	return err;
+}
+
+int gifplayer_replace_animation_(const char *path, const char *new_path) {
+	bool playing;
+	int err = 0;
+
+	playing = current_animation_path && !strcmp(current_animation_path, path);
+	if (playing) {
+		// File must not be open while it is replaced, transition into new file from frame on display
+		gui_lock(gui_root);
+		gui_gifplayer_close_animation(&gifplayer, true);
+		gifplayer_unmap_animation_();
+		gui_unlock(gui_root);
+	}
+
+	// Flash erase and file moves, GUI keeps rendering meanwhile
+	animation_cache_invalidate(path);
+	animation_store_remove(path);
+	err = gifplayer_move_into_place(new_path, path);
+
+	if (playing) {
+		gui_lock(gui_root);
+		if (gifplayer_load_animation_()) {
+			gui_gifplayer_close_animation(&gifplayer, false);
+		}
+		gui_unlock(gui_root);
+	}
+	return err;
+}
+
 static int gifplayer_set_animation_relative_(const char *path) {
 	return gifplayer_set_animation__(path, GIFPLAYER_BASE_DIR);
 }
@@ -117,6 +378,75 @@ static void gifplayer_frame_played(void) {
 	}
 }
 
+// Uploads used to be received next to the animations, drop leftovers of interrupted ones
+static void gifplayer_remove_stale_uploads(void) {
+	struct dirent *cursor;
+	DIR *dir;
+
+	dir = opendir(GIFPLAYER_BASE);
+	if (!dir) {
+		return;
+	}
+	while ((cursor = readdir(dir))) {
+		const char *fext = futil_get_fext(cursor->d_name);
+		char *path;
+
+		if (!fext || strcmp(fext, "tmp")) {
+			continue;
+		}
+		path = futil_path_concat(cursor->d_name, GIFPLAYER_BASE_DIR);
+		if (path) {
+			ESP_LOGI(TAG, "Removing stale upload %s", cursor->d_name);
+			unlink(path);
+			free(path);
+		}
+	}
+	closedir(dir);
+}
+
+// Finish replacements interrupted by a power loss, old file is kept unless new one is in place
+static void gifplayer_restore_backups(void) {
+	struct dirent *cursor;
+	DIR *dir;
+
+	if (futil_dir_exists(GIFPLAYER_BACKUP_DIR)) {
+		remove(GIFPLAYER_BACKUP_DIR);
+		if (mkdir(GIFPLAYER_BACKUP_DIR, 0)) {
+			ESP_LOGE(TAG, "Failed to create backup directory: %d", errno);
+		}
+		return;
+	}
+
+	dir = opendir(GIFPLAYER_BACKUP_DIR);
+	if (!dir) {
+		return;
+	}
+	while ((cursor = readdir(dir))) {
+		char *backup_path = futil_path_concat(cursor->d_name, GIFPLAYER_BACKUP_DIR);
+		char *path = futil_path_concat(cursor->d_name, GIFPLAYER_BASE);
+		struct stat st;
+
+		if (backup_path && path) {
+			if (stat(path, &st)) {
+				ESP_LOGI(TAG, "Restoring %s", cursor->d_name);
+				rename(backup_path, path);
+			} else {
+				unlink(backup_path);
+			}
+		}
+		free(backup_path);
+		free(path);
+	}
+	closedir(dir);
+}
+
+// Called from decode task, only notifies render loop
+static void gifplayer_request_render(void) {
+	if (gui_root->ops->request_render) {
+		gui_root->ops->request_render(gui_root);
+	}
+}
+
 static void switch_to_first_animation_(void) {
 	const char *first_animation = gifplayer_get_first_animation_name_();
 
@@ -133,6 +463,8 @@ void gifplayer_init(gui_t *gui) {
 			.action_filter = (1 << BUTTON_ACTION_RELEASE)
 		}
 	};
+	gui_gifplayer_transition_t transition;
+	unsigned int transition_steps;
 
 	if (futil_dir_exists(GIFPLAYER_BASE)) {
 		ESP_LOGI(TAG, "Animation directory '"GIFPLAYER_BASE_DIR"' does not exists, creating it");
@@ -142,13 +474,37 @@ void gifplayer_init(gui_t *gui) {
 		}
 	}
 
+	gifplayer_remove_stale_uploads();
+	gifplayer_restore_backups();
+	animation_store_init();
+	scheduler_task_init(&sync_task);
+	animation_index_init();
+	file_cache_budget = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) ? GIFPLAYER_FILE_CACHE_BUDGET_SPIRAM : 0;
+	animation_cache_init(file_cache_budget);
+	scheduler_task_init(&prefetch_task);
+
 	dirent_cache_init(&animation_dirent_cache);
 	ESP_ERROR_CHECK(dirent_cache_update(&animation_dirent_cache, GIFPLAYER_BASE));
 
 	gui_root = gui;
-	gui_gifplayer_init(&gifplayer, render_fb);
+	transition = settings_get_animation_transition();
+	transition_steps = settings_get_animation_transition_steps();
+	if (transition != GUI_GIFPLAYER_TRANSITION_NONE && transition_steps >= 2) {
+		transition_fbs = heap_caps_aligned_alloc(16, 2 * GIFPLAYER_FRAME_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+		if (!transition_fbs) {
+			ESP_LOGW(TAG, "Not enough memory for transitions, using hard cuts");
+		}
+	}
+	gui_gifplayer_init(&gifplayer, render_fb, &frame_fbs[0][0], transition_fbs, GIFPLAYER_FRAME_SIZE);
 	gifplayer.frame_played_cb = gifplayer_frame_played;
-	gui_element_set_size(&gifplayer.element, 256, 64);
+	gifplayer.request_render_cb = gifplayer_request_render;
+	gui_gifplayer_set_transition(&gifplayer, transition, transition_steps);
+	if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM)) {
+		gui_gifplayer_set_cache_budget(&gifplayer, GIFPLAYER_CACHE_BUDGET_SPIRAM);
+	} else {
+		gui_gifplayer_set_cache_budget(&gifplayer, GIFPLAYER_CACHE_BUDGET_INTERNAL);
+	}
+	gui_element_set_size(&gifplayer.element, GIFPLAYER_WIDTH, GIFPLAYER_HEIGHT);
 	gui_element_add_child(&gui->container.element, &gifplayer.element);
 
 	current_animation_path = settings_get_default_animation();
@@ -178,8 +534,12 @@ void gifplayer_unlock() {
 	dirent_cache_unlock(&animation_dirent_cache);
 }
 
+void gifplayer_get_stats(gui_gifplayer_stats_t *stats) {
+	gui_gifplayer_get_stats(&gifplayer, stats);
+}
+
 bool gifplayer_is_animation_playing(void) {
-	return current_animation_path != NULL;
+	return current_animation_path != NULL || preview.playing;
 }
 
 int gifplayer_set_animation_(const char *path) {
@@ -204,6 +564,10 @@ int gifplayer_update_available_animations_(void) {
 	return dirent_cache_update_(&animation_dirent_cache, GIFPLAYER_BASE);
 }
 
+int gifplayer_add_available_animation_(const char *name) {
+	return dirent_cache_add_entry_(&animation_dirent_cache, name);
+}
+
 int gifplayer_update_available_animations(void) {
 	int err;
 
@@ -245,6 +609,46 @@ const char *get_prev_animation_name_(const char *animation_name) {
 	return dirent_cache_iter_prev_(&animation_dirent_cache, dircache_entry);
 }
 
+static char *get_animation_path_(const char *animation_name) {
+	return animation_name ? futil_path_concat(animation_name, GIFPLAYER_BASE_DIR) : NULL;
+}
+
+static void gifplayer_prefetch(void *ctx) {
+	const char *current_name, *next_name, *prev_name;
+	char *paths[3];
+
+	gifplayer_lock();
+	current_name = gifplayer_get_name_of_playing_animation_();
+	if (!current_name) {
+		gifplayer_unlock();
+		return;
+	}
+	next_name = get_next_animation_name_(current_name);
+	if (!next_name) {
+		next_name = gifplayer_get_first_animation_name_();
+	}
+	prev_name = get_prev_animation_name_(current_name);
+	if (!prev_name) {
+		prev_name = gifplayer_get_last_animation_name_();
+	}
+	// Current animation first, least likely to be evicted by its neighbours
+	paths[0] = current_animation_path ? strdup(current_animation_path) : NULL;
+	paths[1] = get_animation_path_(next_name);
+	paths[2] = get_animation_path_(prev_name);
+	gifplayer_unlock();
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(paths); i++) {
+		if (paths[i]) {
+			int err = animation_cache_load(paths[i]);
+
+			if (err && err != -ENOSPC) {
+				ESP_LOGD(TAG, "Failed to prefetch '%s': %d", paths[i], err);
+			}
+			free(paths[i]);
+		}
+	}
+}
+
 void gifplayer_play_prev_animation(void) {
 	const char *prev_animation_name;
 
@@ -281,12 +685,161 @@ const char *gifplayer_get_next_animation_name_(const char *cursor) {
 	return dirent_cache_iter_next_(&animation_dirent_cache, cursor);
 }
 
+static size_t gui_gifplayer_frame_size(const gui_gifplayer_t *player) {
+	const gui_element_t *element = &player->element;
+
+	return GUI_FB_STRIDE(element->area.size.x) * element->area.size.y;
+}
+
+// Move timeline past frame about to be shown
+static void gui_gifplayer_advance_timeline(gui_gifplayer_t *player, int duration_ms, bool loop_end, int64_t now) {
+	int64_t lag_us;
+
+	if (!player->timeline_started) {
+		player->timeline_started = true;
+		player->loop_start_us = now;
+		player->loop_offset_us = 0;
+		player->animation_start_us = now;
+	}
+
+	player->animation_frames++;
+	if (duration_ms <= 0) {
+		// Single frame or broken animation, nothing more to show
+		player->next_frame_deadline_us = -1;
+		return;
+	}
+	player->animation_nominal_us += duration_ms * 1000;
+
+	// Frame was due at this point of the loop
+	lag_us = now - (player->loop_start_us + player->loop_offset_us);
+	if (lag_us > GIF_MAX_LAG_MS * 1000) {
+		// Decoder stalled or display was blocked, catching up would look worse than slowing down
+		player->loop_start_us += lag_us;
+	}
+
+	player->loop_offset_us += duration_ms * 1000;
+	player->next_frame_deadline_us = player->loop_start_us + player->loop_offset_us;
+	if (loop_end) {
+		player->loop_start_us = player->next_frame_deadline_us;
+		player->loop_offset_us = 0;
+	}
+}
+
+// Frame is over already and a later one is ready to be shown instead
+static bool gui_gifplayer_should_skip(const gui_gifplayer_t *player, int64_t now) {
+	if (player->next_frame_deadline_us < 0 || now < player->next_frame_deadline_us || player->current_frame < 0) {
+		return false;
+	}
+
+	return uxQueueMessagesWaiting(player->ready_frames) ||
+	       player->cache_state == GUI_GIFPLAYER_CACHE_COMPLETE;
+}
+
+static void gui_gifplayer_full_area(const gui_gifplayer_t *player, gui_area_t *area) {
+	area->position.x = 0;
+	area->position.y = 0;
+	area->size = player->element.area.size;
+}
+
+// Damage area the next frame is expected to change, render needs to be called once it is due
+static void gui_gifplayer_damage_next_frame(gui_gifplayer_t *player) {
+	gui_area_t damage;
+	uint8_t frame_idx;
+
+	if (xQueuePeek(player->ready_frames, &frame_idx, 0)) {
+		damage = player->frames[frame_idx].damage;
+	} else if (player->cache_state == GUI_GIFPLAYER_CACHE_COMPLETE && player->current_frame >= 0) {
+		damage = player->cache_frames[player->cache_next_frame].damage;
+	} else {
+		// Not decoded yet, its damage is added once it has been taken from the queue
+		damage.size.x = 0;
+		damage.size.y = 0;
+	}
+
+	if (gui_area_is_empty(&damage)) {
+		// Frame does not change anything, damage a single pixel to get called when it is due
+		damage.position.x = 0;
+		damage.position.y = 0;
+		damage.size.x = 1;
+		damage.size.y = 1;
+	}
+	gui_element_damage(&player->element, &damage);
+}
+
+static unsigned int gui_gifplayer_transition_step(const gui_gifplayer_t *player, int64_t now) {
+	return (now - player->transition_start_us) / (GIF_TRANSITION_STEP_MS * 1000) + 1;
+}
+
+static void gui_gifplayer_compose_transition(gui_gifplayer_t *player, const uint8_t *incoming, unsigned int step) {
+	const gui_point_t *size = &player->element.area.size;
+	unsigned int stride = GUI_FB_STRIDE(size->x);
+	const uint8_t *outgoing = player->transition_from_fb;
+	uint8_t *dst = player->transition_fb;
+
+	switch (player->transition) {
+	case GUI_GIFPLAYER_TRANSITION_CROSSFADE:
+		pixel_blend_bytes(dst, outgoing, incoming, step * PIXEL_BLEND_MAX / player->transition_steps, stride * size->y);
+		break;
+	case GUI_GIFPLAYER_TRANSITION_WIPE: {
+		unsigned int split_x = step * size->x / player->transition_steps;
+
+		for (int y = 0; y < size->y; y++) {
+			pixel_copy_4bpp(&dst[y * stride], 0, &incoming[y * stride], 0, split_x);
+			pixel_copy_4bpp(&dst[y * stride], split_x, &outgoing[y * stride], split_x, size->x - split_x);
+		}
+		break;
+	}
+	case GUI_GIFPLAYER_TRANSITION_SLIDE: {
+		unsigned int offset_y = step * size->y / player->transition_steps;
+		size_t outgoing_size = (size->y - offset_y) * stride;
+
+		pixel_copy_bytes(dst, &outgoing[offset_y * stride], outgoing_size);
+		pixel_copy_bytes(&dst[outgoing_size], incoming, offset_y * stride);
+		break;
+	}
+	case GUI_GIFPLAYER_TRANSITION_NONE:
+		pixel_copy_bytes(dst, incoming, stride * size->y);
+		break;
+	}
+}
+
+// Returns pixels to display while a transition is running
+static const uint8_t *gui_gifplayer_render_transition(gui_gifplayer_t *player, const uint8_t *incoming, int64_t now) {
+	unsigned int step = gui_gifplayer_transition_step(player, now);
+
+	// Every step changes the whole player
+	gui_gifplayer_full_area(player, &player->pending_damage);
+	if (!incoming) {
+		// Next animation is still being opened or decoded
+		player->transition_composed = false;
+		return player->transition_from_fb;
+	}
+	if (step >= player->transition_steps) {
+		player->transition_active = false;
+		return incoming;
+	}
+
+	gui_gifplayer_compose_transition(player, incoming, step);
+	player->transition_composed = true;
+	return player->transition_fb;
+}
+
 static int gui_gifplayer_render(gui_element_t *element, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size) {
 	gui_gifplayer_t *player = container_of(element, gui_gifplayer_t, element);
 	int64_t now;
-	int copy_width = MIN(element->area.size.x - source_offset->x, destination_size->x);
-	int copy_height = MIN(element->area.size.y - source_offset->y, destination_size->y);
-	int y;
+	gui_point_t copy_size = {
+		.x = MIN(element->area.size.x - source_offset->x, destination_size->x),
+		.y = MIN(element->area.size.y - source_offset->y, destination_size->y)
+	};
+	gui_fb_t player_fb = {
+		.stride = GUI_FB_STRIDE(element->area.size.x),
+		.x = 0
+	};
+	gui_fb_t src_fb;
+	gui_area_t render_area;
+	const uint8_t *pixels = NULL;
+	int64_t deadline_us;
+	int timeout_ms;
 
 	if (!player->animation_loaded) {
 		ESP_LOGI(TAG, "No animation loaded, nothing to render");
@@ -294,118 +847,544 @@ static int gui_gifplayer_render(gui_element_t *element, const gui_point_t *sourc
 	}
 
 	now = esp_timer_get_time();
-	if (now >= player->next_frame_deadline_us && player->next_frame_deadline_us >= 0) {
-		int duration_ms = -1;
-		int ret;
-
-		ret = GIF_playFrame(&player->animation, &duration_ms, player);
-		if (duration_ms > 0) {
-			player->next_frame_deadline_us = now + duration_ms * 1000;
+	while (now >= player->next_frame_deadline_us && player->next_frame_deadline_us >= 0) {
+		uint8_t frame_idx;
+		bool skip;
+
+		if (xQueueReceive(player->ready_frames, &frame_idx, 0)) {
+			const gui_gifplayer_frame_t *frame = &player->frames[frame_idx];
+
+			gui_gifplayer_advance_timeline(player, frame->duration_ms, frame->loop_end, now);
+			gui_area_union(&player->pending_damage, &frame->damage);
+			skip = gui_gifplayer_should_skip(player, now);
+			if (skip) {
+				// Decoded for correctness of following frames only
+				xQueueSend(player->free_frames, &frame_idx, 0);
+			} else {
+				if (player->current_frame >= 0) {
+					uint8_t prev_frame_idx = player->current_frame;
+
+					xQueueSend(player->free_frames, &prev_frame_idx, 0);
+				}
+				player->current_frame = frame_idx;
+			}
+		} else if (player->cache_state == GUI_GIFPLAYER_CACHE_COMPLETE && player->current_frame >= 0) {
+			// All decoded frames have been shown, continue looping from cache
+			const gui_gifplayer_cache_frame_t *frame = &player->cache_frames[player->cache_next_frame];
+
+			gui_gifplayer_advance_timeline(player, frame->duration_ms,
+						       player->cache_next_frame == player->cache_num_frames - 1, now);
+			gui_area_union(&player->pending_damage, &frame->damage);
+			skip = gui_gifplayer_should_skip(player, now);
+			if (!skip) {
+				pixel_copy_bytes(player->frames[player->current_frame].pixels, frame->pixels, gui_gifplayer_frame_size(player));
+			}
+			player->cache_next_frame = (player->cache_next_frame + 1) % player->cache_num_frames;
+			player->stats.frames_from_cache++;
 		} else {
-			player->next_frame_deadline_us = -1;
+			if (!player->underrun) {
+				player->underrun = true;
+				player->stats.underruns++;
+				// Frame might have been queued before decode task could see the underrun
+				if (uxQueueMessagesWaiting(player->ready_frames)) {
+					continue;
+				}
+			}
+			break;
 		}
 
+		player->underrun = false;
+		if (skip) {
+			player->stats.frames_skipped++;
+			continue;
+		}
+
+		player->stats.frames_shown++;
+		player->animation_frames_shown++;
 		if (player->frame_played_cb) {
 			player->frame_played_cb();
 		}
+		break;
 	}
 
-	for (y = 0; y < copy_height; y++) {
-		gui_pixel_t *dst = &fb->pixels[y * fb->stride];
-		const uint8_t *src = &player->render_fb[player->element.area.size.x * (y + source_offset->y) + source_offset->x];
+	if (player->current_frame >= 0) {
+		pixels = player->frames[player->current_frame].pixels;
+	}
+	if (player->transition_active) {
+		pixels = gui_gifplayer_render_transition(player, pixels, now);
+	}
 
-		memcpy(dst, src, copy_width * sizeof(gui_pixel_t));
+	// Only damaged area is copied
+	if (pixels) {
+		player_fb.pixels = (uint8_t *)pixels;
+		gui_fb_offset(&src_fb, &player_fb, source_offset->x, source_offset->y);
+		gui_fb_blit(fb, &src_fb, &copy_size);
+	} else {
+		// First frame is still being decoded
+		gui_fb_memset(fb, GUI_COLOR_BLACK, &copy_size);
 	}
 
-	now = esp_timer_get_time();
-	if (now >= player->next_frame_deadline_us) {
-		return 0;
+	// Frame changed outside of area damaged upfront, e.g. after skipping frames
+	render_area.position = *source_offset;
+	render_area.size = copy_size;
+	if (!gui_area_is_empty(&player->pending_damage) &&
+	    !gui_area_contains(&render_area, &player->pending_damage)) {
+		gui_element_damage(element, &player->pending_damage);
+		gui_element_check_render(element);
+	}
+	player->pending_damage.size.x = 0;
+	player->pending_damage.size.y = 0;
+
+	deadline_us = player->next_frame_deadline_us;
+	if (deadline_us >= 0) {
+		gui_gifplayer_damage_next_frame(player);
+		if (player->underrun) {
+			// Decode task requests render once frame is ready
+			deadline_us = -1;
+		}
 	}
+	if (player->transition_active) {
+		int64_t step_deadline_us = player->transition_start_us +
+			(int64_t)gui_gifplayer_transition_step(player, now) * GIF_TRANSITION_STEP_MS * 1000;
 
-	return DIV_ROUND(player->next_frame_deadline_us - now, 1000);
+		gui_element_invalidate(element);
+		deadline_us = deadline_us >= 0 ? MIN(deadline_us, step_deadline_us) : step_deadline_us;
+	}
+	if (deadline_us < 0) {
+		return -1;
+	}
+
+	timeout_ms = DIV_ROUND(deadline_us - now, 1000);
+	return MAX(timeout_ms, 0);
 }
 
 static const gui_element_ops_t gui_gifplayer_ops = {
 	.render = gui_gifplayer_render,
 };
 
-gui_element_t *gui_gifplayer_init(gui_gifplayer_t *player, gui_pixel_t *render_fb) {
+static void gui_gifplayer_cache_free_(gui_gifplayer_t *player) {
+	for (unsigned int i = 0; i < player->cache_num_frames; i++) {
+		heap_caps_free(player->cache_frames[i].pixels);
+	}
+	free(player->cache_frames);
+	player->cache_frames = NULL;
+	player->cache_num_frames = 0;
+	player->cache_frames_size = 0;
+	player->cache_next_frame = 0;
+}
+
+static void gui_gifplayer_cache_disable_(gui_gifplayer_t *player) {
+	gui_gifplayer_cache_free_(player);
+	player->cache_state = GUI_GIFPLAYER_CACHE_DISABLED;
+}
+
+// Add canvas to cache, play_ret is the result of GIF_playFrame
+static void gui_gifplayer_cache_frame_(gui_gifplayer_t *player, int duration_ms, const gui_area_t *damage, int play_ret) {
+	size_t frame_size = gui_gifplayer_frame_size(player);
+	gui_gifplayer_cache_frame_t *frame;
+
+	if (play_ret < 0 || (player->cache_num_frames + 1) * frame_size > player->cache_budget) {
+		ESP_LOGD(TAG, "Animation does not fit into cache");
+		gui_gifplayer_cache_disable_(player);
+		return;
+	}
+
+	if (player->cache_num_frames == player->cache_frames_size) {
+		unsigned int frames_size = MAX(player->cache_frames_size * 2, 8);
+		gui_gifplayer_cache_frame_t *frames = realloc(player->cache_frames, frames_size * sizeof(*frames));
+
+		if (!frames) {
+			gui_gifplayer_cache_disable_(player);
+			return;
+		}
+		player->cache_frames = frames;
+		player->cache_frames_size = frames_size;
+	}
+
+	frame = &player->cache_frames[player->cache_num_frames];
+	frame->pixels = heap_caps_malloc_prefer(frame_size, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT);
+	if (!frame->pixels) {
+		ESP_LOGW(TAG, "Failed to allocate cache frame");
+		gui_gifplayer_cache_disable_(player);
+		return;
+	}
+	pixel_copy_bytes(frame->pixels, player->render_fb, frame_size);
+	frame->duration_ms = duration_ms;
+	frame->damage = *damage;
+	if (!player->cache_num_frames) {
+		// Follows last frame of loop when played from cache
+		gui_gifplayer_full_area(player, &frame->damage);
+	}
+	player->cache_num_frames++;
+}
+
+// Decode next frame and queue it, returns false if there is nothing to decode
+static bool gui_gifplayer_decode_frame(gui_gifplayer_t *player, uint8_t frame_idx) {
+	gui_element_t *element = &player->element;
+	gui_gifplayer_frame_t *frame = &player->frames[frame_idx];
+	gui_gifplayer_stats_t *stats = &player->stats;
+	int duration_ms = -1;
+	int64_t decode_start;
+	unsigned int decode_time_us;
+	bool loop_cached = false;
+	gui_area_t damage;
+	int play_ret;
+
+	xSemaphoreTake(player->decode_lock, portMAX_DELAY);
+	if (!player->animation_loaded || player->decode_finished) {
+		xSemaphoreGive(player->decode_lock);
+		return false;
+	}
+
+	decode_start = esp_timer_get_time();
+	if (player->is_oan) {
+		play_ret = oan_play_frame(&player->oan, player->render_fb, &duration_ms);
+		damage.position.x = 0;
+		damage.position.y = player->oan.changed_first_row;
+		damage.size.x = element->area.size.x;
+		damage.size.y = player->oan.changed_num_rows;
+	} else {
+		gifdecode_canvas_reset_damage(&player->canvas);
+		play_ret = GIF_playFrame(&player->animation, &duration_ms, &player->canvas);
+		damage.position.x = player->canvas.damage_x0;
+		damage.position.y = player->canvas.damage_y0;
+		damage.size.x = MAX(player->canvas.damage_x1 - player->canvas.damage_x0, 0);
+		damage.size.y = MAX(player->canvas.damage_y1 - player->canvas.damage_y0, 0);
+	}
+	if (player->full_damage_pending || play_ret < 0) {
+		gui_gifplayer_full_area(player, &damage);
+		player->full_damage_pending = false;
+	}
+	frame->damage = damage;
+	// Decoder canvas is the base for the next frame, queue a copy
+	pixel_copy_bytes(frame->pixels, player->render_fb, GUI_FB_STRIDE(element->area.size.x) * element->area.size.y);
+	decode_time_us = esp_timer_get_time() - decode_start;
+	frame->duration_ms = duration_ms;
+	frame->decoded_us = decode_start;
+	frame->loop_end = play_ret == 0;
+	if (duration_ms <= 0) {
+		player->decode_finished = true;
+	}
+	if (player->cache_state == GUI_GIFPLAYER_CACHE_FILLING) {
+		gui_gifplayer_cache_frame_(player, duration_ms, &damage, play_ret);
+		// Last frame of loop, playback continues from cache
+		if (player->cache_state == GUI_GIFPLAYER_CACHE_FILLING && play_ret == 0) {
+			loop_cached = true;
+			player->decode_finished = true;
+		}
+	}
+
+	stats->decode_time_last_us = decode_time_us;
+	stats->decode_time_max_us = MAX(stats->decode_time_max_us, decode_time_us);
+	// Exponential moving average
+	stats->decode_time_avg_us = stats->frames_decoded ?
+		(stats->decode_time_avg_us * 7 + decode_time_us) / 8 : decode_time_us;
+	stats->frames_decoded++;
+	ESP_LOGD(TAG, "Decoded frame in %u us", decode_time_us);
+
+	// Queue while holding lock, loading a new animation must not see frames of the old one later on
+	xQueueSend(player->ready_frames, &frame_idx, 0);
+	if (player->underrun && player->request_render_cb) {
+		player->request_render_cb();
+	}
+	if (loop_cached) {
+		// Set only after last frame has been queued, display switches to cache once queue runs dry
+		player->cache_state = GUI_GIFPLAYER_CACHE_COMPLETE;
+		ESP_LOGI(TAG, "Cached %u frames (%u bytes)", player->cache_num_frames,
+			 (unsigned int)(player->cache_num_frames * gui_gifplayer_frame_size(player)));
+	}
+	xSemaphoreGive(player->decode_lock);
+	return true;
+}
+
+static void gui_gifplayer_decode_task(void *arg) {
+	gui_gifplayer_t *player = arg;
+
+	while (1) {
+		uint8_t frame_idx;
+
+		// Wait for display to release a frame buffer
+		xQueueReceive(player->free_frames, &frame_idx, portMAX_DELAY);
+		while (!gui_gifplayer_decode_frame(player, frame_idx)) {
+			// Wait for next animation to be loaded
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+	}
+}
+
+gui_element_t *gui_gifplayer_init(gui_gifplayer_t *player, uint8_t *render_fb, uint8_t *frame_fbs, uint8_t *transition_fbs,
+				  size_t frame_size) {
 	player->render_fb = render_fb;
 	player->animation_loaded = false;
+	player->is_oan = false;
 	player->next_frame_deadline_us = 0;
 	player->frame_played_cb = NULL;
+	player->request_render_cb = NULL;
+	player->current_frame = -1;
+	player->underrun = false;
+	player->decode_finished = false;
+	player->full_damage_pending = true;
+	player->pending_damage.size.x = 0;
+	player->pending_damage.size.y = 0;
+	memset(&player->stats, 0, sizeof(player->stats));
+	player->cache_budget = 0;
+	player->cache_state = GUI_GIFPLAYER_CACHE_DISABLED;
+	player->cache_frames = NULL;
+	player->cache_num_frames = 0;
+	player->cache_frames_size = 0;
+	player->cache_next_frame = 0;
+	player->frame_count_hint = 0;
+	player->timeline_started = false;
+	player->animation_nominal_us = 0;
+	player->animation_frames = 0;
+	player->animation_frames_shown = 0;
+	player->transition = GUI_GIFPLAYER_TRANSITION_NONE;
+	player->transition_steps = 0;
+	player->transition_from_fb = transition_fbs;
+	player->transition_fb = transition_fbs ? &transition_fbs[frame_size] : NULL;
+	player->transition_active = false;
+	player->transition_composed = false;
+
+	player->decode_lock = xSemaphoreCreateMutexStatic(&player->decode_lock_buffer);
+	player->free_frames = xQueueCreateStatic(GUI_GIFPLAYER_NUM_FRAMES, sizeof(uint8_t), player->free_frames_storage, &player->free_frames_buffer);
+	player->ready_frames = xQueueCreateStatic(GUI_GIFPLAYER_NUM_FRAMES, sizeof(uint8_t), player->ready_frames_storage, &player->ready_frames_buffer);
+	for (uint8_t i = 0; i < GUI_GIFPLAYER_NUM_FRAMES; i++) {
+		player->frames[i].pixels = &frame_fbs[i * frame_size];
+		xQueueSend(player->free_frames, &i, 0);
+	}
+
+	ESP_ERROR_CHECK(xTaskCreatePinnedToCore(gui_gifplayer_decode_task, "gif_decode", GIF_DECODE_TASK_STACK_DEPTH, player,
+						GIF_DECODE_TASK_PRIORITY, &player->decode_task, GIF_DECODE_TASK_CORE) != pdPASS);
 	return gui_element_init(&player->element, &gui_gifplayer_ops);
 }
 
-static inline void gui_gifplayer_draw_pixel(GIFDRAW *draw, unsigned char palette_idx, int x, int y) {
-	gui_gifplayer_t *player = draw->pUser;
-	gui_element_t *element = &player->element;
-	uint8_t *palette = draw->pPalette24 + 3 * palette_idx;
-	unsigned int r, g, b;
+void gui_gifplayer_get_stats(gui_gifplayer_t *player, gui_gifplayer_stats_t *stats) {
+	*stats = player->stats;
+	stats->queue_depth = uxQueueMessagesWaiting(player->ready_frames);
+	stats->cache_state = player->cache_state;
+	stats->cache_frames = player->cache_num_frames;
+	stats->cache_size = player->cache_num_frames * gui_gifplayer_frame_size(player);
+	stats->fps_nominal = 0;
+	stats->fps_achieved = 0;
+	if (player->timeline_started) {
+		int64_t elapsed_us = esp_timer_get_time() - player->animation_start_us;
+
+		if (player->animation_nominal_us > 0) {
+			stats->fps_nominal = player->animation_frames * 1000000.f / player->animation_nominal_us;
+		}
+		if (elapsed_us > 0) {
+			stats->fps_achieved = player->animation_frames_shown * 1000000.f / elapsed_us;
+		}
+	}
+}
 
-	r = palette[0];
-	g = palette[1];
-	b = palette[2];
-	player->render_fb[y * element->area.size.x + x] = (r + g + b) / 3;
+void gui_gifplayer_set_cache_budget(gui_gifplayer_t *player, size_t budget) {
+	player->cache_budget = budget;
 }
 
-static void gui_gifplayer_draw_frame(GIFDRAW *draw) {
-	gui_gifplayer_t *player = draw->pUser;
-	gui_element_t *element = &player->element;
-	int y = draw->iY + draw->y;
+void gui_gifplayer_set_frame_count_hint(gui_gifplayer_t *player, unsigned int num_frames) {
+	player->frame_count_hint = num_frames;
+}
 
-	if (y < element->area.size.y) {
-		int x;
-		int draw_width = MIN(draw->iX + draw->iWidth, element->area.size.x);
+void gui_gifplayer_set_transition(gui_gifplayer_t *player, gui_gifplayer_transition_t transition, unsigned int num_steps) {
+	if (transition > GUI_GIFPLAYER_TRANSITION_SLIDE) {
+		ESP_LOGW(TAG, "Unknown transition %u, using hard cut", transition);
+		transition = GUI_GIFPLAYER_TRANSITION_NONE;
+	}
+	player->transition = transition;
+	player->transition_steps = num_steps;
+}
 
-		for (x = draw->iX; x < draw_width; x++) {
-			if (draw->pPixels[x - draw->iX] == draw->ucTransparent && draw->ucDisposalMethod == 2) {
-				gui_gifplayer_draw_pixel(draw, draw->ucBackground, x, y);
-			} else if (!draw->ucHasTransparency || draw->pPixels[x - draw->iX] != draw->ucTransparent) {
-				gui_gifplayer_draw_pixel(draw, draw->pPixels[x - draw->iX], x, y);
-			}
-		}
+const char *gui_gifplayer_cache_state_to_str(gui_gifplayer_cache_state_t state) {
+	switch (state) {
+	case GUI_GIFPLAYER_CACHE_DISABLED:
+		return "disabled";
+	case GUI_GIFPLAYER_CACHE_FILLING:
+		return "filling";
+	case GUI_GIFPLAYER_CACHE_COMPLETE:
+		return "complete";
 	}
+
+	return "unknown";
 }
 
-int gui_gifplayer_load_animation_from_file(gui_gifplayer_t *player, const char *path) {
+// Snapshot frame on display as starting point of transition to next animation
+static void gui_gifplayer_begin_transition_(gui_gifplayer_t *player) {
+	size_t frame_size = gui_gifplayer_frame_size(player);
+
+	if (!player->transition_from_fb || player->transition == GUI_GIFPLAYER_TRANSITION_NONE ||
+	    player->transition_steps < 2) {
+		player->transition_active = false;
+		return;
+	}
+
+	if (player->transition_active && player->transition_composed) {
+		// Changed again during transition, continue from what is on display
+		pixel_copy_bytes(player->transition_from_fb, player->transition_fb, frame_size);
+	} else if (player->current_frame >= 0) {
+		pixel_copy_bytes(player->transition_from_fb, player->frames[player->current_frame].pixels, frame_size);
+	} else if (!player->transition_active) {
+		// Nothing on display to transition from
+		return;
+	}
+
+	player->transition_active = true;
+	player->transition_composed = false;
+	// Opening and decoding the next animation overlaps with the first steps
+	player->transition_start_us = esp_timer_get_time();
+}
+
+// Stop decoding and drop decoded frames, returns with decode lock held
+static void gui_gifplayer_unload_animation(gui_gifplayer_t *player, bool keep_frame) {
+	uint8_t frame_idx;
+
+	xSemaphoreTake(player->decode_lock, portMAX_DELAY);
 	if (player->animation_loaded) {
-		GIF_close(&player->animation);
+		if (player->is_oan) {
+			oan_close(&player->oan);
+		} else {
+			GIF_close(&player->animation);
+		}
 		player->animation_loaded = false;
+		player->element.opaque = false;
+	}
+	player->decode_finished = false;
+	player->full_damage_pending = true;
+	gui_gifplayer_cache_free_(player);
+	player->cache_state = player->cache_budget >= gui_gifplayer_frame_size(player) * MAX(player->frame_count_hint, 1) ?
+		GUI_GIFPLAYER_CACHE_FILLING : GUI_GIFPLAYER_CACHE_DISABLED;
+
+	while (xQueueReceive(player->ready_frames, &frame_idx, 0)) {
+		xQueueSend(player->free_frames, &frame_idx, 0);
+		player->stats.frames_flushed++;
+	}
+	if (keep_frame) {
+		gui_gifplayer_begin_transition_(player);
+	} else {
+		player->transition_active = false;
+	}
+	// Frame on display is shown until first frame of next animation is ready, unless a snapshot has been taken
+	if ((!keep_frame || player->transition_active) && player->current_frame >= 0) {
+		frame_idx = player->current_frame;
+		xQueueSend(player->free_frames, &frame_idx, 0);
+		player->current_frame = -1;
+	}
+}
+
+static void gui_gifplayer_init_canvas_(gui_gifplayer_t *player) {
+	gui_element_t *element = &player->element;
+
+	gifdecode_canvas_init(&player->canvas, player->render_fb, GUI_FB_STRIDE(element->area.size.x),
+			      element->area.size.x, element->area.size.y);
+}
+
+static int gui_gifplayer_check_oan_size_(gui_gifplayer_t *player) {
+	// Native animations are rendered for the display, no scaling
+	if (player->oan.header.width != player->canvas.width ||
+	    player->oan.header.height != player->canvas.height) {
+		ESP_LOGE(TAG, "Animation size %ux%u does not match player size %ux%u",
+			 player->oan.header.width, player->oan.header.height,
+			 player->canvas.width, player->canvas.height);
+		oan_close(&player->oan);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int gui_gifplayer_open_oan_(gui_gifplayer_t *player, const char *path) {
+	int err = oan_open(&player->oan, path);
+
+	if (err) {
+		return err;
 	}
+	return gui_gifplayer_check_oan_size_(player);
+}
+
+static int gui_gifplayer_open_oan_memory_(gui_gifplayer_t *player, const uint8_t *data, size_t size) {
+	int err = oan_open_memory(&player->oan, data, size);
+
+	if (err) {
+		return err;
+	}
+	return gui_gifplayer_check_oan_size_(player);
+}
+
+static void gui_gifplayer_start_animation(gui_gifplayer_t *player) {
+	player->next_frame_deadline_us = 0;
+	player->timeline_started = false;
+	player->animation_nominal_us = 0;
+	player->animation_frames = 0;
+	player->animation_frames_shown = 0;
+	player->underrun = false;
+	// Frames cover the whole player
+	player->element.opaque = player->animation_loaded;
+	xSemaphoreGive(player->decode_lock);
+	xTaskNotifyGive(player->decode_task);
+
+	gui_element_invalidate(&player->element);
+	gui_element_check_render(&player->element);
+}
+
+void gui_gifplayer_close_animation(gui_gifplayer_t *player, bool keep_frame) {
+	gui_gifplayer_unload_animation(player, keep_frame);
+	gui_gifplayer_start_animation(player);
+}
+
+int gui_gifplayer_load_animation_from_file(gui_gifplayer_t *player, const char *path) {
+	gui_gifplayer_unload_animation(player, !!path);
 
 	if (path) {
-		GIF_begin(&player->animation, GIF_PALETTE_RGB888);
-		if (GIF_openFile(&player->animation, path, gui_gifplayer_draw_frame)) {
+		gui_gifplayer_init_canvas_(player);
+		player->is_oan = oan_probe(path);
+		if (player->is_oan) {
+			int err = gui_gifplayer_open_oan_(player, path);
+
+			if (err) {
+				xSemaphoreGive(player->decode_lock);
+				return err;
+			}
 			player->animation_loaded = true;
 		} else {
-			return player->animation.iError ? player->animation.iError : -1;
+			GIF_begin(&player->animation, GIF_PALETTE_RGB888);
+			if (GIF_openFile(&player->animation, path, gifdecode_draw_line)) {
+				player->animation_loaded = true;
+			} else {
+				xSemaphoreGive(player->decode_lock);
+				return player->animation.iError ? player->animation.iError : -1;
+			}
 		}
 	}
 
-	gui_element_invalidate(&player->element);
-	gui_element_check_render(&player->element);
-
+	gui_gifplayer_start_animation(player);
 	return 0;
 }
 
 int gui_gifplayer_load_animation_from_memory(gui_gifplayer_t *player, const uint8_t *start, const uint8_t *end) {
-	if (player->animation_loaded) {
-		GIF_close(&player->animation);
-		player->animation_loaded = false;
-	}
+	gui_gifplayer_unload_animation(player, !!start);
 
 	if (start) {
-		GIF_begin(&player->animation, GIF_PALETTE_RGB888);
-		if (GIF_openRAM(&player->animation, (void *)start /* const correctness is hard */, end - start, gui_gifplayer_draw_frame)) {
+		gui_gifplayer_init_canvas_(player);
+		player->is_oan = oan_probe_memory(start, end - start);
+		if (player->is_oan) {
+			int err = gui_gifplayer_open_oan_memory_(player, start, end - start);
+
+			if (err) {
+				xSemaphoreGive(player->decode_lock);
+				return err;
+			}
 			player->animation_loaded = true;
 		} else {
-			return player->animation.iError ? player->animation.iError : -1;
+			GIF_begin(&player->animation, GIF_PALETTE_RGB888);
+			if (GIF_openRAM(&player->animation, (void *)start /* const correctness is hard */, end - start, gifdecode_draw_line)) {
+				player->animation_loaded = true;
+			} else {
+				xSemaphoreGive(player->decode_lock);
+				return player->animation.iError ? player->animation.iError : -1;
+			}
 		}
 	}
 
-	gui_element_invalidate(&player->element);
-	gui_element_check_render(&player->element);
-
+	gui_gifplayer_start_animation(player);
 	return 0;
 }
@@ -4,14 +4,24 @@
 
 #include <esp_timer.h>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
 #include <gif.h>
 
+#include "gifdecode.h"
 #include "gui.h"
 #include "menu.h"
+#include "oan.h"
 
 #define GIFPLAYER_BASE		"/flash/animations"
 #define GIFPLAYER_BASE_DIR	GIFPLAYER_BASE"/"
 
+#define GIFPLAYER_WIDTH		256
+#define GIFPLAYER_HEIGHT	64
+
 #define GIFPLAYER_FOR_EACH_ANIMATION(cursor_) \
 	for (cursor_ = gifplayer_get_first_animation_name_(); \
 	     cursor_; \
@@ -34,6 +44,20 @@ int gifplayer_run(menu_cb_f exit_cb, void *cb_ctx, void *priv);
 /* Use only with player lock acquired */
 int gifplayer_set_animation_(const char *path);
 int gifplayer_update_available_animations_(void);
+// Adds animation file that has been created in the animation directory
+int gifplayer_add_available_animation_(const char *name);
+// Play animation from RAM without a file. On success the player takes ownership of data, which
+// must be allocated with heap_caps_malloc(). It is freed once another animation is set. Returns
+// -EBUSY without touching playback while the previous preview is held
+int gifplayer_set_preview_(uint8_t *data, size_t size);
+bool gifplayer_is_preview_playing_(void);
+// Preview is being stored, it can not be replaced until released
+bool gifplayer_is_preview_held_(void);
+// Returns data of preview on display or NULL, stays valid until released even if playback switches away
+const uint8_t *gifplayer_get_preview_(size_t *size);
+void gifplayer_release_preview_(void);
+// Move new_path over animation file at path, playback of it continues from the new file
+int gifplayer_replace_animation_(const char *path, const char *new_path);
 
 /* Use method and result only with player lock acquired */
 const char *gifplayer_get_path_of_playing_animation_(void);
@@ -42,16 +66,152 @@ const char *gifplayer_get_first_animation_name_(void);
 const char *gifplayer_get_last_animation_name_(void);
 const char *gifplayer_get_next_animation_name_(const char *cursor);
 
+// Number of decoded frames, one is on display while the others are queued
+#define GUI_GIFPLAYER_NUM_FRAMES	3
+
+typedef enum gui_gifplayer_cache_state {
+	// Animation does not fit into cache budget
+	GUI_GIFPLAYER_CACHE_DISABLED,
+	// Frames are being cached while first loop is decoded
+	GUI_GIFPLAYER_CACHE_FILLING,
+	// Whole loop is cached, playback does not decode anymore
+	GUI_GIFPLAYER_CACHE_COMPLETE,
+} gui_gifplayer_cache_state_t;
+
+typedef enum gui_gifplayer_transition {
+	// Hard cut
+	GUI_GIFPLAYER_TRANSITION_NONE,
+	// Outgoing frame fades into incoming animation
+	GUI_GIFPLAYER_TRANSITION_CROSSFADE,
+	// Incoming animation is revealed from left to right
+	GUI_GIFPLAYER_TRANSITION_WIPE,
+	// Incoming animation pushes outgoing frame out at the top
+	GUI_GIFPLAYER_TRANSITION_SLIDE,
+} gui_gifplayer_transition_t;
+
+typedef struct gui_gifplayer_stats {
+	unsigned int frames_decoded;
+	unsigned int frames_shown;
+	// Decoded frames discarded on animation change
+	unsigned int frames_flushed;
+	// Frame was due but had not been decoded yet
+	unsigned int underruns;
+	unsigned int queue_depth;
+	unsigned int decode_time_last_us;
+	unsigned int decode_time_max_us;
+	unsigned int decode_time_avg_us;
+	unsigned int frames_from_cache;
+	gui_gifplayer_cache_state_t cache_state;
+	unsigned int cache_frames;
+	size_t cache_size;
+	// Frames decoded but not shown to catch up with the timeline
+	unsigned int frames_skipped;
+	// Frame rate of current animation, as specified by its frame durations and as shown
+	float fps_nominal;
+	float fps_achieved;
+} gui_gifplayer_stats_t;
+
+typedef struct gui_gifplayer_frame {
+	// Display format, two 4 bit pixels per byte
+	uint8_t *pixels;
+	int duration_ms;
+	int64_t decoded_us;
+	// Last frame of loop
+	bool loop_end;
+	// Area changed compared to previously decoded frame
+	gui_area_t damage;
+} gui_gifplayer_frame_t;
+
+typedef struct gui_gifplayer_cache_frame {
+	uint8_t *pixels;
+	int duration_ms;
+	// Area changed compared to previous frame in cache
+	gui_area_t damage;
+} gui_gifplayer_cache_frame_t;
+
 typedef struct gui_gifplayer {
 	gui_element_t element;
 
 	int64_t next_frame_deadline_us;
 	bool animation_loaded;
+	// Animation is in native format, see oan.h
+	bool is_oan;
 	GIFIMAGE animation;
-	gui_pixel_t *render_fb;
+	oan_t oan;
+	// Decoder canvas, display format, two 4 bit pixels per byte
+	uint8_t *render_fb;
+	gifdecode_canvas_t canvas;
 	void (*frame_played_cb)(void);
+	// Threadsafe, called by decode task once an overdue frame is ready
+	void (*request_render_cb)(void);
+
+	// Managed properties
+	gui_gifplayer_frame_t frames[GUI_GIFPLAYER_NUM_FRAMES];
+	// Index of frame on display, -1 if none
+	int current_frame;
+	bool underrun;
+	// Animation consists of a single frame that has been decoded already
+	bool decode_finished;
+	// Next decoded frame replaces frame of different animation, damages whole player
+	bool full_damage_pending;
+	// Area changed by frames taken from queue or cache, not rendered yet
+	gui_area_t pending_damage;
+	TaskHandle_t decode_task;
+	// Held while decoding, protects animation and decoder canvas
+	SemaphoreHandle_t decode_lock;
+	StaticSemaphore_t decode_lock_buffer;
+	QueueHandle_t free_frames;
+	StaticQueue_t free_frames_buffer;
+	uint8_t free_frames_storage[GUI_GIFPLAYER_NUM_FRAMES];
+	QueueHandle_t ready_frames;
+	StaticQueue_t ready_frames_buffer;
+	uint8_t ready_frames_storage[GUI_GIFPLAYER_NUM_FRAMES];
+	gui_gifplayer_stats_t stats;
+	// Decoded frames of whole loop, filled by decode task while in filling state
+	size_t cache_budget;
+	gui_gifplayer_cache_state_t cache_state;
+	gui_gifplayer_cache_frame_t *cache_frames;
+	unsigned int cache_num_frames;
+	unsigned int cache_frames_size;
+	unsigned int cache_next_frame;
+	// Number of frames of next animation if known in advance, 0 otherwise
+	unsigned int frame_count_hint;
+	// Frames are due at fixed offsets from start of loop, independent of render latency
+	bool timeline_started;
+	int64_t loop_start_us;
+	int64_t loop_offset_us;
+	// Current animation, for frame rate statistics
+	int64_t animation_start_us;
+	int64_t animation_nominal_us;
+	unsigned int animation_frames;
+	unsigned int animation_frames_shown;
+	// Transition between animations, runs on its own clock from the moment the animation is changed
+	gui_gifplayer_transition_t transition;
+	unsigned int transition_steps;
+	// Last frame of outgoing animation and composed output, NULL if transitions are not supported
+	uint8_t *transition_from_fb;
+	uint8_t *transition_fb;
+	bool transition_active;
+	// Composed output is on display
+	bool transition_composed;
+	int64_t transition_start_us;
 } gui_gifplayer_t;
 
-gui_element_t *gui_gifplayer_init(gui_gifplayer_t *player, gui_pixel_t *render_fb);
+// frame_fbs holds GUI_GIFPLAYER_NUM_FRAMES buffers of frame_size bytes each, transition_fbs holds two or is NULL
+gui_element_t *gui_gifplayer_init(gui_gifplayer_t *player, uint8_t *render_fb, uint8_t *frame_fbs, uint8_t *transition_fbs,
+				  size_t frame_size);
+void gui_gifplayer_get_stats(gui_gifplayer_t *player, gui_gifplayer_stats_t *stats);
+// Takes effect on next animation load
+void gui_gifplayer_set_cache_budget(gui_gifplayer_t *player, size_t budget);
+// Takes effect on next animation load
+void gui_gifplayer_set_frame_count_hint(gui_gifplayer_t *player, unsigned int num_frames);
+const char *gui_gifplayer_cache_state_to_str(gui_gifplayer_cache_state_t state);
+// Takes effect on next animation change
+void gui_gifplayer_set_transition(gui_gifplayer_t *player, gui_gifplayer_transition_t transition, unsigned int num_steps);
+
+/* Threadsafe */
+void gifplayer_get_stats(gui_gifplayer_stats_t *stats);
+// Stop playback, with keep_frame set the frame on display is kept for the next animation to start from
+void gui_gifplayer_close_animation(gui_gifplayer_t *player, bool keep_frame);
 int gui_gifplayer_load_animation_from_file(gui_gifplayer_t *player, const char *path);
 int gui_gifplayer_load_animation_from_memory(gui_gifplayer_t *player, const uint8_t *start, const uint8_t *end);
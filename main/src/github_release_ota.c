@@ -35,6 +35,7 @@ static void remove_ota_labels(void) {
 
 		gui_element_remove_child(&app_container.element,
 					 &label->element);
+		gui_label_set_cache_surface(label, false);
 		i++;
 	}
 
@@ -134,6 +135,7 @@ void ota_cb(github_release_ctx_t *releases, int err, void *ctx) {
 
 			gui_label_init(label, update->name);
 			gui_label_set_font_size(label, 9);
+			gui_label_set_cache_surface(label, true);
 			gui_element_set_position(&label->element, 10, 10 + 10 * i);
 			gui_element_set_size(&label->element, 256, 10);
 			gui_element_add_child(&app_container.element,
@@ -1,11 +1,16 @@
 #include "gui.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <esp_log.h>
 
 #include "fonts.h"
 #include "gui_priv.h"
+#include "pixel_ops.h"
 #include "util.h"
 
 static const char *TAG = "gui";
@@ -14,10 +19,54 @@ gui_element_t *gui_element_init(gui_element_t *elem, const gui_element_ops_t *op
 	INIT_LIST_HEAD(elem->list);
 	elem->parent = NULL;
 	elem->inverted = false;
+	elem->opaque = false;
+	elem->dirty_area.size.x = 0;
+	elem->dirty_area.size.y = 0;
 	elem->ops = ops;
 	return elem;
 }
 
+bool gui_area_is_empty(const gui_area_t *area) {
+	return area->size.x <= 0 || area->size.y <= 0;
+}
+
+void gui_area_union(gui_area_t *area, const gui_area_t *other) {
+	int end_x, end_y;
+
+	if (gui_area_is_empty(other)) {
+		return;
+	}
+
+	if (gui_area_is_empty(area)) {
+		*area = *other;
+		return;
+	}
+
+	end_x = MAX(area->position.x + area->size.x, other->position.x + other->size.x);
+	end_y = MAX(area->position.y + area->size.y, other->position.y + other->size.y);
+	area->position.x = MIN(area->position.x, other->position.x);
+	area->position.y = MIN(area->position.y, other->position.y);
+	area->size.x = end_x - area->position.x;
+	area->size.y = end_y - area->position.y;
+}
+
+void gui_area_intersect(gui_area_t *area, const gui_area_t *other) {
+	int end_x = MIN(area->position.x + area->size.x, other->position.x + other->size.x);
+	int end_y = MIN(area->position.y + area->size.y, other->position.y + other->size.y);
+
+	area->position.x = MAX(area->position.x, other->position.x);
+	area->position.y = MAX(area->position.y, other->position.y);
+	area->size.x = MAX(end_x - area->position.x, 0);
+	area->size.y = MAX(end_y - area->position.y, 0);
+}
+
+bool gui_area_contains(const gui_area_t *area, const gui_area_t *other) {
+	return other->position.x >= area->position.x &&
+	       other->position.y >= area->position.y &&
+	       other->position.x + other->size.x <= area->position.x + area->size.x &&
+	       other->position.y + other->size.y <= area->position.y + area->size.y;
+}
+
 void gui_element_check_render(gui_element_t *elem) {
 	if (elem->dirty) {
 		if (elem->ops->check_render) {
@@ -28,13 +77,48 @@ void gui_element_check_render(gui_element_t *elem) {
 	}
 }
 
-static void gui_element_invalidate_ignore_hidden_shown(gui_element_t *elem) {
+static void gui_element_damage_ignore_hidden_shown(gui_element_t *elem, const gui_area_t *area) {
 	elem->dirty = true;
+	gui_area_union(&elem->dirty_area, area);
 	if (elem->parent) {
-		gui_element_invalidate(elem->parent);
+		gui_element_t *parent = elem->parent;
+		gui_area_t parent_area = *area;
+
+		if (parent->ops->children_scroll) {
+			// Can not tell where the child ends up, damage the whole parent
+			parent_area.position.x = 0;
+			parent_area.position.y = 0;
+			parent_area.size = parent->area.size;
+		} else {
+			// Translate damage into coordinate system of parent
+			parent_area.position.x += elem->area.position.x;
+			parent_area.position.y += elem->area.position.y;
+		}
+		gui_element_damage(parent, &parent_area);
+	}
+}
+
+static void gui_element_damage_ignore_hidden(gui_element_t *elem, const gui_area_t *area) {
+	if (elem->shown) {
+		gui_element_damage_ignore_hidden_shown(elem, area);
 	}
 }
 
+void gui_element_damage(gui_element_t *elem, const gui_area_t *area) {
+	if (!elem->hidden) {
+		gui_element_damage_ignore_hidden(elem, area);
+	}
+}
+
+static void gui_element_invalidate_ignore_hidden_shown(gui_element_t *elem) {
+	gui_area_t area = {
+		.position = { 0, 0 },
+		.size = elem->area.size
+	};
+
+	gui_element_damage_ignore_hidden_shown(elem, &area);
+}
+
 static void gui_element_invalidate_ignore_hidden(gui_element_t *elem) {
 	if (elem->shown) {
 		gui_element_invalidate_ignore_hidden_shown(elem);
@@ -47,20 +131,43 @@ void gui_element_invalidate(gui_element_t *elem) {
 	}
 }
 
-static void gui_fb_invert_area(const gui_fb_t *fb, const gui_area_t *area) {
-	unsigned int x, y;
+void gui_fb_offset(gui_fb_t *dst, const gui_fb_t *src, int x, int y) {
+	unsigned int pixel_x = src->x + x;
 
-	for (y = 0; y < area->size.y; y++) {
-		for (x = 0; x < area->size.x; x++) {
-			unsigned int index = y * fb->stride + x;
+	dst->pixels = &src->pixels[y * src->stride + pixel_x / 2];
+	dst->stride = src->stride;
+	dst->x = pixel_x % 2;
+}
 
-			fb->pixels[index] = GUI_INVERT_PIXEL(fb->pixels[index]);
-		}
-	}
+void gui_fb_set_pixel(const gui_fb_t *fb, int x, int y, gui_pixel_t color) {
+	pixel_set_4bpp(&fb->pixels[y * fb->stride], fb->x + x, PIXEL_TO_4BPP(color));
+}
+
+void gui_fb_memset(const gui_fb_t *fb, gui_pixel_t color, const gui_point_t *size) {
+	pixel_fill_4bpp_2d(fb->pixels, fb->stride, fb->x, size->x, size->y, PIXEL_TO_4BPP(color));
+}
+
+void gui_fb_invert_area(const gui_fb_t *fb, const gui_area_t *area) {
+	pixel_invert_4bpp_2d(&fb->pixels[area->position.y * fb->stride], fb->stride,
+			     fb->x + area->position.x, area->size.x, area->size.y);
+}
+
+void gui_fb_blit_8bpp(const gui_fb_t *fb, const uint8_t *src, unsigned int src_stride, const gui_point_t *size) {
+	pixel_pack_8bpp_2d(fb->pixels, fb->stride, fb->x, src, src_stride, size->x, size->y);
+}
+
+void gui_fb_blit(const gui_fb_t *fb, const gui_fb_t *src, const gui_point_t *size) {
+	pixel_copy_4bpp_2d(fb->pixels, fb->stride, fb->x, src->pixels, src->stride, src->x, size->x, size->y);
 }
 
 static int gui_element_render(gui_element_t *elem, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size) {
 	int ret = -1;
+
+	// Clear damage before rendering, elements may damage themselves while rendering
+	elem->dirty = false;
+	elem->dirty_area.size.x = 0;
+	elem->dirty_area.size.y = 0;
+
 	if (elem->shown && !elem->hidden && elem->ops->render) {
 		ret = elem->ops->render(elem, source_offset, fb, destination_size);
 	}
@@ -77,7 +184,6 @@ static int gui_element_render(gui_element_t *elem, const gui_point_t *source_off
 		gui_fb_invert_area(fb, &invert_area);
 	}
 
-	elem->dirty = false;
 	return ret;
 }
 
@@ -89,9 +195,74 @@ static void gui_element_set_shown(gui_element_t *element, bool shown) {
 	gui_element_invalidate_ignore_hidden_shown(element);
 }
 
+static bool gui_element_is_visible(const gui_element_t *elem) {
+	return elem->shown && !elem->hidden;
+}
+
+// Check if visible part of child is covered by opaque siblings rendered after it
+static bool gui_container_child_occluded(gui_container_t *container, gui_element_t *child, const gui_area_t *visible_area) {
+	gui_area_t child_area = child->area;
+	list_head_t *cursor;
+
+	gui_area_intersect(&child_area, visible_area);
+	for (cursor = child->list.next; cursor != &container->children; cursor = cursor->next) {
+		gui_element_t *sibling = LIST_GET_ENTRY(cursor, gui_element_t, list);
+
+		if (sibling->opaque && gui_element_is_visible(sibling) &&
+		    gui_area_contains(&sibling->area, &child_area)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static const gui_element_ops_t gui_container_ops;
+
+// Find largest area within area (relative to container) covered by a single opaque element
+static void gui_container_find_opaque_area(gui_container_t *container, const gui_area_t *area, gui_area_t *opaque_area) {
+	gui_element_t *cursor;
+
+	LIST_FOR_EACH_ENTRY(cursor, &container->children, list) {
+		gui_area_t candidate = cursor->area;
+
+		if (!gui_element_is_visible(cursor)) {
+			continue;
+		}
+
+		if (cursor->opaque) {
+			gui_area_intersect(&candidate, area);
+		} else if (cursor->ops == &gui_container_ops) {
+			gui_area_t child_area = *area;
+
+			// Look into plain containers, children are not scrolled
+			child_area.position.x -= cursor->area.position.x;
+			child_area.position.y -= cursor->area.position.y;
+			gui_area_intersect(&child_area, &(gui_area_t){ .position = { 0, 0 }, .size = cursor->area.size });
+			candidate.size.x = 0;
+			candidate.size.y = 0;
+			gui_container_find_opaque_area(container_of(cursor, gui_container_t, element), &child_area, &candidate);
+			candidate.position.x += cursor->area.position.x;
+			candidate.position.y += cursor->area.position.y;
+		} else {
+			continue;
+		}
+
+		if (!gui_area_is_empty(&candidate) &&
+		    (gui_area_is_empty(opaque_area) ||
+		     candidate.size.x * candidate.size.y > opaque_area->size.x * opaque_area->size.y)) {
+			*opaque_area = candidate;
+		}
+	}
+}
+
 static int gui_container_render(gui_element_t *element, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size) {
 	int ret = -1;
 	gui_container_t *container = container_of(element, gui_container_t, element);
+	const gui_area_t visible_area = {
+		.position = *source_offset,
+		.size = *destination_size
+	};
 
 	ESP_LOGD(TAG, "Rendering container from [%d, %d] to [%d, %d]...", source_offset->x, source_offset->y, destination_size->x, destination_size->y);
 
@@ -100,9 +271,7 @@ static int gui_container_render(gui_element_t *element, const gui_point_t *sourc
 		// Render area realtive to container
 		gui_area_t render_area = cursor->area;
 		gui_point_t local_source_offset = *source_offset;
-		gui_fb_t local_fb = {
-			.stride = fb->stride
-		};
+		gui_fb_t local_fb;
 		int retval;
 
 		// Check if there is anything to render
@@ -120,6 +289,11 @@ static int gui_container_render(gui_element_t *element, const gui_point_t *sourc
 			continue;
 		}
 
+		if (gui_container_child_occluded(container, cursor, &visible_area)) {
+			ESP_LOGD(TAG, "Render area covered by opaque element, nothing to do");
+			continue;
+		}
+
 		// Clip render area by destination area
 		if (render_area.position.x + render_area.size.x - local_source_offset.x > destination_size->x) {
 			render_area.size.x = destination_size->x - render_area.position.x + local_source_offset.x;
@@ -149,7 +323,7 @@ static int gui_container_render(gui_element_t *element, const gui_point_t *sourc
 			local_source_offset.y = 0;
 		}
 
-		local_fb.pixels = &fb->pixels[render_area.position.y * fb->stride + render_area.position.x];
+		gui_fb_offset(&local_fb, fb, render_area.position.x, render_area.position.y);
 
 		retval = gui_element_render(cursor, &local_source_offset, &local_fb, &render_area.size);
 		if (ret == -1) {
@@ -187,6 +361,8 @@ gui_element_t *gui_container_init(gui_container_t *container) {
 }
 
 static void gui_element_set_size_(gui_element_t *elem, unsigned int width, unsigned int height) {
+	// Damage area covered before resize
+	gui_element_invalidate(elem);
 	elem->area.size.x = width;
 	elem->area.size.y = height;
 	gui_element_invalidate(elem);
@@ -205,9 +381,9 @@ static int gui_list_render(gui_element_t *element, const gui_point_t *source_off
 		if (list->last_y_scroll_pos > area->position.y) {
 			// Top of entry would be clipped, scroll to show it
 			list->last_y_scroll_pos = area->position.y - 1;
-		} else if (area->position.y + area->size.y - list->last_y_scroll_pos + 1 >= destination_size->y) {
+		} else if (area->position.y + area->size.y - list->last_y_scroll_pos + 1 >= element->area.size.y) {
 			// Bottom of entry would be clipped, scroll to show it
-			list->last_y_scroll_pos = area->position.y + area->size.y - destination_size->y + 1;
+			list->last_y_scroll_pos = area->position.y + area->size.y - element->area.size.y + 1;
 		}
 		ESP_LOGD(TAG, "Need to scroll by %d pixels to show selected entry", list->last_y_scroll_pos);
 	}
@@ -217,9 +393,7 @@ static int gui_list_render(gui_element_t *element, const gui_point_t *source_off
 		// Render area relative to list
 		gui_point_t scrolled_source_offset = *source_offset;
 		gui_area_t render_area = cursor->area;
-		gui_fb_t local_fb = {
-			.stride = fb->stride
-		};
+		gui_fb_t local_fb;
 		int retval;
 
 		ESP_LOGD(TAG, "Entry size: %dx%d", render_area.size.x, render_area.size.y);
@@ -260,7 +434,7 @@ static int gui_list_render(gui_element_t *element, const gui_point_t *source_off
 			scrolled_source_offset.y = 0;
 		}
 
-		local_fb.pixels = &fb->pixels[render_area.position.y * fb->stride + render_area.position.x];
+		gui_fb_offset(&local_fb, fb, render_area.position.x, render_area.position.y);
 
 		// Clip rendering area size by destination area
 		if (render_area.position.x + render_area.size.x - scrolled_source_offset.x > destination_size->x) {
@@ -298,6 +472,7 @@ static int gui_list_render(gui_element_t *element, const gui_point_t *source_off
 static const gui_element_ops_t gui_list_ops = {
 	.render = gui_list_render,
 	.update_shown = gui_container_update_shown,
+	.children_scroll = true,
 };
 
 gui_element_t *gui_list_init(gui_list_t *list) {
@@ -309,18 +484,15 @@ gui_element_t *gui_list_init(gui_list_t *list) {
 
 static int gui_image_render(gui_element_t *element, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size) {
 	gui_image_t *image = container_of(element, gui_image_t, element);
-	int copy_width = MIN(element->area.size.x - source_offset->x, destination_size->x);
-	int copy_height = MIN(element->area.size.y - source_offset->y, destination_size->y);
-	unsigned int y;
+	gui_point_t copy_size = {
+		.x = MIN(element->area.size.x - source_offset->x, destination_size->x),
+		.y = MIN(element->area.size.y - source_offset->y, destination_size->y)
+	};
+	const uint8_t *src = &image->image_data_start[image->element.area.size.x * source_offset->y + source_offset->x];
 
 	ESP_LOGD(TAG, "Rendering image from [%d, %d] to [%d, %d]...", source_offset->x, source_offset->y, destination_size->x, destination_size->y);
 
-	for (y = 0; y < copy_height; y++) {
-		gui_pixel_t *dst = &fb->pixels[y * fb->stride];
-		const uint8_t *src = &image->image_data_start[image->element.area.size.x * (y + source_offset->y) + source_offset->x];
-
-		memcpy(dst, src, copy_width * sizeof(gui_pixel_t));
-	}
+	gui_fb_blit_8bpp(fb, src, image->element.area.size.x, &copy_size);
 
 	return -1;
 }
@@ -332,32 +504,75 @@ static const gui_element_ops_t gui_image_ops = {
 gui_element_t *gui_image_init(gui_image_t *image, unsigned int width, unsigned int height, const uint8_t *image_data_start) {
 	gui_element_init(&image->element, &gui_image_ops);
 	image->element.ops = &gui_image_ops;
+	image->element.opaque = true;
 	gui_element_set_size_(&image->element, width, height);
 	image->image_data_start = image_data_start;
 	return &image->element;
 }
 
-static void gui_fb_memset(const gui_fb_t *fb, gui_pixel_t color, const gui_point_t *size) {
-	unsigned int x, y;
+static void gui_fb_clear_area(const gui_fb_t *fb, int x, int y, int width, int height) {
+	gui_point_t size = { width, height };
+	gui_fb_t area_fb;
 
-	for (y = 0; y < size->y; y++) {
-		for (x = 0; x < size->x; x++) {
-			fb->pixels[y * fb->stride + x] = color;
-		}
+	if (width <= 0 || height <= 0) {
+		return;
 	}
+	gui_fb_offset(&area_fb, fb, x, y);
+	gui_fb_memset(&area_fb, GUI_COLOR_BLACK, &size);
+}
+
+// Clear render area except for the part covered by an opaque element anyway
+static void gui_render_clear(const gui_fb_t *fb, gui_container_t *root, const gui_area_t *area) {
+	gui_area_t opaque = { 0 };
+	int end_x = area->position.x + area->size.x;
+	int end_y = area->position.y + area->size.y;
+	int opaque_end_x, opaque_end_y;
+
+	gui_container_find_opaque_area(root, area, &opaque);
+	if (gui_area_is_empty(&opaque)) {
+		gui_fb_clear_area(fb, area->position.x, area->position.y, area->size.x, area->size.y);
+		return;
+	}
+
+	opaque_end_x = opaque.position.x + opaque.size.x;
+	opaque_end_y = opaque.position.y + opaque.size.y;
+	// Above, below, left and right of opaque area
+	gui_fb_clear_area(fb, area->position.x, area->position.y, area->size.x, opaque.position.y - area->position.y);
+	gui_fb_clear_area(fb, area->position.x, opaque_end_y, area->size.x, end_y - opaque_end_y);
+	gui_fb_clear_area(fb, area->position.x, opaque.position.y, opaque.position.x - area->position.x, opaque.size.y);
+	gui_fb_clear_area(fb, opaque_end_x, opaque.position.y, end_x - opaque_end_x, opaque.size.y);
 }
 
-int gui_render(gui_t *gui, gui_pixel_t *fb, unsigned int stride, const gui_point_t *size) {
+int gui_render(gui_t *gui, uint8_t *fb, unsigned int stride, const gui_point_t *size, gui_area_t *damaged_area) {
 	int ret;
-	const gui_point_t offset = { 0, 0 };
-	gui_fb_t gui_fb = {
+	gui_element_t *root = &gui->container.element;
+	gui_area_t render_area = {
+		.position = { 0, 0 },
+		.size = *size
+	};
+	const gui_fb_t root_fb = {
 		.pixels = fb,
-		.stride = stride
+		.stride = stride,
+		.x = 0
 	};
+	gui_fb_t gui_fb;
+
+	// Only rerender the union of all damaged areas
+	gui_area_intersect(&render_area, &root->dirty_area);
+	root->dirty = false;
+	root->dirty_area.size.x = 0;
+	root->dirty_area.size.y = 0;
+	*damaged_area = render_area;
+	if (gui_area_is_empty(&render_area)) {
+		ESP_LOGD(TAG, "Nothing damaged, skipping render");
+		return -1;
+	}
+
+	ESP_LOGD(TAG, "Rendering damaged area [%d, %d] (%dx%d)", render_area.position.x, render_area.position.y, render_area.size.x, render_area.size.y);
 
-	gui_fb_memset(&gui_fb, GUI_COLOR_BLACK, size);
-	ret = gui_container_render(&gui->container.element, &offset, &gui_fb, size);
-	gui->container.element.dirty = false;
+	gui_render_clear(&root_fb, &gui->container, &render_area);
+	gui_fb_offset(&gui_fb, &root_fb, render_area.position.x, render_area.position.y);
+	ret = gui_container_render(root, &render_area.position, &gui_fb, &render_area.size);
 	return ret;
 }
 
@@ -378,6 +593,9 @@ gui_element_t *gui_init(gui_t *gui, void *priv, const gui_ops_t *ops) {
 	gui->container.element.ops = &gui_ops;
 	gui->container.element.hidden = false;
 	gui->container.element.shown = true;
+	// Nothing has been rendered yet, everything is damaged
+	gui->container.element.dirty_area.size.x = INT_MAX;
+	gui->container.element.dirty_area.size.y = INT_MAX;
 	gui->priv = priv;
 	gui->ops = ops;
 	gui->lock = xSemaphoreCreateMutexStatic(&gui->lock_buffer);
@@ -414,7 +632,7 @@ static int gui_rectangle_render(gui_element_t *element, const gui_point_t *sourc
 			unsigned int x;
 
 			for (x = 0; x < width; x++) {
-				fb->pixels[x] = rect->color;
+				gui_fb_set_pixel(fb, x, 0, rect->color);
 			}
 		}
 
@@ -422,7 +640,7 @@ static int gui_rectangle_render(gui_element_t *element, const gui_point_t *sourc
 			unsigned int x;
 
 			for (x = 0; x < width; x++) {
-				fb->pixels[(max_y - 1) * fb->stride + x] = rect->color;
+				gui_fb_set_pixel(fb, x, max_y - 1, rect->color);
 			}
 		}
 
@@ -430,7 +648,7 @@ static int gui_rectangle_render(gui_element_t *element, const gui_point_t *sourc
 			unsigned int y;
 
 			for (y = 0; y < height; y++) {
-				fb->pixels[y * fb->stride] = rect->color;
+				gui_fb_set_pixel(fb, 0, y, rect->color);
 			}
 		}
 
@@ -438,7 +656,7 @@ static int gui_rectangle_render(gui_element_t *element, const gui_point_t *sourc
 			unsigned int y;
 
 			for (y = 0; y < height; y++) {
-				fb->pixels[y * fb->stride + max_x - 1] = rect->color;
+				gui_fb_set_pixel(fb, max_x - 1, y, rect->color);
 			}
 		}
 	}
@@ -455,6 +673,99 @@ gui_element_t *gui_rectangle_init(gui_rectangle_t *rectangle) {
 	return &rectangle->element;
 }
 
+// Offset of text relative to label, depending on alignment
+static void gui_label_get_text_offset(const gui_label_t *label, const font_vec_t *text_size, gui_point_t *offset) {
+	const gui_element_t *element = &label->element;
+
+	*offset = label->text_offset;
+	// Align relative to whole label, not just the part being rendered
+	if (label->align == GUI_TEXT_ALIGN_END) {
+		if (element->area.size.x > text_size->x) {
+			offset->x += element->area.size.x - text_size->x;
+		}
+	} else if (label->align == GUI_TEXT_ALIGN_CENTER) {
+		if (element->area.size.x > text_size->x) {
+			offset->x += (element->area.size.x - text_size->x) / 2;
+		}
+	}
+}
+
+static int gui_label_update_surface(gui_label_t *label) {
+	font_text_params_t text_params;
+	font_vec_t source_offset = { 0, 0 };
+	font_fb_t font_fb;
+	size_t buffer_size;
+	int err;
+
+	err = fonts_calculate_text_params(fonts_get_default_font(), label->font_size, label->text, &text_params);
+	if (err) {
+		ESP_LOGW(TAG, "Failed to get text params for string \'%s\': %d", label->text, err);
+		return err;
+	}
+
+	buffer_size = GUI_FB_STRIDE(text_params.effective_size.x) * text_params.effective_size.y;
+	if (buffer_size > label->surface.buffer_size) {
+		uint8_t *pixels = realloc(label->surface.pixels, buffer_size);
+
+		if (!pixels) {
+			ESP_LOGW(TAG, "Failed to allocate %zu bytes for label surface", buffer_size);
+			return -ENOMEM;
+		}
+		label->surface.pixels = pixels;
+		label->surface.buffer_size = buffer_size;
+	}
+	memset(label->surface.pixels, 0, buffer_size);
+
+	font_fb.pixels = label->surface.pixels;
+	font_fb.stride = GUI_FB_STRIDE(text_params.effective_size.x);
+	font_fb.x = 0;
+	font_fb.size = text_params.effective_size;
+	err = fonts_render_string(fonts_get_default_font(), label->text, &text_params, &source_offset, &font_fb);
+	if (err) {
+		ESP_LOGW(TAG, "Failed to render string \'%s\': %d", label->text, err);
+		return err;
+	}
+
+	label->surface.size.x = text_params.effective_size.x;
+	label->surface.size.y = text_params.effective_size.y;
+	label->surface.valid = true;
+	return 0;
+}
+
+static void gui_label_render_surface(gui_label_t *label, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size) {
+	gui_element_t *element = &label->element;
+	int width = MIN(element->area.size.x - source_offset->x, destination_size->x);
+	int height = MIN(element->area.size.y - source_offset->y, destination_size->y);
+	font_vec_t text_size = { label->surface.size.x, label->surface.size.y };
+	gui_point_t surface_offset = *source_offset;
+	gui_point_t offset;
+	gui_point_t blit_size;
+	gui_fb_t surface_fb;
+	gui_fb_t dst_fb;
+
+	gui_label_get_text_offset(label, &text_size, &offset);
+	// Translate into surface and destination coordinates
+	surface_offset.x -= offset.x;
+	surface_offset.y -= offset.y;
+	offset.x = MAX(-surface_offset.x, 0);
+	offset.y = MAX(-surface_offset.y, 0);
+	surface_offset.x = MAX(surface_offset.x, 0);
+	surface_offset.y = MAX(surface_offset.y, 0);
+
+	blit_size.x = MIN(width - offset.x, label->surface.size.x - surface_offset.x);
+	blit_size.y = MIN(height - offset.y, label->surface.size.y - surface_offset.y);
+	if (blit_size.x <= 0 || blit_size.y <= 0) {
+		return;
+	}
+
+	surface_fb.pixels = label->surface.pixels;
+	surface_fb.stride = GUI_FB_STRIDE(label->surface.size.x);
+	surface_fb.x = 0;
+	gui_fb_offset(&surface_fb, &surface_fb, surface_offset.x, surface_offset.y);
+	gui_fb_offset(&dst_fb, fb, offset.x, offset.y);
+	gui_fb_blit(&dst_fb, &surface_fb, &blit_size);
+}
+
 static int gui_label_render(gui_element_t *element, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size) {
 	gui_label_t *label = container_of(element, gui_label_t, element);
 	int width = MIN(element->area.size.x - source_offset->x, destination_size->x);
@@ -465,14 +776,22 @@ static int gui_label_render(gui_element_t *element, const gui_point_t *source_of
 		.y = source_offset->y
 	};
 	int err;
-	int offset_x = label->text_offset.x;
-	int offset_y = label->text_offset.y;
+	int offset_x, offset_y;
+	gui_point_t text_offset;
 	font_text_params_t text_params;
 
 	if (!label->text) {
 		return -1;
 	}
 
+	if (label->cache_surface) {
+		if (label->surface.valid || !gui_label_update_surface(label)) {
+			gui_label_render_surface(label, source_offset, fb, destination_size);
+			return -1;
+		}
+		// Render directly if surface can not be used
+	}
+
 	err = fonts_calculate_text_params(fonts_get_default_font(), label->font_size, label->text, &text_params);
 	if (err) {
 		ESP_LOGW(TAG, "Failed to get text params for string \'%s\': %d", label->text, err);
@@ -480,15 +799,9 @@ static int gui_label_render(gui_element_t *element, const gui_point_t *source_of
 
 	ESP_LOGD(TAG, "Size required to render string: %dx%d px", text_params.effective_size.x, text_params.effective_size.y);
 
-	if (label->align == GUI_TEXT_ALIGN_END) {
-		if (width > text_params.effective_size.x) {
-			offset_x += width - text_params.effective_size.x;
-		}
-	} else if (label->align == GUI_TEXT_ALIGN_CENTER) {
-		if (width > text_params.effective_size.x) {
-			offset_x += (width - text_params.effective_size.x) / 2;
-		}
-	}
+	gui_label_get_text_offset(label, &text_params.effective_size, &text_offset);
+	offset_x = text_offset.x;
+	offset_y = text_offset.y;
 
 	if (source_offset->x > offset_x) {
 		font_source_offset.x -= offset_x;
@@ -505,8 +818,9 @@ static int gui_label_render(gui_element_t *element, const gui_point_t *source_of
 		font_source_offset.y = 0;
 	}
 
-	font_fb.pixels = &fb->pixels[offset_y * fb->stride + offset_x];
+	font_fb.pixels = &fb->pixels[offset_y * fb->stride];
 	font_fb.stride = fb->stride;
+	font_fb.x = fb->x + offset_x;
 	font_fb.size.x = width - offset_x;
 	font_fb.size.y = height - offset_y;
 
@@ -529,6 +843,10 @@ gui_element_t *gui_label_init(gui_label_t *label, const char *text) {
 	label->text_offset.x = 0;
 	label->text_offset.y = 0;
 	label->align = GUI_TEXT_ALIGN_START;
+	label->cache_surface = false;
+	label->surface.pixels = NULL;
+	label->surface.buffer_size = 0;
+	label->surface.valid = false;
 	return &label->element;
 }
 
@@ -553,13 +871,14 @@ static int gui_marquee_render(gui_element_t *element, const gui_point_t *source_
 		marquee->x_scroll_pos = 0;
 	}
 
+	// Scrolling on next render changes whole marquee
+	gui_element_invalidate(element);
+
 	LIST_FOR_EACH_ENTRY(cursor, &marquee->container.children, list) {
 		// Render area relative to marquee start
 		gui_point_t scrolled_source_offset = *source_offset;
 		gui_area_t render_area = cursor->area;
-		gui_fb_t local_fb = {
-			.stride = fb->stride
-		};
+		gui_fb_t local_fb;
 		int retval;
 
 		ESP_LOGD(TAG, "Entry size: %dx%d", render_area.size.x, render_area.size.y);
@@ -598,7 +917,7 @@ static int gui_marquee_render(gui_element_t *element, const gui_point_t *source_
 			scrolled_source_offset.y = 0;
 		}
 
-		local_fb.pixels = &fb->pixels[render_area.position.y * fb->stride + render_area.position.x];
+		gui_fb_offset(&local_fb, fb, render_area.position.x, render_area.position.y);
 
 		// Clip rendering area size by destination area
 		if (render_area.position.x + render_area.size.x - scrolled_source_offset.x > destination_size->x) {
@@ -625,6 +944,7 @@ static int gui_marquee_render(gui_element_t *element, const gui_point_t *source_
 static const gui_element_ops_t gui_marquee_ops = {
 	.render = gui_marquee_render,
 	.update_shown = gui_container_update_shown,
+	.children_scroll = true,
 };
 
 gui_element_t *gui_marquee_init(gui_marquee_t *marquee) {
@@ -635,6 +955,8 @@ gui_element_t *gui_marquee_init(gui_marquee_t *marquee) {
 
 // User API functions that might require rerendering
 void gui_element_set_position(gui_element_t *elem, unsigned int x, unsigned int y) {
+	// Damage area covered before move
+	gui_element_invalidate(elem);
 	elem->area.position.x = x;
 	elem->area.position.y = y;
 	gui_element_invalidate(elem);
@@ -658,6 +980,12 @@ void gui_element_set_inverted(gui_element_t *elem, bool inverted) {
 	gui_element_check_render(elem);
 }
 
+void gui_element_set_opaque(gui_element_t *elem, bool opaque) {
+	elem->opaque = opaque;
+	gui_element_invalidate(elem);
+	gui_element_check_render(elem);
+}
+
 void gui_element_show(gui_element_t *elem) {
 	gui_element_set_shown(elem, true);
 	gui_element_check_render(elem);
@@ -680,6 +1008,7 @@ void gui_element_remove_child(gui_element_t *parent, gui_element_t *child) {
 
 void gui_rectangle_set_filled(gui_rectangle_t *rectangle, bool filled) {
 	rectangle->filled = filled;
+	rectangle->element.opaque = filled;
 	gui_element_invalidate(&rectangle->element);
 	gui_element_check_render(&rectangle->element);
 }
@@ -704,12 +1033,14 @@ void gui_image_set_image(gui_image_t *image, unsigned int width, unsigned int he
 
 void gui_label_set_font_size(gui_label_t *label, unsigned int height) {
 	label->font_size = height;
+	label->surface.valid = false;
 	gui_element_invalidate(&label->element);
 	gui_element_check_render(&label->element);
 }
 
 void gui_label_set_text(gui_label_t *label, const char *text) {
 	label->text = text;
+	label->surface.valid = false;
 	gui_element_invalidate(&label->element);
 	gui_element_check_render(&label->element);
 }
@@ -726,3 +1057,15 @@ void gui_label_set_text_offset(gui_label_t *label, int offset_x, int offset_y) {
 	gui_element_invalidate(&label->element);
 	gui_element_check_render(&label->element);
 }
+
+void gui_label_set_cache_surface(gui_label_t *label, bool cache_surface) {
+	label->cache_surface = cache_surface;
+	if (!cache_surface) {
+		free(label->surface.pixels);
+		label->surface.pixels = NULL;
+		label->surface.buffer_size = 0;
+		label->surface.valid = false;
+	}
+	gui_element_invalidate(&label->element);
+	gui_element_check_render(&label->element);
+}
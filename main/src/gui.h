@@ -18,21 +18,29 @@ typedef struct gui_area {
 	gui_point_t size;
 } gui_area_t;
 
+// 8 bit grayscale color, stored with 4 bit precision in framebuffers
 typedef uint8_t gui_pixel_t;
-#define GUI_INVERT_PIXEL(px_) (((1U << (sizeof(gui_pixel_t) * 8)) - 1) - (px_))
 #define GUI_COLOR_BLACK	0
 
+// Framebuffers use the display format, two 4 bit pixels per byte
 typedef struct gui_fb {
-	gui_pixel_t *pixels;
+	uint8_t *pixels;
+	// Bytes per row
 	unsigned int stride;
+	// Pixel offset of first column relative to pixels
+	unsigned int x;
 } gui_fb_t;
 
+#define GUI_FB_STRIDE(width_) (((width_) + 1) / 2)
+
 typedef struct gui_element gui_element_t;
 
 typedef struct gui_element_ops {
 	int (*render)(gui_element_t *element, const gui_point_t *source_offset, const gui_fb_t *fb, const gui_point_t *destination_size);
 	void (*update_shown)(gui_element_t *element);
 	void (*check_render)(gui_element_t *element);
+	// Children are rendered at a (scroll) offset, damage to a child damages the whole element
+	bool children_scroll;
 } gui_element_ops_t;
 
 typedef struct gui_element {
@@ -41,10 +49,14 @@ typedef struct gui_element {
 	gui_element_t *parent;
 	bool shown;
 	bool dirty;
+	// Area in need of rerendering, relative to element position
+	gui_area_t dirty_area;
 
 	// User properties
 	bool hidden;
 	bool inverted;
+	// Element draws every pixel of its area, elements below it need not be rendered
+	bool opaque;
 	gui_area_t area;
 	const gui_element_ops_t *ops;
 } gui_element_t;
@@ -89,6 +101,16 @@ typedef struct gui_label {
 	unsigned int font_size;
 	gui_point_t text_offset;
 	gui_text_alignment_t align;
+	bool cache_surface;
+
+	// Managed properties
+	struct {
+		// Pre-rendered text in display format, valid while text and font size do not change
+		uint8_t *pixels;
+		size_t buffer_size;
+		gui_point_t size;
+		bool valid;
+	} surface;
 } gui_label_t;
 
 typedef struct gui_marquee {
@@ -115,10 +137,16 @@ struct gui {
 
 // Top level GUI API
 gui_element_t *gui_init(gui_t *gui, void *priv, const gui_ops_t *ops);
-int gui_render(gui_t *gui, gui_pixel_t *fb, unsigned int stride, const gui_point_t *size);
+int gui_render(gui_t *gui, uint8_t *fb, unsigned int stride, const gui_point_t *size, gui_area_t *damaged_area);
 void gui_lock(gui_t *gui);
 void gui_unlock(gui_t *gui);
 
+// Area helpers
+bool gui_area_is_empty(const gui_area_t *area);
+void gui_area_union(gui_area_t *area, const gui_area_t *other);
+void gui_area_intersect(gui_area_t *area, const gui_area_t *other);
+bool gui_area_contains(const gui_area_t *area, const gui_area_t *other);
+
 // Container level GUI API
 gui_element_t *gui_container_init(gui_container_t *container);
 
@@ -127,6 +155,7 @@ void gui_element_set_position(gui_element_t *elem, unsigned int x, unsigned int
 void gui_element_set_size(gui_element_t *elem, unsigned int width, unsigned int height);
 void gui_element_set_hidden(gui_element_t *elem, bool hidden);
 void gui_element_set_inverted(gui_element_t *elem, bool inverted);
+void gui_element_set_opaque(gui_element_t *elem, bool opaque);
 void gui_element_show(gui_element_t *elem);
 void gui_element_add_child(gui_element_t *parent, gui_element_t *child);
 void gui_element_remove_child(gui_element_t *parent, gui_element_t *child);
@@ -150,6 +179,8 @@ void gui_label_set_font_size(gui_label_t *label, unsigned int height);
 void gui_label_set_text(gui_label_t *label, const char *text);
 void gui_label_set_text_alignment(gui_label_t *label, gui_text_alignment_t align);
 void gui_label_set_text_offset(gui_label_t *label, int offset_x, int offset_y);
+// Keep rendered text in a surface, text must not be modified without calling gui_label_set_text
+void gui_label_set_cache_surface(gui_label_t *label, bool cache_surface);
 
 // GUI marquee widget API
 gui_element_t *gui_marquee_init(gui_marquee_t *marquee);
@@ -5,4 +5,14 @@
 gui_element_t *gui_element_init(gui_element_t *elem, const gui_element_ops_t *ops);
 
 void gui_element_invalidate(gui_element_t *elem);
+// Area relative to element position
+void gui_element_damage(gui_element_t *elem, const gui_area_t *area);
 void gui_element_check_render(gui_element_t *elem);
+
+// Framebuffer helpers for element implementations
+void gui_fb_offset(gui_fb_t *dst, const gui_fb_t *src, int x, int y);
+void gui_fb_set_pixel(const gui_fb_t *fb, int x, int y, gui_pixel_t color);
+void gui_fb_memset(const gui_fb_t *fb, gui_pixel_t color, const gui_point_t *size);
+void gui_fb_invert_area(const gui_fb_t *fb, const gui_area_t *area);
+void gui_fb_blit_8bpp(const gui_fb_t *fb, const uint8_t *src, unsigned int src_stride, const gui_point_t *size);
+void gui_fb_blit(const gui_fb_t *fb, const gui_fb_t *src, const gui_point_t *size);
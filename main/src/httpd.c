@@ -37,6 +37,61 @@ esp_err_t httpd_send_error(struct httpd_request_ctx* ctx, const char* status) {
   return httpd_send_error_msg(ctx, status, NULL);
 }
 
+// Weak comparison as required for If-None-Match
+static const char* httpd_etag_opaque(const char* etag) {
+  return strncmp(etag, "W/", 2) ? etag : etag + 2;
+}
+
+static bool httpd_etag_matches(httpd_req_t* req, const char* etag) {
+  size_t hdr_len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+  char* hdr, *token, *saveptr;
+  bool match = false;
+
+  if(!hdr_len) {
+    return false;
+  }
+
+  hdr = malloc(hdr_len + 1);
+  if(!hdr) {
+    return false;
+  }
+  if(httpd_req_get_hdr_value_str(req, "If-None-Match", hdr, hdr_len + 1)) {
+    free(hdr);
+    return false;
+  }
+
+  etag = httpd_etag_opaque(etag);
+  for(token = strtok_r(hdr, ", ", &saveptr); token && !match; token = strtok_r(NULL, ", ", &saveptr)) {
+    match = !strcmp(token, "*") || !strcmp(httpd_etag_opaque(token), etag);
+  }
+  free(hdr);
+  return match;
+}
+
+// Sets ETag header, if the client has a matching copy a 304 without body is sent
+static esp_err_t httpd_resp_check_etag(httpd_req_t* req, const char* etag, bool* not_modified) {
+  esp_err_t err;
+
+  *not_modified = false;
+  if(!etag) {
+    return ESP_OK;
+  }
+
+  if((err = httpd_resp_set_hdr(req, "ETag", etag))) {
+    return err;
+  }
+
+  if(httpd_etag_matches(req, etag)) {
+    *not_modified = true;
+    if((err = httpd_resp_set_status(req, HTTPD_304))) {
+      return err;
+    }
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  return ESP_OK;
+}
+
 static esp_err_t request_send_chunk(void* ctx, char* buff, size_t len) {
   struct httpd_request_ctx* req_ctx = ctx;
   return httpd_resp_send_chunk(req_ctx->req, buff, len);
@@ -112,8 +167,15 @@ static esp_err_t httpd_embedded_template_file_request_handler(struct httpd_handl
   httpd_req_t* req = slice_ctx->req_ctx->req;
   esp_err_t err;
 
+  bool not_modified;
+
   printf("httpd: Delivering templated embedded content for %s from @%p\n", req->uri, hndlr_file->start);
 
+  // Rendering is skipped entirely if the client has a current copy
+  if ((err = httpd_resp_check_etag(req, hndlr_file->etag, &not_modified)) || not_modified) {
+    return err;
+  }
+
   if ((err = httpd_resp_set_type(req, hndlr_file->mime_type))) {
     return err;
   }
@@ -132,7 +194,7 @@ const struct httpd_handler_ops httpd_embedded_template_file_handler_ops = {
   .invoke = httpd_embedded_template_file_request_handler,
 };
 
-static esp_err_t add_embedded_file_template(struct httpd_embedded_template_file_handler **ret, struct httpd* httpd, const char *path, const char *mime_type, const void *start, const void *end) {
+static esp_err_t add_embedded_file_template(struct httpd_embedded_template_file_handler **ret, struct httpd* httpd, const char *path, const char *mime_type, const void *start, const void *end, const char *etag) {
   esp_err_t err;
   char *uri;
   struct httpd_embedded_template_file_handler* hndlr;
@@ -145,6 +207,7 @@ static esp_err_t add_embedded_file_template(struct httpd_embedded_template_file_
   hndlr->mime_type = mime_type;
   hndlr->start = start;
   hndlr->end = end;
+  hndlr->etag = etag;
 
   if((err = template_alloc_instance_embedded(&hndlr->templ, &httpd->templates, start, end))) {
     printf("Failed to allocate embedded template instance: %d\n", err);
@@ -197,8 +260,8 @@ fail:
   return err;
 }
 
-esp_err_t httpd_add_embedded_template_file(struct httpd *httpd, const char *path, const char *mime_type, const void *ptr_start, const void *ptr_end) {
-  return add_embedded_file_template(NULL, httpd, path, mime_type, ptr_start, ptr_end);
+esp_err_t httpd_add_embedded_template_file(struct httpd *httpd, const char *path, const char *mime_type, const void *ptr_start, const void *ptr_end, const char *etag) {
+  return add_embedded_file_template(NULL, httpd, path, mime_type, ptr_start, ptr_end, etag);
 }
 
 static esp_err_t template_send(struct httpd_slice_ctx *ctx, struct httpd_static_template_file_handler* hndlr) {
@@ -638,6 +701,7 @@ static esp_err_t httpd_embedded_static_file_include_handler(struct httpd_handler
 
 static esp_err_t httpd_embedded_static_file_request_handler(struct httpd_handler* hndlr, struct httpd_slice_ctx *slice_ctx) {
   struct httpd_embedded_static_file_handler* hndlr_embedded_file = HTTPD_HANDLER_TO_HTTPD_EMBEDDED_STATIC_FILE_HANDLER(hndlr);
+  bool not_modified;
   esp_err_t err;
 
   printf("httpd: Delivering static content for %s from embedded file @%p\n", slice_ctx->req_ctx->req->uri, hndlr_embedded_file->start);
@@ -654,6 +718,10 @@ static esp_err_t httpd_embedded_static_file_request_handler(struct httpd_handler
     return err;
   }
 
+  if((err = httpd_resp_check_etag(slice_ctx->req_ctx->req, hndlr_embedded_file->etag, &not_modified)) || not_modified) {
+    return err;
+  }
+
   if((err = httpd_resp_set_type(slice_ctx->req_ctx->req, hndlr_embedded_file->mime_type))) {
     return err;
   }
@@ -671,7 +739,7 @@ struct httpd_handler_ops httpd_embedded_static_file_handler_ops = {
   .invoke = httpd_embedded_static_file_request_handler,
 };
 
-esp_err_t httpd_add_embedded_static_file(struct httpd* httpd, const char* path, const char *mime_type, const void *ptr_start, const void *ptr_end) {
+esp_err_t httpd_add_embedded_static_file(struct httpd* httpd, const char* path, const char *mime_type, const void *ptr_start, const void *ptr_end, const char *etag) {
   esp_err_t err;
   char* uri;
   struct httpd_embedded_static_file_handler* hndlr = calloc(1, sizeof(struct httpd_embedded_static_file_handler));
@@ -681,6 +749,7 @@ esp_err_t httpd_add_embedded_static_file(struct httpd* httpd, const char* path,
   }
   hndlr->start = ptr_start;
   hndlr->end = ptr_end;
+  hndlr->etag = etag;
   // Safe to assume this will always be a const ptr with global
   // lifetime since embedded files are defined at compile time
   hndlr->mime_type = mime_type;
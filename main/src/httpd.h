@@ -14,6 +14,22 @@
 #define HTTPD_302 "302 Found"
 #endif
 
+#ifndef HTTPD_304
+#define HTTPD_304 "304 Not Modified"
+#endif
+
+#ifndef HTTPD_409
+#define HTTPD_409 "409 Conflict"
+#endif
+
+#ifndef HTTPD_413
+#define HTTPD_413 "413 Payload Too Large"
+#endif
+
+#ifndef HTTPD_416
+#define HTTPD_416 "416 Range Not Satisfiable"
+#endif
+
 typedef struct httpd {
   httpd_handle_t server;
   char* webroot;
@@ -52,6 +68,8 @@ struct httpd_embedded_template_file_handler {
   const char *mime_type;
   const void *start;
   const void *end;
+  // Derived from inputs of template, NULL if output depends on runtime state
+  const char *etag;
   struct templ_instance* templ;
 };
 
@@ -73,6 +91,7 @@ struct httpd_embedded_static_file_handler {
   const char *mime_type;
   const void *start;
   const void *end;
+  const char *etag;
 };
 
 struct httpd_redirect_handler {
@@ -120,8 +139,9 @@ struct httpd_slice_ctx {
 esp_err_t httpd_alloc(struct httpd** retval, const char* webroot, uint16_t max_num_handlers);
 esp_err_t httpd_init(struct httpd* httpd, const char* webroot, uint16_t max_num_handlers);
 esp_err_t __httpd_add_static_path(struct httpd* httpd, const char* dir, char* name);
-esp_err_t httpd_add_embedded_static_file(struct httpd *httpd, const char *path, const char *mime_type, const void *ptr_start, const void *ptr_end);
-esp_err_t httpd_add_embedded_template_file(struct httpd *httpd, const char *path, const char *mime_type, const void *ptr_start, const void *ptr_end);
+// etag is a quoted entity tag with static lifetime or NULL
+esp_err_t httpd_add_embedded_static_file(struct httpd *httpd, const char *path, const char *mime_type, const void *ptr_start, const void *ptr_end, const char *etag);
+esp_err_t httpd_add_embedded_template_file(struct httpd *httpd, const char *path, const char *mime_type, const void *ptr_start, const void *ptr_end, const char *etag);
 esp_err_t httpd_add_redirect(struct httpd* httpd, const char* from, const char* to);
 esp_err_t httpd_response_write(struct httpd_request_ctx* ctx, const char* buff, size_t len);
 ssize_t httpd_query_string_get_param(struct httpd_request_ctx* ctx, const char* param, char** value);
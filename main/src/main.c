@@ -11,6 +11,7 @@
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_timer.h"
+#include "sdkconfig.h"
 
 #include "accept_all_the_cookies.h"
 #include "api.h"
@@ -35,9 +36,12 @@
 #include "nvs.h"
 #include "oled.h"
 #include "pixelflut/pixelflut.h"
+#include "pixel_ops.h"
 #include "power.h"
 #include "scheduler.h"
 #include "settings.h"
+#include "transcoder.h"
+#include "upload.h"
 #include "vendor.h"
 #include "webserver.h"
 #include "wlan_settings.h"
@@ -46,11 +50,7 @@
 static const char *TAG = "main";
 
 //static pixelflut_t pixelflut;
-static uint8_t gui_render_fb[256 * 64];
-
-static inline unsigned int rgb_to_grayscale(const uint8_t *rgb) {
-	return (rgb[0] + rgb[1] + rgb[2]) / 3;
-}
+static uint8_t __attribute__((aligned(16))) gui_render_fb[OLED_STRIDE * OLED_HEIGHT];
 
 static inline unsigned int rgb_pixel_to_grayscale(union fb_pixel px) {
 	unsigned int red = px.color.color_bgr.red;
@@ -61,23 +61,52 @@ static inline unsigned int rgb_pixel_to_grayscale(union fb_pixel px) {
 }
 
 static void fb_convert(uint8_t *grayscale, const uint8_t *rgb888) {
-	for (int y = 0; y < 64; y++) {
-		for (int x = 0; x < 256 / 2; x++) {
-			unsigned int int1 = rgb_to_grayscale(rgb888 + (y * 256 + x * 2 + 1) * 3);
-			unsigned int int2 = rgb_to_grayscale(rgb888 + (y * 256 + x * 2 + 0) * 3);
-			grayscale[y * 128 + x] = (int1 >> 4) | (int2 & 0xf0);
-		}
+	static uint8_t __attribute__((aligned(16))) row[OLED_WIDTH];
+
+	for (int y = 0; y < OLED_HEIGHT; y++) {
+		pixel_rgb888_to_gray(row, &rgb888[y * OLED_WIDTH * 3], OLED_WIDTH);
+		pixel_pack_8bpp(&grayscale[y * OLED_STRIDE], 0, row, OLED_WIDTH);
 	}
 }
 
-static void fb_convert_grayscale(uint8_t *stuffed_4bit, const uint8_t *grayscale) {
-	for (int y = 0; y < 64; y++) {
-		for (int x = 0; x < 256 / 2; x++) {
-			unsigned int int1 = grayscale[y * 256 + x * 2 + 1];
-			unsigned int int2 = grayscale[y * 256 + x * 2 + 0];
-			stuffed_4bit[y * 128 + x] = (int1 >> 4) | (int2 & 0xf0);
+// Find smallest area containing all differences between two packed 4 bit images
+// Only rows within damaged area can differ, the rest has not been rendered
+static void fb_diff(const uint8_t *a, const uint8_t *b, const gui_area_t *damaged_area, gui_area_t *area) {
+	int first_row = -1, last_row = -1;
+	int first_byte = OLED_STRIDE, last_byte = -1;
+	int start_y = MAX(damaged_area->position.y, 0);
+	int end_y = MIN(damaged_area->position.y + damaged_area->size.y, OLED_HEIGHT);
+
+	for (int y = start_y; y < end_y; y++) {
+		const uint8_t *row_a = &a[y * OLED_STRIDE];
+		const uint8_t *row_b = &b[y * OLED_STRIDE];
+		int x;
+
+		if (!memcmp(row_a, row_b, OLED_STRIDE)) {
+			continue;
 		}
+
+		if (first_row < 0) {
+			first_row = y;
+		}
+		last_row = y;
+
+		for (x = 0; x < first_byte && row_a[x] == row_b[x]; x++);
+		first_byte = MIN(first_byte, x);
+		for (x = OLED_STRIDE - 1; x > last_byte && row_a[x] == row_b[x]; x--);
+		last_byte = MAX(last_byte, x);
+	}
+
+	if (first_row < 0) {
+		area->size.x = 0;
+		area->size.y = 0;
+		return;
 	}
+
+	area->position.x = first_byte * 2;
+	area->position.y = first_row;
+	area->size.x = (last_byte - first_byte + 1) * 2;
+	area->size.y = last_row - first_row + 1;
 }
 
 gui_t gui;
@@ -128,13 +157,24 @@ void power_on_cb(void) {
 	menu_show(menu);
 }
 
-static uint8_t oled_fb[8192] = { 0 };
+// Last frame sent to the display
+static uint8_t __attribute__((aligned(16))) oled_fb[OLED_STRIDE * OLED_HEIGHT] = { 0 };
+// Areas of each display slot that are out of date
+static gui_area_t oled_slot_damage[2] = { 0 };
 
 void app_main(void)
 {
 	// Ensure we keep the lights on
 	power_early_init();
 
+#if CONFIG_PIXEL_OPS_SELFTEST
+	// Check SIMD pixel kernels before anything is drawn with them
+	pixel_ops_selftest();
+#if CONFIG_PIXEL_OPS_BENCHMARK
+	pixel_ops_benchmark();
+#endif
+#endif
+
 	// Initialize the display
 	oled_init();
 
@@ -185,6 +225,9 @@ void app_main(void)
 	// Setup gifplayer
 	gifplayer_init(&gui);
 
+	// Setup background conversion of uploaded animations
+	transcoder_init();
+
 	// Setup wifi settings
 	wlan_settings_init(&gui);
 
@@ -224,6 +267,7 @@ void app_main(void)
 	}
 
 	// Setup webserver
+	upload_init();
 	httpd_t *httpd = webserver_preinit();
 	api_init(httpd);
 	webserver_init(httpd);
@@ -248,6 +292,9 @@ void app_main(void)
 			256,
 			64
 		};
+		gui_area_t damaged_area, changed_area;
+		gui_area_t *damage;
+
 		if (render_ret < 0) {
 			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 		} else if (!render_ret) {
@@ -256,11 +303,33 @@ void app_main(void)
 			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(render_ret));
 		}
 		gui_lock(&gui);
-		render_ret = gui_render(&gui, gui_render_fb, 256, &render_size);
+		render_ret = gui_render(&gui, gui_render_fb, OLED_STRIDE, &render_size, &damaged_area);
 		gui_unlock(&gui);
-		fb_convert_grayscale(oled_fb, gui_render_fb);
+		if (gui_area_is_empty(&damaged_area)) {
+			// Nothing changed, no need to update the display
+			continue;
+		}
+		fb_diff(gui_render_fb, oled_fb, &damaged_area, &changed_area);
+		if (gui_area_is_empty(&changed_area)) {
+			// Rendered frame matches what is on the display already
+			continue;
+		}
+		// Previous frame might still be on its way to the display
+		oled_wait_write_done();
+		for (int y = changed_area.position.y; y < changed_area.position.y + changed_area.size.y; y++) {
+			pixel_copy_bytes(&oled_fb[y * OLED_STRIDE], &gui_render_fb[y * OLED_STRIDE], OLED_STRIDE);
+		}
+		// Both slots miss the changes, the slot not written to now catches up on next update
+		gui_area_union(&oled_slot_damage[0], &changed_area);
+		gui_area_union(&oled_slot_damage[1], &changed_area);
+
 		slot = !slot;
-		oled_write_image(oled_fb, slot ? 1 : 0);
+		damage = &oled_slot_damage[slot ? 1 : 0];
+		// Queued, next frame is rendered while this one is transferred
+		oled_write_region(oled_fb, slot ? 1 : 0, damage->position.x, damage->position.y, damage->size.x, damage->size.y);
+		damage->size.x = 0;
+		damage->size.y = 0;
+		// Slot switch is queued behind image data, switches only after write completed
 		oled_show_image(slot ? 1 : 0);
 	}
 }
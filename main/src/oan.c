@@ -0,0 +1,405 @@
+#include "oan.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+
+#include "util.h"
+
+// Run of equal bytes: header has MSB set, followed by one byte
+#define RLE_RUN			0x80
+#define RLE_MAX_LEN		128
+// Shorter runs are stored as literals
+#define RLE_MIN_RUN		3
+
+static const char *TAG = "oan";
+
+static size_t oan_frame_size(const oan_header_t *header) {
+	return OAN_STRIDE(header->width) * header->height;
+}
+
+bool oan_probe(const char *path) {
+	char magic[4];
+	FILE *file = fopen(path, "r");
+	bool is_oan;
+
+	if (!file) {
+		return false;
+	}
+	is_oan = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && !memcmp(magic, OAN_MAGIC, sizeof(magic));
+	fclose(file);
+	return is_oan;
+}
+
+bool oan_probe_memory(const uint8_t *data, size_t size) {
+	return size >= sizeof(oan_header_t) && !memcmp(data, OAN_MAGIC, strlen(OAN_MAGIC));
+}
+
+static int oan_check_header(const oan_header_t *header) {
+	if (memcmp(header->magic, OAN_MAGIC, sizeof(header->magic)) ||
+	    header->version != OAN_VERSION || !header->num_frames) {
+		ESP_LOGE(TAG, "Invalid animation header");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int oan_open_memory(oan_t *oan, const uint8_t *data, size_t size) {
+	size_t index_size;
+
+	memset(oan, 0, sizeof(*oan));
+	if (size < sizeof(oan->header)) {
+		return -EINVAL;
+	}
+	memcpy(&oan->header, data, sizeof(oan->header));
+	if (oan_check_header(&oan->header)) {
+		return -EINVAL;
+	}
+
+	index_size = oan->header.num_frames * sizeof(oan_frame_index_t);
+	if (oan->header.index_offset > size || index_size > size - oan->header.index_offset) {
+		return -EINVAL;
+	}
+	oan->index = malloc(index_size);
+	if (!oan->index) {
+		return -ENOMEM;
+	}
+	memcpy(oan->index, &data[oan->header.index_offset], index_size);
+	oan->data = data;
+	oan->data_size = size;
+
+	return 0;
+}
+
+int oan_open(oan_t *oan, const char *path) {
+	size_t index_size;
+	int err;
+
+	memset(oan, 0, sizeof(*oan));
+	oan->file = fopen(path, "r");
+	if (!oan->file) {
+		return -errno;
+	}
+
+	if (fread(&oan->header, 1, sizeof(oan->header), oan->file) != sizeof(oan->header)) {
+		err = -EIO;
+		goto fail;
+	}
+	err = oan_check_header(&oan->header);
+	if (err) {
+		goto fail;
+	}
+
+	index_size = oan->header.num_frames * sizeof(oan_frame_index_t);
+	oan->index = malloc(index_size);
+	if (!oan->index) {
+		err = -ENOMEM;
+		goto fail;
+	}
+	if (fseek(oan->file, oan->header.index_offset, SEEK_SET) ||
+	    fread(oan->index, 1, index_size, oan->file) != index_size) {
+		err = -EIO;
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	oan_close(oan);
+	return err;
+}
+
+void oan_close(oan_t *oan) {
+	if (oan->file) {
+		fclose(oan->file);
+	}
+	free(oan->index);
+	free(oan->buf);
+	memset(oan, 0, sizeof(*oan));
+}
+
+// XOR run length encoded delta into dst
+static int oan_apply_xor_rle(uint8_t *dst, size_t len, const uint8_t *src, size_t src_len) {
+	const uint8_t *src_end = src + src_len;
+	uint8_t *dst_end = dst + len;
+
+	while (src < src_end) {
+		uint8_t header = *src++;
+		size_t run_len = (header & ~RLE_RUN) + 1;
+
+		if (run_len > dst_end - dst) {
+			return -EINVAL;
+		}
+		if (header & RLE_RUN) {
+			uint8_t value;
+
+			if (src >= src_end) {
+				return -EINVAL;
+			}
+			value = *src++;
+			// Runs of zeros are unchanged pixels
+			if (value) {
+				for (size_t i = 0; i < run_len; i++) {
+					dst[i] ^= value;
+				}
+			}
+		} else {
+			if (run_len > src_end - src) {
+				return -EINVAL;
+			}
+			for (size_t i = 0; i < run_len; i++) {
+				dst[i] ^= src[i];
+			}
+			src += run_len;
+		}
+		dst += run_len;
+	}
+
+	return 0;
+}
+
+int oan_play_frame(oan_t *oan, uint8_t *canvas, int *duration_ms) {
+	const oan_frame_index_t *frame = &oan->index[oan->next_frame];
+	unsigned int stride = OAN_STRIDE(oan->header.width);
+	uint8_t *rows = &canvas[frame->first_row * stride];
+	size_t rows_size = frame->num_rows * stride;
+	const uint8_t *src = NULL;
+	int err;
+
+	if (frame->first_row + frame->num_rows > oan->header.height) {
+		return -EINVAL;
+	}
+
+	if (oan->data) {
+		if (frame->offset > oan->data_size || frame->size > oan->data_size - frame->offset) {
+			return -EINVAL;
+		}
+		src = &oan->data[frame->offset];
+	} else if (frame->size) {
+		if (frame->size > oan->buf_size) {
+			uint8_t *buf = realloc(oan->buf, frame->size);
+
+			if (!buf) {
+				return -ENOMEM;
+			}
+			oan->buf = buf;
+			oan->buf_size = frame->size;
+		}
+		if (fseek(oan->file, frame->offset, SEEK_SET) ||
+		    fread(oan->buf, 1, frame->size, oan->file) != frame->size) {
+			return -EIO;
+		}
+		src = oan->buf;
+	}
+
+	switch (frame->encoding) {
+	case OAN_ENCODING_RAW:
+		if (frame->size != rows_size) {
+			return -EINVAL;
+		}
+		memcpy(rows, src, rows_size);
+		break;
+	case OAN_ENCODING_XOR_RLE:
+		err = oan_apply_xor_rle(rows, rows_size, src, frame->size);
+		if (err) {
+			return err;
+		}
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	*duration_ms = frame->duration_ms;
+	oan->changed_first_row = frame->first_row;
+	oan->changed_num_rows = frame->num_rows;
+	oan->next_frame++;
+	if (oan->next_frame >= oan->header.num_frames) {
+		oan->next_frame = 0;
+		return 0;
+	}
+	return 1;
+}
+
+int oan_encoder_init(oan_encoder_t *enc, FILE *file, unsigned int width, unsigned int height) {
+	size_t frame_size;
+
+	memset(enc, 0, sizeof(*enc));
+	enc->file = file;
+	memcpy(enc->header.magic, OAN_MAGIC, sizeof(enc->header.magic));
+	enc->header.version = OAN_VERSION;
+	enc->header.width = width;
+	enc->header.height = height;
+	frame_size = oan_frame_size(&enc->header);
+
+	enc->prev = calloc(1, frame_size);
+	enc->delta = malloc(frame_size);
+	// Worst case for literal runs
+	enc->buf = malloc(frame_size + DIV_ROUND_UP(frame_size, RLE_MAX_LEN));
+	if (!enc->prev || !enc->delta || !enc->buf) {
+		oan_encoder_free(enc);
+		return -ENOMEM;
+	}
+
+	// Header is rewritten once frame index is known
+	if (fwrite(&enc->header, 1, sizeof(enc->header), file) != sizeof(enc->header)) {
+		oan_encoder_free(enc);
+		return -EIO;
+	}
+	enc->offset = sizeof(enc->header);
+	return 0;
+}
+
+static size_t oan_encode_rle(uint8_t *dst, const uint8_t *src, size_t len) {
+	size_t pos = 0, out = 0;
+	size_t literal_start = 0;
+
+	while (pos < len) {
+		size_t run = 1;
+
+		while (pos + run < len && run < RLE_MAX_LEN && src[pos + run] == src[pos]) {
+			run++;
+		}
+
+		if (run >= RLE_MIN_RUN || pos - literal_start == RLE_MAX_LEN) {
+			// Flush pending literals
+			while (literal_start < pos) {
+				size_t literal_len = MIN(pos - literal_start, RLE_MAX_LEN);
+
+				dst[out++] = literal_len - 1;
+				memcpy(&dst[out], &src[literal_start], literal_len);
+				out += literal_len;
+				literal_start += literal_len;
+			}
+		}
+
+		if (run >= RLE_MIN_RUN) {
+			dst[out++] = RLE_RUN | (run - 1);
+			dst[out++] = src[pos];
+			pos += run;
+			literal_start = pos;
+		} else {
+			pos += run;
+		}
+	}
+
+	while (literal_start < len) {
+		size_t literal_len = MIN(len - literal_start, RLE_MAX_LEN);
+
+		dst[out++] = literal_len - 1;
+		memcpy(&dst[out], &src[literal_start], literal_len);
+		out += literal_len;
+		literal_start += literal_len;
+	}
+
+	return out;
+}
+
+int oan_encoder_add_frame(oan_encoder_t *enc, const uint8_t *pixels, int duration_ms) {
+	unsigned int stride = OAN_STRIDE(enc->header.width);
+	unsigned int height = enc->header.height;
+	unsigned int first_row = 0, last_row = height;
+	oan_frame_index_t *frame;
+	const uint8_t *data;
+	size_t rows_size, rle_size;
+
+	if (enc->header.num_frames == UINT16_MAX) {
+		return -EFBIG;
+	}
+
+	if (enc->header.num_frames == enc->index_size) {
+		unsigned int index_size = MAX(enc->index_size * 2, 16);
+		oan_frame_index_t *index = realloc(enc->index, index_size * sizeof(*index));
+
+		if (!index) {
+			return -ENOMEM;
+		}
+		enc->index = index;
+		enc->index_size = index_size;
+	}
+	frame = &enc->index[enc->header.num_frames];
+
+	// First frame is a key frame covering all rows
+	if (enc->header.num_frames) {
+		while (first_row < height && !memcmp(&pixels[first_row * stride], &enc->prev[first_row * stride], stride)) {
+			first_row++;
+		}
+		while (last_row > first_row && !memcmp(&pixels[(last_row - 1) * stride], &enc->prev[(last_row - 1) * stride], stride)) {
+			last_row--;
+		}
+	}
+
+	frame->offset = enc->offset;
+	frame->duration_ms = MIN(MAX(duration_ms, 0), UINT16_MAX);
+	frame->first_row = first_row;
+	frame->num_rows = last_row - first_row;
+	frame->encoding = OAN_ENCODING_RAW;
+	frame->reserved = 0;
+	rows_size = frame->num_rows * stride;
+	data = &pixels[first_row * stride];
+
+	if (enc->header.num_frames && rows_size) {
+		for (size_t i = 0; i < rows_size; i++) {
+			enc->delta[i] = data[i] ^ enc->prev[first_row * stride + i];
+		}
+		rle_size = oan_encode_rle(enc->buf, enc->delta, rows_size);
+		if (rle_size < rows_size) {
+			frame->encoding = OAN_ENCODING_XOR_RLE;
+			data = enc->buf;
+			rows_size = rle_size;
+		}
+	}
+
+	frame->size = rows_size;
+	if (fwrite(data, 1, rows_size, enc->file) != rows_size) {
+		return -EIO;
+	}
+	enc->offset += rows_size;
+	memcpy(enc->prev, pixels, stride * height);
+	enc->header.num_frames++;
+	return 0;
+}
+
+int oan_encoder_extend_last_frame(oan_encoder_t *enc, int duration_ms) {
+	oan_frame_index_t *frame;
+
+	if (!enc->header.num_frames) {
+		return -EINVAL;
+	}
+
+	frame = &enc->index[enc->header.num_frames - 1];
+	frame->duration_ms = MIN(frame->duration_ms + MAX(duration_ms, 0), UINT16_MAX);
+	return 0;
+}
+
+int oan_encoder_finish(oan_encoder_t *enc) {
+	size_t index_size = enc->header.num_frames * sizeof(oan_frame_index_t);
+
+	if (!enc->header.num_frames) {
+		return -EINVAL;
+	}
+
+	enc->header.index_offset = enc->offset;
+	if (fwrite(enc->index, 1, index_size, enc->file) != index_size) {
+		return -EIO;
+	}
+	if (fseek(enc->file, 0, SEEK_SET) ||
+	    fwrite(&enc->header, 1, sizeof(enc->header), enc->file) != sizeof(enc->header)) {
+		return -EIO;
+	}
+
+	return 0;
+}
+
+void oan_encoder_free(oan_encoder_t *enc) {
+	free(enc->index);
+	free(enc->prev);
+	free(enc->delta);
+	free(enc->buf);
+	enc->index = NULL;
+	enc->prev = NULL;
+	enc->delta = NULL;
+	enc->buf = NULL;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Native animation format
+ *
+ * Frames are stored in display format, two 4 bit pixels per byte, in panel
+ * row order. Each frame only covers the range of rows that changed since
+ * the previous frame, either raw or as run length encoded XOR delta. The
+ * first frame is always a raw key frame covering all rows.
+ *
+ * Layout: header, frame data, frame index. All values are little endian.
+ */
+
+#define OAN_MAGIC		"OAN1"
+#define OAN_VERSION		1
+
+typedef enum oan_encoding {
+	// Rows are stored as they are
+	OAN_ENCODING_RAW = 0,
+	// Rows are XORed with previous frame, then run length encoded
+	OAN_ENCODING_XOR_RLE = 1,
+} oan_encoding_t;
+
+typedef struct oan_header {
+	char magic[4];
+	uint16_t version;
+	uint16_t width;
+	uint16_t height;
+	uint16_t num_frames;
+	uint32_t index_offset;
+} __attribute__((packed)) oan_header_t;
+
+typedef struct oan_frame_index {
+	uint32_t offset;
+	uint32_t size;
+	uint16_t duration_ms;
+	uint16_t first_row;
+	uint16_t num_rows;
+	uint8_t encoding;
+	uint8_t reserved;
+} __attribute__((packed)) oan_frame_index_t;
+
+typedef struct oan {
+	// Either file or memory backed
+	FILE *file;
+	const uint8_t *data;
+	size_t data_size;
+	oan_header_t header;
+	oan_frame_index_t *index;
+	unsigned int next_frame;
+	// Rows changed by last frame played
+	unsigned int changed_first_row;
+	unsigned int changed_num_rows;
+	// Encoded frame data
+	uint8_t *buf;
+	size_t buf_size;
+} oan_t;
+
+typedef struct oan_encoder {
+	FILE *file;
+	oan_header_t header;
+	oan_frame_index_t *index;
+	unsigned int index_size;
+	uint32_t offset;
+	// Previous frame, all black before the first frame
+	uint8_t *prev;
+	uint8_t *delta;
+	uint8_t *buf;
+} oan_encoder_t;
+
+// Stride of frames in bytes
+#define OAN_STRIDE(width_) (((width_) + 1) / 2)
+
+bool oan_probe(const char *path);
+bool oan_probe_memory(const uint8_t *data, size_t size);
+
+int oan_open(oan_t *oan, const char *path);
+// Frame data is read from memory directly, must stay valid until oan is closed
+int oan_open_memory(oan_t *oan, const uint8_t *data, size_t size);
+void oan_close(oan_t *oan);
+// Apply next frame to canvas holding the previous frame. Returns 1 if there are more frames,
+// 0 after the last frame (playback restarts with the first one) or a negative error code
+int oan_play_frame(oan_t *oan, uint8_t *canvas, int *duration_ms);
+
+int oan_encoder_init(oan_encoder_t *enc, FILE *file, unsigned int width, unsigned int height);
+int oan_encoder_add_frame(oan_encoder_t *enc, const uint8_t *pixels, int duration_ms);
+// Show last frame for longer instead of adding an identical one
+int oan_encoder_extend_last_frame(oan_encoder_t *enc, int duration_ms);
+// Writes frame index and header, does not close the file
+int oan_encoder_finish(oan_encoder_t *enc);
+void oan_encoder_free(oan_encoder_t *enc);
@@ -10,8 +10,10 @@
 #include <driver/spi_master.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 
 #include "event_bus.h"
+#include "util.h"
 
 #define GPIO_SPI_MOSI	36
 #define GPIO_SPI_CLK	33
@@ -22,9 +24,43 @@
 
 #define SPI_OLED_HOST	SPI2_HOST
 
+// GDDRAM column addresses cover 4 pixels each, display starts at column 28
+#define OLED_COLUMN_PIXELS	4
+#define OLED_COLUMN_OFFSET	28
+#define OLED_SLOT_ROWS		64
+
+#define TX_STATS_INTERVAL_US	MS_TO_US(1000)
+
+// Maximum number of SPI transactions queued at once
+#define OLED_QUEUE_SIZE		16
+
+// Flags stored in transaction user data
+#define OLED_TRANS_DC		BIT(0)
+#define OLED_TRANS_WRITE_DONE	BIT(1)
+
+static const char *TAG = "oled";
+
 static spi_device_handle_t oled_spidev;
 
-static const uint8_t oled_blank[8192] = { 0 };
+static const uint8_t oled_blank[OLED_STRIDE * OLED_HEIGHT] = { 0 };
+
+// Bounce buffer for regions not spanning full rows
+static uint8_t __attribute__((aligned(4))) oled_region_buf[OLED_STRIDE * OLED_HEIGHT];
+
+// Transactions must stay valid until the driver has returned them
+static spi_transaction_t trans_pool[OLED_QUEUE_SIZE];
+static unsigned int trans_next = 0;
+static unsigned int trans_in_flight = 0;
+
+static unsigned int writes_queued = 0;
+static volatile unsigned int writes_done = 0;
+static SemaphoreHandle_t write_done_sem;
+static StaticSemaphore_t write_done_sem_buffer;
+
+static uint64_t tx_bytes_total = 0;
+static unsigned int tx_bytes_window = 0;
+static unsigned int tx_bytes_per_second = 0;
+static int64_t tx_window_start_us = 0;
 
 static unsigned int oled_brightness = 15;
 
@@ -39,12 +75,76 @@ static void oled_unlock(void) {
 	xSemaphoreGive(lock);
 }
 
+// Call only with oled lock held
+static void oled_account_tx(size_t bytes) {
+	int64_t now = esp_timer_get_time();
+	int64_t window_us = now - tx_window_start_us;
+
+	if (window_us >= TX_STATS_INTERVAL_US) {
+		tx_bytes_per_second = tx_bytes_window * 1000000LL / window_us;
+		ESP_LOGD(TAG, "SPI throughput: %u bytes/s", tx_bytes_per_second);
+		tx_bytes_window = 0;
+		tx_window_start_us = now;
+	}
+	tx_bytes_window += bytes;
+	tx_bytes_total += bytes;
+}
+
 static void oled_spi_pre_transfer_cb(spi_transaction_t *t)
 {
-	int dc = (int)t->user;
+	int dc = !!((uintptr_t)t->user & OLED_TRANS_DC);
 	gpio_set_level(GPIO_OLED_DC, dc);
 }
 
+static void oled_spi_post_transfer_cb(spi_transaction_t *t)
+{
+	// Image data is on the display, source buffer may be reused
+	if ((uintptr_t)t->user & OLED_TRANS_WRITE_DONE) {
+		BaseType_t task_woken = pdFALSE;
+
+		writes_done++;
+		xSemaphoreGiveFromISR(write_done_sem, &task_woken);
+		if (task_woken) {
+			portYIELD_FROM_ISR();
+		}
+	}
+}
+
+// Call only with oled lock held
+static void oled_queue_trans(spi_device_handle_t spidev, const spi_transaction_t *trans) {
+	spi_transaction_t *t;
+
+	// Collect finished transactions, wait for one if all of them are in flight
+	while (trans_in_flight &&
+	       spi_device_get_trans_result(spidev, &t, trans_in_flight == OLED_QUEUE_SIZE ? portMAX_DELAY : 0) == ESP_OK) {
+		trans_in_flight--;
+	}
+
+	// Transactions complete in order, next one in pool is always free
+	t = &trans_pool[trans_next];
+	trans_next = (trans_next + 1) % OLED_QUEUE_SIZE;
+	*t = *trans;
+	ESP_ERROR_CHECK(spi_device_queue_trans(spidev, t, portMAX_DELAY));
+	trans_in_flight++;
+}
+
+// Call only with oled lock held
+static void oled_flush(spi_device_handle_t spidev) {
+	spi_transaction_t *t;
+
+	while (trans_in_flight) {
+		ESP_ERROR_CHECK(spi_device_get_trans_result(spidev, &t, portMAX_DELAY));
+		trans_in_flight--;
+	}
+}
+
+// Call only with oled lock held
+static void oled_wait_write_done_(void) {
+	while (writes_done != writes_queued) {
+		xSemaphoreTake(write_done_sem, portMAX_DELAY);
+	}
+}
+
 #define OLED_CMD(cmd_, ...) do {						\
 	spi_transaction_t t = { 0 };						\
 	const uint8_t data[] = { __VA_ARGS__ };					\
@@ -54,16 +154,17 @@ static void oled_spi_pre_transfer_cb(spi_transaction_t *t)
 	t.flags = SPI_TRANS_USE_TXDATA;						\
 	t.tx_data[0] = cmd_;							\
 	t.user = (void *)0;							\
-	/* gpio_set_level(GPIO_OLED_DC, 0); */					\
-	ESP_ERROR_CHECK(spi_device_polling_transmit(spidev, &t));		\
-	/* Data */								\
+	oled_queue_trans(spidev, &t);						\
+	oled_account_tx(1);							\
+	/* Data, at most 4 bytes are stored in transaction itself */		\
 	if (sizeof(data)) {							\
 		memset(&t, 0, sizeof(t));					\
 		t.length = sizeof(data) * 8;					\
-		t.tx_buffer = data;						\
-		t.user = (void *)1;						\
-		/* gpio_set_level(GPIO_OLED_DC, 1); */				\
-		ESP_ERROR_CHECK(spi_device_polling_transmit(spidev, &t));	\
+		t.flags = SPI_TRANS_USE_TXDATA;					\
+		memcpy(t.tx_data, data, sizeof(data));				\
+		t.user = (void *)OLED_TRANS_DC;					\
+		oled_queue_trans(spidev, &t);					\
+		oled_account_tx(sizeof(data));					\
 	}									\
 } while (0)
 
@@ -101,32 +202,72 @@ static void oled_configure(spi_device_handle_t spidev)
 	OLED_CMD(0xA6);			// Normal display mode
 	OLED_CMD(0xA9);			// Exit partial display mode
 	OLED_CMD(0xAF);			// Sleep mode off
+	oled_flush(spidev);
 
 	vTaskDelay(pdMS_TO_TICKS(100));
 }
 
-static void oled_write_image_(spi_device_handle_t spidev, const uint8_t *image, unsigned int slot) {
+static void oled_write_region_(spi_device_handle_t spidev, const uint8_t *image, unsigned int slot, unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
 	spi_transaction_t t = { 0 };
+	unsigned int column_start = x / OLED_COLUMN_PIXELS;
+	unsigned int column_end = DIV_ROUND_UP(x + width, OLED_COLUMN_PIXELS);
+	unsigned int row_start = y + (slot ? OLED_SLOT_ROWS : 0);
+	size_t row_len = (column_end - column_start) * OLED_COLUMN_PIXELS / 2;
+	const uint8_t *data;
+
+	if (!width || !height) {
+		return;
+	}
 
 	oled_lock();
-	if (slot) {
-		OLED_CMD(0x75, 64, 127); // Select slot 1
-	} else {
-		OLED_CMD(0x75, 0, 63); // Select slot 0
+	if (row_len != OLED_STRIDE) {
+		// Bounce buffer might still be in use by previous write
+		oled_wait_write_done_();
 	}
+	OLED_CMD(0x15, OLED_COLUMN_OFFSET + column_start, OLED_COLUMN_OFFSET + column_end - 1); // Select columns
+	OLED_CMD(0x75, row_start, row_start + height - 1); // Select rows in slot
 	OLED_CMD(0x5C); // Write GDDRAM
-	t.length = 256 * 64 * 4;
-	t.tx_buffer = image;
-	t.user = (void *)1;
-	ESP_ERROR_CHECK(spi_device_polling_transmit(spidev, &t));
+	if (row_len == OLED_STRIDE) {
+		// Full rows, region is contiguous in image
+		data = &image[y * OLED_STRIDE];
+	} else {
+		unsigned int row;
+
+		for (row = 0; row < height; row++) {
+			memcpy(&oled_region_buf[row * row_len],
+			       &image[(y + row) * OLED_STRIDE + column_start * OLED_COLUMN_PIXELS / 2],
+			       row_len);
+		}
+		data = oled_region_buf;
+	}
+	t.length = row_len * height * 8;
+	t.tx_buffer = data;
+	t.user = (void *)(OLED_TRANS_DC | OLED_TRANS_WRITE_DONE);
+	writes_queued++;
+	oled_queue_trans(spidev, &t);
+	oled_account_tx(row_len * height);
 	oled_unlock();
 }
 
+static void oled_write_image_(spi_device_handle_t spidev, const uint8_t *image, unsigned int slot) {
+	oled_write_region_(spidev, image, slot, 0, 0, OLED_WIDTH, OLED_HEIGHT);
+}
+
 void oled_write_image(const uint8_t *image, unsigned int slot)
 {
 	oled_write_image_(oled_spidev, image, slot);
 }
 
+void oled_write_region(const uint8_t *image, unsigned int slot, unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	oled_write_region_(oled_spidev, image, slot, x, y, width, height);
+}
+
+void oled_wait_write_done(void) {
+	oled_lock();
+	oled_wait_write_done_();
+	oled_unlock();
+}
+
 void oled_show_image(unsigned int slot) {
 	spi_device_handle_t spidev = oled_spidev;
 
@@ -147,18 +288,21 @@ void oled_init() {
 		.sclk_io_num = GPIO_SPI_CLK,
 		.quadwp_io_num = -1,
 		.quadhd_io_num = -1,
-		.max_transfer_sz = 8192
+		.max_transfer_sz = OLED_STRIDE * OLED_HEIGHT
 	};
 
 	spi_device_interface_config_t devcfg = {
 		.clock_speed_hz = 10 * 1000 * 1000,	// Clock out at 10 MHz
 		.mode = 3,				// SPI mode 3
 		.spics_io_num = GPIO_OLED_CS,		// CS pin
-		.queue_size = 1,			// We want to be able to queue 1 transaction at a time
-		.pre_cb = oled_spi_pre_transfer_cb	// Specify pre-transfer callback to handle D/~C line
+		.queue_size = OLED_QUEUE_SIZE,		// Queue commands and image data without waiting
+		.pre_cb = oled_spi_pre_transfer_cb,	// Specify pre-transfer callback to handle D/~C line
+		.post_cb = oled_spi_post_transfer_cb	// Specify post-transfer callback to signal finished writes
 	};
 
 	lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+	write_done_sem = xSemaphoreCreateBinaryStatic(&write_done_sem_buffer);
+	tx_window_start_us = esp_timer_get_time();
 
 	// Setup GPIOs
 	gpio_set_direction(GPIO_OLED_DC, GPIO_MODE_OUTPUT);
@@ -176,6 +320,7 @@ void oled_init() {
 	// Clear screen buffer
 	oled_write_image_(spidev, oled_blank, 0);
 	oled_write_image_(spidev, oled_blank, 1);
+	oled_flush(spidev);
 
 	// Power up display
 	gpio_set_level(GPIO_OLED_VCC, 1);
@@ -200,3 +345,28 @@ void oled_set_brightness(unsigned int brightness) {
 unsigned int oled_get_brightness() {
 	return oled_brightness;
 }
+
+uint64_t oled_get_tx_bytes_total(void) {
+	uint64_t bytes;
+
+	oled_lock();
+	bytes = tx_bytes_total;
+	oled_unlock();
+	return bytes;
+}
+
+unsigned int oled_get_tx_bytes_per_second(void) {
+	unsigned int bytes_per_second;
+	int64_t window_us;
+
+	oled_lock();
+	window_us = esp_timer_get_time() - tx_window_start_us;
+	if (window_us >= 2 * TX_STATS_INTERVAL_US) {
+		// Display has been idle for a while, last result is stale
+		bytes_per_second = tx_bytes_window * 1000000LL / window_us;
+	} else {
+		bytes_per_second = tx_bytes_per_second;
+	}
+	oled_unlock();
+	return bytes_per_second;
+}
@@ -2,8 +2,18 @@
 
 #include <stdint.h>
 
+#define OLED_WIDTH	256
+#define OLED_HEIGHT	 64
+// Two 4 bit pixels per byte
+#define OLED_STRIDE	(OLED_WIDTH / 2)
+
 void oled_init(void);
+// Writes are queued, image must not be modified until oled_wait_write_done() returns
 void oled_write_image(const uint8_t *image, unsigned int slot);
+void oled_write_region(const uint8_t *image, unsigned int slot, unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+void oled_wait_write_done(void);
 void oled_show_image(unsigned int slot);
 void oled_set_brightness(unsigned int brightness);
 unsigned int oled_get_brightness(void);
+uint64_t oled_get_tx_bytes_total(void);
+unsigned int oled_get_tx_bytes_per_second(void);
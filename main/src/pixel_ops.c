@@ -0,0 +1,399 @@
+#include "pixel_ops.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <sdkconfig.h>
+
+void pixel_fill_4bpp(uint8_t *row, unsigned int x, unsigned int width, uint8_t value) {
+	value &= 0x0f;
+
+	if (!width) {
+		return;
+	}
+
+	// Leading odd pixel
+	if (x % 2) {
+		pixel_set_4bpp(row, x, value);
+		x++;
+		width--;
+	}
+
+	// Whole bytes
+	pixel_fill_bytes(&row[x / 2], (value << 4) | value, width / 2);
+	x += width & ~1U;
+
+	// Trailing even pixel
+	if (width % 2) {
+		pixel_set_4bpp(row, x, value);
+	}
+}
+
+void pixel_invert_4bpp(uint8_t *row, unsigned int x, unsigned int width) {
+	if (!width) {
+		return;
+	}
+
+	// Leading odd pixel
+	if (x % 2) {
+		row[x / 2] ^= 0x0f;
+		x++;
+		width--;
+	}
+
+	// Whole bytes
+	pixel_invert_bytes(&row[x / 2], width / 2);
+	x += width & ~1U;
+
+	// Trailing even pixel
+	if (width % 2) {
+		row[x / 2] ^= 0xf0;
+	}
+}
+
+void pixel_pack_8bpp(uint8_t *row, unsigned int x, const uint8_t *src, unsigned int width) {
+	if (!width) {
+		return;
+	}
+
+	// Leading odd pixel
+	if (x % 2) {
+		pixel_set_4bpp(row, x, PIXEL_TO_4BPP(*src++));
+		x++;
+		width--;
+	}
+
+	// Whole bytes
+	pixel_pack_bytes(&row[x / 2], src, width / 2);
+	src += width & ~1U;
+	x += width & ~1U;
+
+	// Trailing even pixel
+	if (width % 2) {
+		pixel_set_4bpp(row, x, PIXEL_TO_4BPP(*src));
+	}
+}
+
+void pixel_copy_4bpp(uint8_t *row, unsigned int x, const uint8_t *src_row, unsigned int src_x, unsigned int width) {
+	if (!width) {
+		return;
+	}
+
+	if (x % 2 == src_x % 2) {
+		// Same nibble alignment, copy whole bytes
+		if (x % 2) {
+			pixel_set_4bpp(row, x, pixel_get_4bpp(src_row, src_x));
+			x++;
+			src_x++;
+			width--;
+		}
+
+		pixel_copy_bytes(&row[x / 2], &src_row[src_x / 2], width / 2);
+		x += width & ~1U;
+		src_x += width & ~1U;
+
+		if (width % 2) {
+			pixel_set_4bpp(row, x, pixel_get_4bpp(src_row, src_x));
+		}
+	} else {
+		uint8_t *byte;
+		const uint8_t *src;
+		unsigned int i;
+
+		// Nibbles need to be shifted by one pixel
+		if (x % 2) {
+			pixel_set_4bpp(row, x, pixel_get_4bpp(src_row, src_x));
+			x++;
+			src_x++;
+			width--;
+		}
+
+		// Destination is byte aligned now, source is not
+		byte = &row[x / 2];
+		src = &src_row[src_x / 2];
+		for (i = 0; i < width / 2; i++) {
+			byte[i] = (src[i] << 4) | (src[i + 1] >> 4);
+		}
+		x += width & ~1U;
+		src_x += width & ~1U;
+
+		if (width % 2) {
+			pixel_set_4bpp(row, x, pixel_get_4bpp(src_row, src_x));
+		}
+	}
+}
+
+void pixel_rgb888_to_gray(uint8_t *dst, const uint8_t *rgb, unsigned int width) {
+	unsigned int i;
+
+	for (i = 0; i < width; i++) {
+		dst[i] = (rgb[0] + rgb[1] + rgb[2]) / 3;
+		rgb += 3;
+	}
+}
+
+void pixel_fill_4bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, unsigned int width, unsigned int height, uint8_t value) {
+	unsigned int y;
+
+	for (y = 0; y < height; y++) {
+		pixel_fill_4bpp(&dst[y * stride], x, width, value);
+	}
+}
+
+void pixel_invert_4bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, unsigned int width, unsigned int height) {
+	unsigned int y;
+
+	for (y = 0; y < height; y++) {
+		pixel_invert_4bpp(&dst[y * stride], x, width);
+	}
+}
+
+void pixel_pack_8bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, const uint8_t *src, unsigned int src_stride, unsigned int width, unsigned int height) {
+	unsigned int y;
+
+	for (y = 0; y < height; y++) {
+		pixel_pack_8bpp(&dst[y * stride], x, &src[y * src_stride], width);
+	}
+}
+
+void pixel_copy_4bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, const uint8_t *src, unsigned int src_stride, unsigned int src_x, unsigned int width, unsigned int height) {
+	unsigned int y;
+
+	for (y = 0; y < height; y++) {
+		pixel_copy_4bpp(&dst[y * stride], x, &src[y * src_stride], src_x, width);
+	}
+}
+
+void pixel_fill_bytes_ref(uint8_t *dst, uint8_t value, size_t len) {
+	memset(dst, value, len);
+}
+
+void pixel_invert_bytes_ref(uint8_t *dst, size_t len) {
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		dst[i] ^= 0xff;
+	}
+}
+
+void pixel_pack_bytes_ref(uint8_t *dst, const uint8_t *src, size_t len) {
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		dst[i] = (src[0] & 0xf0) | (src[1] >> 4);
+		src += 2;
+	}
+}
+
+void pixel_copy_bytes_ref(uint8_t *dst, const uint8_t *src, size_t len) {
+	memcpy(dst, src, len);
+}
+
+void pixel_blend_bytes_ref(uint8_t *dst, const uint8_t *a, const uint8_t *b, unsigned int alpha, size_t len) {
+	unsigned int inv_alpha = PIXEL_BLEND_MAX - alpha;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		unsigned int hi = ((a[i] >> 4) * inv_alpha + (b[i] >> 4) * alpha + PIXEL_BLEND_MAX / 2) / PIXEL_BLEND_MAX;
+		unsigned int lo = ((a[i] & 0x0f) * inv_alpha + (b[i] & 0x0f) * alpha + PIXEL_BLEND_MAX / 2) / PIXEL_BLEND_MAX;
+
+		dst[i] = (hi << 4) | lo;
+	}
+}
+
+#define SWAR_WORD_SIZE		sizeof(uint32_t)
+#define SWAR_LOW_NIBBLES	0x0f0f0f0fU
+#define SWAR_ROUNDING		0x08080808U
+
+/*
+ * Blends eight pixels per 32 bit word. Each nibble is spread into a byte lane,
+ * weights add up to 16, so no lane can carry into its neighbour.
+ */
+static inline uint32_t pixel_blend_word(uint32_t a, uint32_t b, unsigned int alpha, unsigned int inv_alpha) {
+	uint32_t lo = (a & SWAR_LOW_NIBBLES) * inv_alpha + (b & SWAR_LOW_NIBBLES) * alpha + SWAR_ROUNDING;
+	uint32_t hi = ((a >> 4) & SWAR_LOW_NIBBLES) * inv_alpha + ((b >> 4) & SWAR_LOW_NIBBLES) * alpha + SWAR_ROUNDING;
+
+	return (hi & ~SWAR_LOW_NIBBLES) | ((lo >> 4) & SWAR_LOW_NIBBLES);
+}
+
+void pixel_blend_bytes(uint8_t *dst, const uint8_t *a, const uint8_t *b, unsigned int alpha, size_t len) {
+	unsigned int inv_alpha = PIXEL_BLEND_MAX - alpha;
+	size_t head, words;
+
+	if (!alpha) {
+		pixel_copy_bytes(dst, a, len);
+		return;
+	}
+	if (alpha >= PIXEL_BLEND_MAX) {
+		pixel_copy_bytes(dst, b, len);
+		return;
+	}
+
+	// Word access only if all buffers can be aligned at the same time
+	head = (SWAR_WORD_SIZE - (uintptr_t)dst % SWAR_WORD_SIZE) % SWAR_WORD_SIZE;
+	if (len < head || (uintptr_t)(a + head) % SWAR_WORD_SIZE || (uintptr_t)(b + head) % SWAR_WORD_SIZE) {
+		pixel_blend_bytes_ref(dst, a, b, alpha, len);
+		return;
+	}
+
+	pixel_blend_bytes_ref(dst, a, b, alpha, head);
+	dst += head;
+	a += head;
+	b += head;
+	len -= head;
+
+	words = len / SWAR_WORD_SIZE;
+	for (size_t i = 0; i < words; i++) {
+		((uint32_t *)dst)[i] = pixel_blend_word(((const uint32_t *)a)[i], ((const uint32_t *)b)[i], alpha, inv_alpha);
+	}
+	dst += words * SWAR_WORD_SIZE;
+	a += words * SWAR_WORD_SIZE;
+	b += words * SWAR_WORD_SIZE;
+	len -= words * SWAR_WORD_SIZE;
+
+	pixel_blend_bytes_ref(dst, a, b, alpha, len);
+}
+
+#if CONFIG_IDF_TARGET_ESP32S3
+// SIMD kernels, see pixel_ops_esp32s3.S. All pointers must be 16 byte aligned,
+// blocks are 16 bytes of output each.
+void pixel_fill_esp32s3(uint8_t *dst, const uint8_t *pattern, size_t blocks);
+void pixel_invert_esp32s3(uint8_t *dst, size_t blocks);
+void pixel_pack_esp32s3(uint8_t *dst, const uint8_t *src, size_t blocks, const uint8_t *masks);
+void pixel_copy_esp32s3(uint8_t *dst, const uint8_t *src, size_t blocks);
+
+#define SIMD_BLOCK_SIZE		16
+#define SIMD_ALIGNED(ptr_)	(!((uintptr_t)(ptr_) % SIMD_BLOCK_SIZE))
+// Below this size setting up SIMD does not pay off
+#define SIMD_MIN_LEN		(2 * SIMD_BLOCK_SIZE)
+
+// Cleared if the SIMD kernels do not match the reference implementations
+static bool simd_enabled = true;
+
+static const uint8_t __attribute__((aligned(16))) pack_masks[2 * SIMD_BLOCK_SIZE] = {
+	0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0, 0xf0,
+	0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+};
+
+// Bytes to process before destination is aligned
+static inline size_t simd_head_len(const uint8_t *dst) {
+	return (SIMD_BLOCK_SIZE - (uintptr_t)dst % SIMD_BLOCK_SIZE) % SIMD_BLOCK_SIZE;
+}
+
+void pixel_fill_bytes(uint8_t *dst, uint8_t value, size_t len) {
+	uint8_t __attribute__((aligned(16))) pattern[SIMD_BLOCK_SIZE];
+	size_t head, blocks;
+
+	if (!simd_enabled || len < SIMD_MIN_LEN) {
+		pixel_fill_bytes_ref(dst, value, len);
+		return;
+	}
+
+	head = simd_head_len(dst);
+	pixel_fill_bytes_ref(dst, value, head);
+	dst += head;
+	len -= head;
+
+	memset(pattern, value, sizeof(pattern));
+	blocks = len / SIMD_BLOCK_SIZE;
+	pixel_fill_esp32s3(dst, pattern, blocks);
+	dst += blocks * SIMD_BLOCK_SIZE;
+	len -= blocks * SIMD_BLOCK_SIZE;
+
+	pixel_fill_bytes_ref(dst, value, len);
+}
+
+void pixel_invert_bytes(uint8_t *dst, size_t len) {
+	size_t head, blocks;
+
+	if (!simd_enabled || len < SIMD_MIN_LEN) {
+		pixel_invert_bytes_ref(dst, len);
+		return;
+	}
+
+	head = simd_head_len(dst);
+	pixel_invert_bytes_ref(dst, head);
+	dst += head;
+	len -= head;
+
+	blocks = len / SIMD_BLOCK_SIZE;
+	pixel_invert_esp32s3(dst, blocks);
+	dst += blocks * SIMD_BLOCK_SIZE;
+	len -= blocks * SIMD_BLOCK_SIZE;
+
+	pixel_invert_bytes_ref(dst, len);
+}
+
+void pixel_pack_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+	size_t head, blocks;
+
+	if (!simd_enabled || len < SIMD_MIN_LEN) {
+		pixel_pack_bytes_ref(dst, src, len);
+		return;
+	}
+
+	head = simd_head_len(dst);
+	pixel_pack_bytes_ref(dst, src, head);
+	dst += head;
+	src += 2 * head;
+	len -= head;
+
+	// Source advances twice as fast, it can only be used if it happens to be aligned too
+	if (SIMD_ALIGNED(src)) {
+		blocks = len / SIMD_BLOCK_SIZE;
+		pixel_pack_esp32s3(dst, src, blocks, pack_masks);
+		dst += blocks * SIMD_BLOCK_SIZE;
+		src += 2 * blocks * SIMD_BLOCK_SIZE;
+		len -= blocks * SIMD_BLOCK_SIZE;
+	}
+
+	pixel_pack_bytes_ref(dst, src, len);
+}
+
+void pixel_copy_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+	size_t head, blocks;
+
+	// Use SIMD only if source and destination can be aligned at the same time
+	if (!simd_enabled || len < SIMD_MIN_LEN || (uintptr_t)dst % SIMD_BLOCK_SIZE != (uintptr_t)src % SIMD_BLOCK_SIZE) {
+		pixel_copy_bytes_ref(dst, src, len);
+		return;
+	}
+
+	head = simd_head_len(dst);
+	pixel_copy_bytes_ref(dst, src, head);
+	dst += head;
+	src += head;
+	len -= head;
+
+	blocks = len / SIMD_BLOCK_SIZE;
+	pixel_copy_esp32s3(dst, src, blocks);
+	dst += blocks * SIMD_BLOCK_SIZE;
+	src += blocks * SIMD_BLOCK_SIZE;
+	len -= blocks * SIMD_BLOCK_SIZE;
+
+	pixel_copy_bytes_ref(dst, src, len);
+}
+
+void pixel_ops_disable_simd(void) {
+	simd_enabled = false;
+}
+#else
+void pixel_fill_bytes(uint8_t *dst, uint8_t value, size_t len) {
+	pixel_fill_bytes_ref(dst, value, len);
+}
+
+void pixel_invert_bytes(uint8_t *dst, size_t len) {
+	pixel_invert_bytes_ref(dst, len);
+}
+
+void pixel_pack_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+	pixel_pack_bytes_ref(dst, src, len);
+}
+
+void pixel_copy_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+	pixel_copy_bytes_ref(dst, src, len);
+}
+
+void pixel_ops_disable_simd(void) {
+}
+#endif
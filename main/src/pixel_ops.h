@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Kernels for 4 bit grayscale images as used by the display.
+ * Two pixels are packed into each byte, the first pixel is stored in the
+ * upper nibble. All positions and widths are given in pixels.
+ *
+ * Bulk byte operations use the ESP32-S3 SIMD unit where available, the
+ * _ref variants are the portable reference implementations.
+ */
+
+// Convert 8 bit grayscale value to 4 bit
+#define PIXEL_TO_4BPP(px_) ((px_) >> 4)
+
+// Blend weights are fixed point, PIXEL_BLEND_MAX selects the second source only
+#define PIXEL_BLEND_MAX	16
+
+// Row kernels
+void pixel_fill_4bpp(uint8_t *row, unsigned int x, unsigned int width, uint8_t value);
+void pixel_invert_4bpp(uint8_t *row, unsigned int x, unsigned int width);
+void pixel_pack_8bpp(uint8_t *row, unsigned int x, const uint8_t *src, unsigned int width);
+void pixel_copy_4bpp(uint8_t *row, unsigned int x, const uint8_t *src_row, unsigned int src_x, unsigned int width);
+void pixel_rgb888_to_gray(uint8_t *dst, const uint8_t *rgb, unsigned int width);
+
+// Rectangle kernels, strides in bytes
+void pixel_fill_4bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, unsigned int width, unsigned int height, uint8_t value);
+void pixel_invert_4bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, unsigned int width, unsigned int height);
+void pixel_pack_8bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, const uint8_t *src, unsigned int src_stride, unsigned int width, unsigned int height);
+void pixel_copy_4bpp_2d(uint8_t *dst, unsigned int stride, unsigned int x, const uint8_t *src, unsigned int src_stride, unsigned int src_x, unsigned int width, unsigned int height);
+
+// Bulk byte operations
+void pixel_fill_bytes(uint8_t *dst, uint8_t value, size_t len);
+void pixel_invert_bytes(uint8_t *dst, size_t len);
+void pixel_pack_bytes(uint8_t *dst, const uint8_t *src, size_t len);
+void pixel_copy_bytes(uint8_t *dst, const uint8_t *src, size_t len);
+// dst = a * (PIXEL_BLEND_MAX - alpha) + b * alpha, per pixel
+void pixel_blend_bytes(uint8_t *dst, const uint8_t *a, const uint8_t *b, unsigned int alpha, size_t len);
+
+void pixel_fill_bytes_ref(uint8_t *dst, uint8_t value, size_t len);
+void pixel_invert_bytes_ref(uint8_t *dst, size_t len);
+void pixel_pack_bytes_ref(uint8_t *dst, const uint8_t *src, size_t len);
+void pixel_copy_bytes_ref(uint8_t *dst, const uint8_t *src, size_t len);
+void pixel_blend_bytes_ref(uint8_t *dst, const uint8_t *a, const uint8_t *b, unsigned int alpha, size_t len);
+
+// Use reference implementations for all bulk byte operations
+void pixel_ops_disable_simd(void);
+// Compare bulk byte operations against reference implementations at random lengths and
+// alignments, SIMD is disabled on mismatch. Returns 0 or -EIO if SIMD had to be disabled
+int pixel_ops_selftest(void);
+// Log cycles per kernel for a frame buffer sized run
+void pixel_ops_benchmark(void);
+
+static inline void pixel_set_4bpp(uint8_t *row, unsigned int x, uint8_t value) {
+	uint8_t *byte = &row[x / 2];
+
+	if (x % 2) {
+		*byte = (*byte & 0xf0) | (value & 0x0f);
+	} else {
+		*byte = (*byte & 0x0f) | (value << 4);
+	}
+}
+
+static inline uint8_t pixel_get_4bpp(const uint8_t *row, unsigned int x) {
+	uint8_t byte = row[x / 2];
+
+	return x % 2 ? byte & 0x0f : byte >> 4;
+}
@@ -0,0 +1,203 @@
+#include "pixel_ops.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <esp_cpu.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_random.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <sdkconfig.h>
+
+#include "oled.h"
+
+#if CONFIG_PIXEL_OPS_SELFTEST
+
+#define SELFTEST_RUNS_PER_KERNEL	64
+// Long enough for unaligned head, several SIMD blocks and tail
+#define SELFTEST_MAX_LEN		512
+#define SELFTEST_ALIGN			16
+// Untouched bytes around the operated range, catch writes outside of it
+#define SELFTEST_GUARD			SELFTEST_ALIGN
+
+// One frame buffer per run
+#define BENCHMARK_LEN			(OLED_STRIDE * OLED_HEIGHT)
+#define BENCHMARK_RUNS			16
+
+typedef enum selftest_kernel {
+	SELFTEST_FILL,
+	SELFTEST_INVERT,
+	SELFTEST_PACK,
+	SELFTEST_COPY,
+	SELFTEST_BLEND,
+	SELFTEST_NUM_KERNELS
+} selftest_kernel_t;
+
+typedef struct selftest_buffers {
+	uint8_t *dst;
+	uint8_t *expected;
+	uint8_t *a;
+	uint8_t *b;
+	size_t dst_size;
+	size_t src_size;
+} selftest_buffers_t;
+
+static const char *TAG = "pixel_ops";
+
+static const char *kernel_names[SELFTEST_NUM_KERNELS] = { "fill", "invert", "pack", "copy", "blend" };
+
+static void selftest_run_kernel(selftest_kernel_t kernel, bool ref, uint8_t *dst, const uint8_t *a, const uint8_t *b,
+				unsigned int param, size_t len) {
+	switch (kernel) {
+	case SELFTEST_FILL:
+		(ref ? pixel_fill_bytes_ref : pixel_fill_bytes)(dst, param, len);
+		break;
+	case SELFTEST_INVERT:
+		(ref ? pixel_invert_bytes_ref : pixel_invert_bytes)(dst, len);
+		break;
+	case SELFTEST_PACK:
+		(ref ? pixel_pack_bytes_ref : pixel_pack_bytes)(dst, a, len);
+		break;
+	case SELFTEST_COPY:
+		(ref ? pixel_copy_bytes_ref : pixel_copy_bytes)(dst, a, len);
+		break;
+	case SELFTEST_BLEND:
+		(ref ? pixel_blend_bytes_ref : pixel_blend_bytes)(dst, a, b, param, len);
+		break;
+	default:
+		break;
+	}
+}
+
+// Source is read twice as fast as destination is written by pack
+static unsigned int selftest_src_scale(selftest_kernel_t kernel) {
+	return kernel == SELFTEST_PACK ? 2 : 1;
+}
+
+static int selftest_alloc(selftest_buffers_t *bufs, size_t dst_size, size_t src_size) {
+	bufs->dst = heap_caps_aligned_alloc(SELFTEST_ALIGN, dst_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	bufs->expected = heap_caps_aligned_alloc(SELFTEST_ALIGN, dst_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	bufs->a = heap_caps_aligned_alloc(SELFTEST_ALIGN, src_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	bufs->b = heap_caps_aligned_alloc(SELFTEST_ALIGN, src_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	bufs->dst_size = dst_size;
+	bufs->src_size = src_size;
+	if (!bufs->dst || !bufs->expected || !bufs->a || !bufs->b) {
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void selftest_free(selftest_buffers_t *bufs) {
+	heap_caps_free(bufs->dst);
+	heap_caps_free(bufs->expected);
+	heap_caps_free(bufs->a);
+	heap_caps_free(bufs->b);
+}
+
+// Half of all runs use a source offset that lets the SIMD path run, the rest a random one
+static unsigned int selftest_src_offset(selftest_kernel_t kernel, unsigned int dst_offset) {
+	unsigned int head = (SELFTEST_ALIGN - dst_offset) % SELFTEST_ALIGN;
+
+	if (esp_random() % 2) {
+		return esp_random() % SELFTEST_ALIGN;
+	}
+	return (SELFTEST_ALIGN - selftest_src_scale(kernel) * head % SELFTEST_ALIGN) % SELFTEST_ALIGN;
+}
+
+static int selftest_kernel(selftest_kernel_t kernel, selftest_buffers_t *bufs) {
+	unsigned int i;
+
+	for (i = 0; i < SELFTEST_RUNS_PER_KERNEL; i++) {
+		size_t len = esp_random() % (SELFTEST_MAX_LEN + 1);
+		unsigned int dst_offset = esp_random() % SELFTEST_ALIGN;
+		unsigned int src_offset = selftest_src_offset(kernel, dst_offset);
+		unsigned int param = kernel == SELFTEST_BLEND ? esp_random() % (PIXEL_BLEND_MAX + 1) : esp_random() & 0xff;
+		const uint8_t *a = bufs->a + SELFTEST_GUARD + src_offset;
+		const uint8_t *b = bufs->b + SELFTEST_GUARD + src_offset;
+
+		esp_fill_random(bufs->dst, bufs->dst_size);
+		memcpy(bufs->expected, bufs->dst, bufs->dst_size);
+		esp_fill_random(bufs->a, bufs->src_size);
+		esp_fill_random(bufs->b, bufs->src_size);
+
+		selftest_run_kernel(kernel, true, bufs->expected + SELFTEST_GUARD + dst_offset, a, b, param, len);
+		selftest_run_kernel(kernel, false, bufs->dst + SELFTEST_GUARD + dst_offset, a, b, param, len);
+		if (memcmp(bufs->dst, bufs->expected, bufs->dst_size)) {
+			ESP_LOGE(TAG, "%s differs from reference, length %u, destination offset %u, source offset %u",
+				 kernel_names[kernel], (unsigned int)len, dst_offset, src_offset);
+			return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int pixel_ops_selftest(void) {
+	selftest_buffers_t bufs;
+	selftest_kernel_t kernel;
+	int err = 0;
+
+	if (selftest_alloc(&bufs, SELFTEST_MAX_LEN + 2 * SELFTEST_GUARD, 2 * SELFTEST_MAX_LEN + 2 * SELFTEST_GUARD)) {
+		ESP_LOGW(TAG, "Not enough memory for self test");
+		selftest_free(&bufs);
+		return -ENOMEM;
+	}
+
+	for (kernel = 0; kernel < SELFTEST_NUM_KERNELS && !err; kernel++) {
+		err = selftest_kernel(kernel, &bufs);
+	}
+	selftest_free(&bufs);
+
+	if (err) {
+		ESP_LOGE(TAG, "Falling back to reference implementations");
+		pixel_ops_disable_simd();
+		return err;
+	}
+	ESP_LOGI(TAG, "SIMD kernels match reference implementations");
+	return 0;
+}
+
+static uint32_t benchmark_kernel(selftest_kernel_t kernel, bool ref, selftest_buffers_t *bufs) {
+	uint32_t start, cycles;
+	unsigned int i;
+
+	// Cycle counters are per core, do not migrate while measuring
+	vTaskSuspendAll();
+	start = esp_cpu_get_cycle_count();
+	for (i = 0; i < BENCHMARK_RUNS; i++) {
+		selftest_run_kernel(kernel, ref, bufs->dst, bufs->a, bufs->b, PIXEL_BLEND_MAX / 2, BENCHMARK_LEN);
+	}
+	cycles = esp_cpu_get_cycle_count() - start;
+	xTaskResumeAll();
+
+	return cycles / BENCHMARK_RUNS;
+}
+
+void pixel_ops_benchmark(void) {
+	selftest_buffers_t bufs;
+	selftest_kernel_t kernel;
+
+	if (selftest_alloc(&bufs, BENCHMARK_LEN, 2 * BENCHMARK_LEN)) {
+		ESP_LOGW(TAG, "Not enough memory for benchmark");
+		selftest_free(&bufs);
+		return;
+	}
+
+	esp_fill_random(bufs.a, bufs.src_size);
+	esp_fill_random(bufs.b, bufs.src_size);
+	for (kernel = 0; kernel < SELFTEST_NUM_KERNELS; kernel++) {
+		uint32_t ref_cycles = benchmark_kernel(kernel, true, &bufs);
+		uint32_t cycles = benchmark_kernel(kernel, false, &bufs);
+
+		ESP_LOGI(TAG, "%s %u bytes: %"PRIu32" cycles, reference %"PRIu32" cycles", kernel_names[kernel],
+			 BENCHMARK_LEN, cycles, ref_cycles);
+	}
+	selftest_free(&bufs);
+}
+#endif
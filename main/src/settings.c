@@ -140,6 +140,23 @@ char *settings_get_default_animation(void) {
 	return nvs_get_string("DefAnimFile");
 }
 
+void settings_set_animation_transition(unsigned int transition) {
+	nvs_set_uint("AnimTrans", transition);
+}
+
+unsigned int settings_get_animation_transition(void) {
+	// Crossfade
+	return nvs_get_uint("AnimTrans", 1);
+}
+
+void settings_set_animation_transition_steps(unsigned int steps) {
+	nvs_set_uint("AnimTransSteps", steps);
+}
+
+unsigned int settings_get_animation_transition_steps(void) {
+	return nvs_get_uint("AnimTransSteps", 8);
+}
+
 void settings_set_default_app(const char *app) {
 	nvs_set_string("DefApp", app);
 }
@@ -7,6 +7,12 @@ void settings_init(void);
 void settings_set_default_animation(const char *str);
 char *settings_get_default_animation(void);
 
+void settings_set_animation_transition(unsigned int transition);
+unsigned int settings_get_animation_transition(void);
+
+void settings_set_animation_transition_steps(unsigned int steps);
+unsigned int settings_get_animation_transition_steps(void);
+
 void settings_set_default_app(const char *app);
 char *settings_get_default_app(void);
 
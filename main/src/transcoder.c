@@ -0,0 +1,645 @@
+#include "transcoder.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <gif.h>
+
+#include "animation_index.h"
+#include "animation_store.h"
+#include "futil.h"
+#include "gifdecode.h"
+#include "gifplayer.h"
+#include "list.h"
+#include "oan.h"
+#include "pixel_ops.h"
+#include "util.h"
+
+#define TRANSCODER_TASK_STACK_DEPTH	8192
+// Below playback, conversion only uses otherwise idle time
+#define TRANSCODER_TASK_PRIORITY	1
+#define TRANSCODER_TMP_SUFFIX		".oan"
+// Upper bound of GIF frames transcoded, protects against broken files
+#define TRANSCODER_MAX_FRAMES		2000
+// Finished conversions kept for status queries
+#define TRANSCODER_MAX_HISTORY		8
+// Source pixels sampled per output pixel along each axis, keeps sums within 16 bit
+#define TRANSCODER_MAX_TAPS		15
+
+#define TRANSCODER_FRAME_SIZE		(OAN_STRIDE(GIFPLAYER_WIDTH) * GIFPLAYER_HEIGHT)
+
+typedef struct transcoder_job {
+	list_head_t list;
+	char *path;
+	transcoder_options_t options;
+	transcoder_status_t status;
+	// File is about to change, result is discarded
+	bool cancel;
+} transcoder_job_t;
+
+typedef struct transcoder {
+	// Queued and running jobs, oldest first
+	list_head_t jobs;
+	// Finished jobs, most recent first
+	list_head_t history;
+	unsigned int history_len;
+	SemaphoreHandle_t lock;
+	StaticSemaphore_t lock_buffer;
+	// Held while source file is open
+	SemaphoreHandle_t job_lock;
+	StaticSemaphore_t job_lock_buffer;
+	TaskHandle_t task;
+} transcoder_t;
+
+typedef struct transcoder_axis {
+	// Range of output pixels sampling each source pixel, empty if source pixel is skipped
+	uint16_t *first;
+	uint16_t *num;
+	// Number of source pixels sampled per output pixel
+	uint8_t *taps;
+} transcoder_axis_t;
+
+typedef struct transcoder_scaler {
+	unsigned int src_width;
+	unsigned int src_height;
+	// Placement of scaled image on display
+	unsigned int dst_x;
+	unsigned int dst_y;
+	unsigned int dst_width;
+	unsigned int dst_height;
+	transcoder_axis_t cols;
+	transcoder_axis_t rows;
+	// Samples drawn in current frame, per output pixel
+	uint16_t *sum;
+	uint8_t *count;
+	// 8 bit gray output, pixels keep their value until covered by a new frame
+	uint8_t *gray;
+	uint8_t luma_lut[256];
+	const uint8_t *luma_lut_palette;
+} transcoder_scaler_t;
+
+static const char *TAG = "transcoder";
+
+// 4x4 Bayer matrix as thresholds between 0 and 255
+static const uint8_t dither_thresholds[16] = {
+	  7, 135,  39, 167,
+	199,  71, 231, 103,
+	 55, 183,  23, 151,
+	247, 119, 215,  87,
+};
+
+static transcoder_t transcoder;
+
+static int transcoder_axis_init(transcoder_axis_t *axis, unsigned int src_len, unsigned int crop_start, unsigned int crop_len,
+				unsigned int dst_len, transcoder_filter_t filter) {
+	axis->first = calloc(src_len, sizeof(*axis->first));
+	axis->num = calloc(src_len, sizeof(*axis->num));
+	axis->taps = calloc(dst_len, sizeof(*axis->taps));
+	if (!axis->first || !axis->num || !axis->taps) {
+		return -ENOMEM;
+	}
+
+	for (unsigned int dst = 0; dst < dst_len; dst++) {
+		unsigned int start, end, taps;
+
+		if (filter == TRANSCODER_FILTER_BOX) {
+			start = crop_start + dst * crop_len / dst_len;
+			// Upscaling, box covers part of a source pixel
+			end = MAX(crop_start + (dst + 1) * crop_len / dst_len, start + 1);
+		} else {
+			// Center of box
+			start = crop_start + (2 * dst + 1) * crop_len / (2 * dst_len);
+			end = start + 1;
+		}
+
+		// Wide boxes are subsampled evenly
+		taps = MIN(end - start, TRANSCODER_MAX_TAPS);
+		axis->taps[dst] = taps;
+		// Boxes are ordered, output pixels sampling the same source pixel are adjacent
+		for (unsigned int tap = 0; tap < taps; tap++) {
+			unsigned int src = start + tap * (end - start) / taps;
+
+			if (!axis->num[src]) {
+				axis->first[src] = dst;
+			}
+			axis->num[src]++;
+		}
+	}
+
+	return 0;
+}
+
+static void transcoder_axis_free(transcoder_axis_t *axis) {
+	free(axis->first);
+	free(axis->num);
+	free(axis->taps);
+}
+
+static int transcoder_scaler_init(transcoder_scaler_t *scaler, unsigned int src_width, unsigned int src_height,
+				  const transcoder_options_t *options) {
+	unsigned int crop_x = 0, crop_y = 0, crop_width = src_width, crop_height = src_height;
+	size_t num_pixels;
+	bool wider;
+	int err;
+
+	memset(scaler, 0, sizeof(*scaler));
+	if (!src_width || !src_height) {
+		return -EINVAL;
+	}
+
+	scaler->src_width = src_width;
+	scaler->src_height = src_height;
+	scaler->dst_width = GIFPLAYER_WIDTH;
+	scaler->dst_height = GIFPLAYER_HEIGHT;
+	wider = src_width * GIFPLAYER_HEIGHT >= src_height * GIFPLAYER_WIDTH;
+	if (options->scale == TRANSCODER_SCALE_FILL) {
+		if (wider) {
+			crop_width = MAX(src_height * GIFPLAYER_WIDTH / GIFPLAYER_HEIGHT, 1);
+			crop_x = (src_width - crop_width) / 2;
+		} else {
+			crop_height = MAX(src_width * GIFPLAYER_HEIGHT / GIFPLAYER_WIDTH, 1);
+			crop_y = (src_height - crop_height) / 2;
+		}
+	} else {
+		if (wider) {
+			scaler->dst_height = MAX(src_height * GIFPLAYER_WIDTH / src_width, 1);
+		} else {
+			scaler->dst_width = MAX(src_width * GIFPLAYER_HEIGHT / src_height, 1);
+		}
+	}
+	scaler->dst_x = (GIFPLAYER_WIDTH - scaler->dst_width) / 2;
+	scaler->dst_y = (GIFPLAYER_HEIGHT - scaler->dst_height) / 2;
+
+	err = transcoder_axis_init(&scaler->cols, src_width, crop_x, crop_width, scaler->dst_width, options->filter);
+	if (err) {
+		return err;
+	}
+	err = transcoder_axis_init(&scaler->rows, src_height, crop_y, crop_height, scaler->dst_height, options->filter);
+	if (err) {
+		return err;
+	}
+
+	num_pixels = scaler->dst_width * scaler->dst_height;
+	scaler->sum = heap_caps_malloc_prefer(num_pixels * sizeof(*scaler->sum), 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT);
+	scaler->count = heap_caps_malloc_prefer(num_pixels, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT);
+	scaler->gray = heap_caps_malloc_prefer(num_pixels, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_8BIT);
+	if (!scaler->sum || !scaler->count || !scaler->gray) {
+		return -ENOMEM;
+	}
+	memset(scaler->sum, 0, num_pixels * sizeof(*scaler->sum));
+	memset(scaler->count, 0, num_pixels);
+	memset(scaler->gray, 0, num_pixels);
+
+	ESP_LOGI(TAG, "Scaling %ux%u, cropped to %ux%u at %u/%u, to %ux%u", src_width, src_height,
+		 crop_width, crop_height, crop_x, crop_y, scaler->dst_width, scaler->dst_height);
+	return 0;
+}
+
+static void transcoder_scaler_free(transcoder_scaler_t *scaler) {
+	transcoder_axis_free(&scaler->cols);
+	transcoder_axis_free(&scaler->rows);
+	heap_caps_free(scaler->sum);
+	heap_caps_free(scaler->count);
+	heap_caps_free(scaler->gray);
+}
+
+// GIF draw callback, accumulates source line into every output pixel sampling it
+static void transcoder_draw_line(GIFDRAW *draw) {
+	transcoder_scaler_t *scaler = draw->pUser;
+	unsigned int src_y = draw->iY + draw->y;
+	bool skip_transparent = draw->ucHasTransparency && draw->ucDisposalMethod != 2;
+	unsigned int num_rows, row_offset;
+
+	if (src_y >= scaler->src_height) {
+		return;
+	}
+	num_rows = scaler->rows.num[src_y];
+	if (!num_rows) {
+		return;
+	}
+
+	// Palette, transparency and disposal only change between frames
+	if (!draw->y || draw->pPalette24 != scaler->luma_lut_palette) {
+		gifdecode_build_luma_lut(scaler->luma_lut, draw->pPalette24);
+		// Transparent pixels are replaced by background
+		if (draw->ucDisposalMethod == 2) {
+			scaler->luma_lut[draw->ucTransparent] = scaler->luma_lut[draw->ucBackground];
+		}
+		scaler->luma_lut_palette = draw->pPalette24;
+	}
+
+	row_offset = scaler->rows.first[src_y] * scaler->dst_width;
+	for (int i = 0; i < draw->iWidth; i++) {
+		unsigned int src_x = draw->iX + i;
+		uint8_t px = draw->pPixels[i];
+		unsigned int num_cols;
+		uint8_t luma;
+
+		if (src_x >= scaler->src_width) {
+			break;
+		}
+		num_cols = scaler->cols.num[src_x];
+		if (!num_cols || (skip_transparent && px == draw->ucTransparent)) {
+			continue;
+		}
+
+		luma = scaler->luma_lut[px];
+		for (unsigned int row = 0; row < num_rows; row++) {
+			unsigned int offset = row_offset + row * scaler->dst_width + scaler->cols.first[src_x];
+
+			for (unsigned int col = 0; col < num_cols; col++) {
+				scaler->sum[offset + col] += luma;
+				scaler->count[offset + col]++;
+			}
+		}
+	}
+}
+
+// Resolve samples of current frame, samples not drawn keep the value of the previous frame
+static void transcoder_scaler_finish_frame(transcoder_scaler_t *scaler) {
+	size_t num_pixels = scaler->dst_width * scaler->dst_height;
+
+	for (unsigned int y = 0; y < scaler->dst_height; y++) {
+		for (unsigned int x = 0; x < scaler->dst_width; x++) {
+			unsigned int i = y * scaler->dst_width + x;
+			unsigned int taps, count = scaler->count[i];
+
+			if (!count) {
+				continue;
+			}
+			taps = scaler->cols.taps[x] * scaler->rows.taps[y];
+			scaler->gray[i] = (scaler->sum[i] + scaler->gray[i] * (taps - count) + taps / 2) / taps;
+		}
+	}
+
+	memset(scaler->sum, 0, num_pixels * sizeof(*scaler->sum));
+	memset(scaler->count, 0, num_pixels);
+}
+
+// Reduce to 16 gray levels, positions outside of scaled image are left untouched
+static void transcoder_quantize(const transcoder_scaler_t *scaler, uint8_t *pixels, bool dither) {
+	unsigned int stride = OAN_STRIDE(GIFPLAYER_WIDTH);
+
+	for (unsigned int y = 0; y < scaler->dst_height; y++) {
+		unsigned int out_y = scaler->dst_y + y;
+		const uint8_t *gray = &scaler->gray[y * scaler->dst_width];
+		uint8_t *row = &pixels[out_y * stride];
+
+		for (unsigned int x = 0; x < scaler->dst_width; x++) {
+			unsigned int out_x = scaler->dst_x + x;
+			// Thresholds are fixed per display position, static areas stay static
+			unsigned int threshold = dither ? dither_thresholds[(out_y % 4) * 4 + out_x % 4] : 127;
+
+			pixel_set_4bpp(row, out_x, (gray[x] * 15 + threshold) / 255);
+		}
+	}
+}
+
+static int transcoder_update_progress(transcoder_job_t *job, bool dropped) {
+	int err = 0;
+
+	xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+	job->status.frames_done++;
+	if (dropped) {
+		job->status.frames_dropped++;
+	}
+	if (job->cancel) {
+		err = -ECANCELED;
+	}
+	xSemaphoreGive(transcoder.lock);
+	return err;
+}
+
+static int transcoder_convert(transcoder_job_t *job, const char *oan_path) {
+	transcoder_scaler_t scaler = { 0 };
+	oan_encoder_t enc;
+	uint8_t *pixels;
+	GIFIMAGE *gif;
+	FILE *file;
+	int err, ret;
+
+	gif = malloc(sizeof(*gif));
+	// Letterbox bars stay black
+	pixels = calloc(1, TRANSCODER_FRAME_SIZE);
+	if (!gif || !pixels) {
+		err = -ENOMEM;
+		goto out_alloc;
+	}
+
+	GIF_begin(gif, GIF_PALETTE_RGB888);
+	if (!GIF_openFile(gif, job->path, transcoder_draw_line)) {
+		err = gif->iError ? -abs(gif->iError) : -EINVAL;
+		goto out_alloc;
+	}
+
+	err = transcoder_scaler_init(&scaler, GIF_getCanvasWidth(gif), GIF_getCanvasHeight(gif), &job->options);
+	if (err) {
+		goto out_scaler;
+	}
+
+	file = fopen(oan_path, "w");
+	if (!file) {
+		err = -errno;
+		goto out_scaler;
+	}
+
+	err = oan_encoder_init(&enc, file, GIFPLAYER_WIDTH, GIFPLAYER_HEIGHT);
+	if (err) {
+		goto out_file;
+	}
+
+	do {
+		int duration_ms = 0;
+		bool duplicate;
+
+		ret = GIF_playFrame(gif, &duration_ms, &scaler);
+		if (ret < 0) {
+			ESP_LOGE(TAG, "Failed to decode GIF frame %u: %d", job->status.frames_done, gif->iError);
+			err = -EINVAL;
+			goto out_encoder;
+		}
+		transcoder_scaler_finish_frame(&scaler);
+		transcoder_quantize(&scaler, pixels, job->options.dither);
+
+		// Frame does not change anything after quantization, show previous one for longer
+		duplicate = enc.header.num_frames && !memcmp(pixels, enc.prev, TRANSCODER_FRAME_SIZE);
+		if (duplicate) {
+			err = oan_encoder_extend_last_frame(&enc, duration_ms);
+		} else {
+			err = oan_encoder_add_frame(&enc, pixels, duration_ms);
+		}
+		if (err) {
+			goto out_encoder;
+		}
+
+		err = transcoder_update_progress(job, duplicate);
+		if (err) {
+			goto out_encoder;
+		}
+	} while (ret > 0 && job->status.frames_done < TRANSCODER_MAX_FRAMES);
+
+	// Truncated animation must not replace the GIF
+	if (ret > 0) {
+		ESP_LOGE(TAG, "GIF has more than %u frames", TRANSCODER_MAX_FRAMES);
+		err = -EFBIG;
+		goto out_encoder;
+	}
+
+	err = oan_encoder_finish(&enc);
+	if (!err) {
+		ESP_LOGI(TAG, "Transcoded %u frames into %u, %u bytes", job->status.frames_done, enc.header.num_frames,
+			 (unsigned int)(enc.offset + enc.header.num_frames * sizeof(oan_frame_index_t)));
+	}
+
+out_encoder:
+	oan_encoder_free(&enc);
+out_file:
+	if (fclose(file) && !err) {
+		err = -EIO;
+	}
+out_scaler:
+	transcoder_scaler_free(&scaler);
+	GIF_close(gif);
+out_alloc:
+	free(pixels);
+	free(gif);
+	return err;
+}
+
+static char *transcoder_tmp_path(const char *path) {
+	const char *name = futil_fname(path);
+	char *tmp_path = malloc(strlen(TRANSCODER_DIR) + 1 + strlen(name) + strlen(TRANSCODER_TMP_SUFFIX) + 1);
+
+	if (tmp_path) {
+		sprintf(tmp_path, TRANSCODER_DIR "/%s" TRANSCODER_TMP_SUFFIX, name);
+	}
+	return tmp_path;
+}
+
+// Move finished job to history, drops oldest entries
+static void transcoder_retire_job_(transcoder_job_t *job) {
+	LIST_DELETE(&job->list);
+	LIST_APPEND(&job->list, &transcoder.history);
+	transcoder.history_len++;
+
+	while (transcoder.history_len > TRANSCODER_MAX_HISTORY) {
+		transcoder_job_t *oldest = LIST_GET_ENTRY(transcoder.history.prev, transcoder_job_t, list);
+
+		LIST_DELETE(&oldest->list);
+		free(oldest->path);
+		free(oldest);
+		transcoder.history_len--;
+	}
+}
+
+// Index and store published result, without holding player lock
+static void transcoder_sync_animation(transcoder_job_t *job) {
+	int err;
+
+	err = animation_index_build(job->path);
+	if (err) {
+		ESP_LOGW(TAG, "Failed to index '%s': %d", job->path, err);
+	}
+	err = animation_store_add(job->path);
+	if (err && err != -ENODEV) {
+		ESP_LOGW(TAG, "Failed to add '%s' to animation store: %d", job->path, err);
+	}
+}
+
+static void transcoder_run_job(transcoder_job_t *job) {
+	char *tmp_path = transcoder_tmp_path(job->path);
+	animation_info_t info;
+	bool cancel, has_info;
+	int err;
+
+	if (!tmp_path) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	// Frame count of GIF for progress, merged frames are included
+	has_info = !animation_index_get_info(job->path, &info);
+
+	xSemaphoreTake(transcoder.job_lock, portMAX_DELAY);
+	xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+	cancel = job->cancel;
+	if (has_info) {
+		job->status.frames_total = info.num_frames;
+	}
+	xSemaphoreGive(transcoder.lock);
+	ESP_LOGI(TAG, "Transcoding '%s'", job->path);
+	err = cancel ? -ECANCELED : transcoder_convert(job, tmp_path);
+	xSemaphoreGive(transcoder.job_lock);
+
+	if (!err) {
+		gifplayer_lock();
+		xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+		cancel = job->cancel;
+		xSemaphoreGive(transcoder.lock);
+		err = cancel ? -ECANCELED : gifplayer_replace_animation_(job->path, tmp_path);
+		gifplayer_unlock();
+		if (!err) {
+			transcoder_sync_animation(job);
+		}
+	}
+	if (err) {
+		unlink(tmp_path);
+	}
+	free(tmp_path);
+
+out:
+	if (err && err != -ECANCELED) {
+		ESP_LOGE(TAG, "Failed to transcode '%s': %d", job->path, err);
+	}
+	xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+	if (err == -ECANCELED) {
+		job->status.state = TRANSCODER_STATE_CANCELLED;
+	} else {
+		job->status.state = err ? TRANSCODER_STATE_FAILED : TRANSCODER_STATE_DONE;
+	}
+	job->status.error = err;
+	transcoder_retire_job_(job);
+	xSemaphoreGive(transcoder.lock);
+}
+
+static void transcoder_task(void *arg) {
+	while (1) {
+		transcoder_job_t *job = NULL, *cursor;
+
+		xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+		LIST_FOR_EACH_ENTRY(cursor, &transcoder.jobs, list) {
+			if (cursor->status.state == TRANSCODER_STATE_QUEUED) {
+				job = cursor;
+				job->status.state = TRANSCODER_STATE_RUNNING;
+				break;
+			}
+		}
+		xSemaphoreGive(transcoder.lock);
+
+		if (job) {
+			transcoder_run_job(job);
+		} else {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		}
+	}
+}
+
+void transcoder_init(void) {
+	if (futil_dir_exists(TRANSCODER_DIR)) {
+		remove(TRANSCODER_DIR);
+		if (mkdir(TRANSCODER_DIR, 0)) {
+			ESP_LOGE(TAG, "Failed to create transcoder directory: %d", errno);
+		}
+	}
+
+	INIT_LIST_HEAD(transcoder.jobs);
+	INIT_LIST_HEAD(transcoder.history);
+	transcoder.history_len = 0;
+	transcoder.lock = xSemaphoreCreateMutexStatic(&transcoder.lock_buffer);
+	transcoder.job_lock = xSemaphoreCreateMutexStatic(&transcoder.job_lock_buffer);
+	ESP_ERROR_CHECK(xTaskCreate(transcoder_task, "transcoder", TRANSCODER_TASK_STACK_DEPTH, NULL,
+				    TRANSCODER_TASK_PRIORITY, &transcoder.task) != pdPASS);
+}
+
+int transcoder_enqueue(const char *path, const transcoder_options_t *options) {
+	transcoder_job_t *job = calloc(1, sizeof(*job));
+
+	if (!job) {
+		return -ENOMEM;
+	}
+	job->path = strdup(path);
+	if (!job->path) {
+		free(job);
+		return -ENOMEM;
+	}
+	job->options = *options;
+	job->status.state = TRANSCODER_STATE_QUEUED;
+
+	xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+	LIST_APPEND_TAIL(&job->list, &transcoder.jobs);
+	xSemaphoreGive(transcoder.lock);
+	xTaskNotifyGive(transcoder.task);
+	return 0;
+}
+
+void transcoder_cancel(const char *path) {
+	transcoder_job_t *job;
+	list_head_t *next;
+	bool running = false;
+
+	xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+	LIST_FOR_EACH_ENTRY_SAFE(job, next, &transcoder.jobs, list) {
+		if (strcmp(job->path, path)) {
+			continue;
+		}
+		if (job->status.state == TRANSCODER_STATE_RUNNING) {
+			job->cancel = true;
+			running = true;
+		} else {
+			job->status.state = TRANSCODER_STATE_CANCELLED;
+			job->status.error = -ECANCELED;
+			transcoder_retire_job_(job);
+		}
+	}
+	xSemaphoreGive(transcoder.lock);
+
+	if (running) {
+		// Conversion stops after current frame, wait for source file to be closed
+		xSemaphoreTake(transcoder.job_lock, portMAX_DELAY);
+		xSemaphoreGive(transcoder.job_lock);
+	}
+}
+
+int transcoder_get_status(const char *path, transcoder_status_t *status) {
+	transcoder_job_t *job, *found = NULL;
+
+	xSemaphoreTake(transcoder.lock, portMAX_DELAY);
+	// Most recently queued job first
+	LIST_FOR_EACH_ENTRY(job, &transcoder.jobs, list) {
+		if (!strcmp(job->path, path)) {
+			found = job;
+		}
+	}
+	if (!found) {
+		LIST_FOR_EACH_ENTRY(job, &transcoder.history, list) {
+			if (!strcmp(job->path, path)) {
+				found = job;
+				break;
+			}
+		}
+	}
+	if (found) {
+		*status = found->status;
+	}
+	xSemaphoreGive(transcoder.lock);
+
+	return found ? 0 : -ENOENT;
+}
+
+const char *transcoder_state_to_str(transcoder_state_t state) {
+	switch (state) {
+	case TRANSCODER_STATE_QUEUED:
+		return "queued";
+	case TRANSCODER_STATE_RUNNING:
+		return "running";
+	case TRANSCODER_STATE_DONE:
+		return "done";
+	case TRANSCODER_STATE_FAILED:
+		return "failed";
+	case TRANSCODER_STATE_CANCELLED:
+		return "cancelled";
+	}
+
+	return "unknown";
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * Background conversion of uploaded GIFs into native animations
+ *
+ * Frames are scaled to the display size through precomputed index maps,
+ * reduced to 16 gray levels and merged into their predecessor if they do
+ * not change any pixel. Once done the native animation replaces the GIF
+ * in place and playback switches over to it.
+ */
+
+#define TRANSCODER_DIR		"/flash/transcoder"
+
+typedef enum transcoder_filter {
+	// Single source pixel per output pixel
+	TRANSCODER_FILTER_NEAREST,
+	// Average of source pixels covered by output pixel
+	TRANSCODER_FILTER_BOX,
+} transcoder_filter_t;
+
+typedef enum transcoder_scale {
+	// Whole image is visible, letterboxed
+	TRANSCODER_SCALE_FIT,
+	// Display is covered, image is cropped around its center
+	TRANSCODER_SCALE_FILL,
+} transcoder_scale_t;
+
+typedef struct transcoder_options {
+	transcoder_filter_t filter;
+	transcoder_scale_t scale;
+	// Ordered dithering, unlike error diffusion it does not flicker in static areas
+	bool dither;
+} transcoder_options_t;
+
+typedef enum transcoder_state {
+	TRANSCODER_STATE_QUEUED,
+	TRANSCODER_STATE_RUNNING,
+	TRANSCODER_STATE_DONE,
+	TRANSCODER_STATE_FAILED,
+	TRANSCODER_STATE_CANCELLED,
+} transcoder_state_t;
+
+typedef struct transcoder_status {
+	transcoder_state_t state;
+	unsigned int frames_done;
+	// 0 if not known upfront
+	unsigned int frames_total;
+	// Frames merged into previous one
+	unsigned int frames_dropped;
+	int error;
+} transcoder_status_t;
+
+// Init only
+void transcoder_init(void);
+
+/* Threadsafe */
+int transcoder_enqueue(const char *path, const transcoder_options_t *options);
+// Returns once no conversion of path is running anymore, call before modifying or deleting the file
+void transcoder_cancel(const char *path);
+// Returns -ENOENT if path has not been queued recently
+int transcoder_get_status(const char *path, transcoder_status_t *status);
+const char *transcoder_state_to_str(transcoder_state_t state);
@@ -0,0 +1,327 @@
+#include "upload.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <esp_rom_crc.h>
+
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <sdkconfig.h>
+
+#include "futil.h"
+#include "util.h"
+
+#define UPLOAD_WRITER_TASK_STACK_DEPTH	4096
+// Above httpd, writing starts as soon as a buffer has been filled
+#define UPLOAD_WRITER_TASK_PRIORITY	6
+// Consecutive socket timeouts tolerated before giving up on a client
+#define UPLOAD_MAX_RECV_TIMEOUTS	3
+
+_Static_assert(UPLOAD_BUFFER_SIZE % CONFIG_WL_SECTOR_SIZE == 0, "Upload buffers must hold whole FAT sectors");
+
+typedef struct upload_buffer {
+	uint8_t *data;
+	size_t len;
+} upload_buffer_t;
+
+static const char *TAG = "upload";
+
+static struct {
+	// Held for the duration of a transfer
+	SemaphoreHandle_t lock;
+	StaticSemaphore_t lock_buffer;
+	upload_buffer_t buffers[UPLOAD_NUM_BUFFERS];
+	QueueHandle_t free_buffers;
+	StaticQueue_t free_buffers_buffer;
+	uint8_t free_buffers_storage[UPLOAD_NUM_BUFFERS];
+	QueueHandle_t full_buffers;
+	StaticQueue_t full_buffers_buffer;
+	uint8_t full_buffers_storage[UPLOAD_NUM_BUFFERS];
+	TaskHandle_t writer_task;
+	// State of current transfer, error is the first write error
+	int fd;
+	int error;
+	int64_t write_us;
+} upload;
+
+static void upload_writer_task(void *arg) {
+	upload_buffer_t *buffer;
+	uint8_t idx;
+
+	while (1) {
+		xQueueReceive(upload.full_buffers, &idx, portMAX_DELAY);
+		buffer = &upload.buffers[idx];
+		// Data following a failed write is discarded
+		if (!upload.error) {
+			int64_t start_us = esp_timer_get_time();
+			ssize_t res = write(upload.fd, buffer->data, buffer->len);
+
+			if (res < 0) {
+				upload.error = -errno;
+			} else if (res != buffer->len) {
+				upload.error = -ENOSPC;
+			}
+			upload.write_us += esp_timer_get_time() - start_us;
+		}
+		xQueueSend(upload.free_buffers, &idx, portMAX_DELAY);
+	}
+}
+
+// Staged uploads are not resumed across reboots, do not let them fill up flash
+static void upload_clean_staging_dir(void) {
+	struct dirent *cursor;
+	DIR *dir;
+
+	if (futil_dir_exists(UPLOAD_STAGING_DIR)) {
+		remove(UPLOAD_STAGING_DIR);
+		if (mkdir(UPLOAD_STAGING_DIR, 0)) {
+			ESP_LOGE(TAG, "Failed to create staging directory: %d", errno);
+		}
+		return;
+	}
+
+	dir = opendir(UPLOAD_STAGING_DIR);
+	if (!dir) {
+		return;
+	}
+	while ((cursor = readdir(dir))) {
+		char *path = futil_path_concat(cursor->d_name, UPLOAD_STAGING_DIR);
+
+		if (path) {
+			ESP_LOGI(TAG, "Removing stale upload %s", cursor->d_name);
+			unlink(path);
+			free(path);
+		}
+	}
+	closedir(dir);
+}
+
+void upload_init(void) {
+	upload_clean_staging_dir();
+	upload.lock = xSemaphoreCreateMutexStatic(&upload.lock_buffer);
+	upload.free_buffers = xQueueCreateStatic(UPLOAD_NUM_BUFFERS, sizeof(uint8_t), upload.free_buffers_storage, &upload.free_buffers_buffer);
+	upload.full_buffers = xQueueCreateStatic(UPLOAD_NUM_BUFFERS, sizeof(uint8_t), upload.full_buffers_storage, &upload.full_buffers_buffer);
+	ESP_ERROR_CHECK(xTaskCreate(upload_writer_task, "upload_writer", UPLOAD_WRITER_TASK_STACK_DEPTH, NULL,
+				    UPLOAD_WRITER_TASK_PRIORITY, &upload.writer_task) != pdPASS);
+}
+
+// Receive exactly len bytes
+static int upload_recv(httpd_req_t *req, uint8_t *data, size_t len, int64_t *recv_us) {
+	unsigned int timeouts = 0;
+
+	while (len) {
+		int64_t start_us = esp_timer_get_time();
+		int ret = httpd_req_recv(req, (char *)data, len);
+
+		*recv_us += esp_timer_get_time() - start_us;
+		if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < UPLOAD_MAX_RECV_TIMEOUTS) {
+			continue;
+		}
+		if (ret <= 0) {
+			ESP_LOGE(TAG, "Failed to receive from socket: %d", ret);
+			return -ECONNABORTED;
+		}
+		timeouts = 0;
+		data += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+// Fill buffer completely unless body ends, partial buffers would misalign all following writes
+static int upload_fill_buffer(httpd_req_t *req, upload_buffer_t *buffer, size_t *remaining, int64_t *recv_us) {
+	int err;
+
+	buffer->len = MIN(UPLOAD_BUFFER_SIZE, *remaining);
+	err = upload_recv(req, buffer->data, buffer->len, recv_us);
+	if (err) {
+		return err;
+	}
+	*remaining -= buffer->len;
+	return 0;
+}
+
+int upload_receive_to_fd(httpd_req_t *req, int fd, upload_stats_t *stats) {
+	size_t remaining = req->content_len;
+	int64_t start_us = esp_timer_get_time();
+	int64_t recv_us = 0;
+	uint8_t *data;
+	uint8_t idx;
+	int err = 0;
+
+	// Internal memory, flash writes from external memory go through a bounce buffer
+	data = heap_caps_malloc(UPLOAD_NUM_BUFFERS * UPLOAD_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	if (!data) {
+		return -ENOMEM;
+	}
+
+	xSemaphoreTake(upload.lock, portMAX_DELAY);
+	upload.fd = fd;
+	upload.error = 0;
+	upload.write_us = 0;
+	for (idx = 0; idx < UPLOAD_NUM_BUFFERS; idx++) {
+		upload.buffers[idx].data = data + idx * UPLOAD_BUFFER_SIZE;
+		xQueueSend(upload.free_buffers, &idx, portMAX_DELAY);
+	}
+
+	while (remaining && !err) {
+		upload_buffer_t *buffer;
+
+		xQueueReceive(upload.free_buffers, &idx, portMAX_DELAY);
+		buffer = &upload.buffers[idx];
+		err = upload_fill_buffer(req, buffer, &remaining, &recv_us);
+		if (err) {
+			xQueueSend(upload.free_buffers, &idx, portMAX_DELAY);
+			break;
+		}
+		xQueueSend(upload.full_buffers, &idx, portMAX_DELAY);
+		err = upload.error;
+	}
+
+	// Writer is done once it has returned all buffers
+	for (unsigned int i = 0; i < UPLOAD_NUM_BUFFERS; i++) {
+		xQueueReceive(upload.free_buffers, &idx, portMAX_DELAY);
+	}
+	if (!err) {
+		err = upload.error;
+	}
+
+	stats->bytes = req->content_len - remaining;
+	stats->duration_us = esp_timer_get_time() - start_us;
+	stats->recv_us = recv_us;
+	stats->write_us = upload.write_us;
+	xSemaphoreGive(upload.lock);
+	heap_caps_free(data);
+
+	if (err) {
+		return err;
+	}
+	ESP_LOGI(TAG, "Received %u bytes in %u ms, %u KiB/s", (unsigned int)stats->bytes,
+		 (unsigned int)(stats->duration_us / 1000), upload_stats_get_throughput(stats));
+	return stats->bytes;
+}
+
+int upload_receive_to_memory(httpd_req_t *req, uint8_t *data, upload_stats_t *stats) {
+	int64_t start_us = esp_timer_get_time();
+	int err;
+
+	stats->recv_us = 0;
+	stats->write_us = 0;
+	err = upload_recv(req, data, req->content_len, &stats->recv_us);
+	stats->duration_us = esp_timer_get_time() - start_us;
+	if (err) {
+		stats->bytes = 0;
+		return err;
+	}
+	stats->bytes = req->content_len;
+	return stats->bytes;
+}
+
+unsigned int upload_stats_get_throughput(const upload_stats_t *stats) {
+	if (stats->duration_us <= 0) {
+		return 0;
+	}
+	return (uint64_t)stats->bytes * 1000000ULL / 1024 / stats->duration_us;
+}
+
+int upload_receive_range(httpd_req_t *req, const char *path, size_t offset, upload_stats_t *stats) {
+	struct stat st;
+	int err, fd;
+
+	if (offset % UPLOAD_BUFFER_SIZE) {
+		return -EINVAL;
+	}
+	fd = open(path, O_WRONLY | O_CREAT, 0644);
+	if (fd < 0) {
+		return -errno;
+	}
+	if (fstat(fd, &st)) {
+		err = -errno;
+		goto out;
+	}
+	// Ranges must be contiguous, a gap would be committed as data
+	if (offset > st.st_size) {
+		err = -ERANGE;
+		goto out;
+	}
+	// Retransmitted range replaces whatever has been received after it
+	if (ftruncate(fd, offset) || lseek(fd, offset, SEEK_SET) < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	err = upload_receive_to_fd(req, fd, stats);
+	if (err >= 0) {
+		err = offset + err;
+	}
+
+out:
+	if (close(fd) && err >= 0) {
+		err = -errno;
+	}
+	return err;
+}
+
+int upload_get_committed_size(const char *path) {
+	struct stat st;
+
+	if (stat(path, &st)) {
+		return -errno;
+	}
+	return st.st_size;
+}
+
+int upload_get_resume_offset(const char *path) {
+	int size = upload_get_committed_size(path);
+
+	if (size < 0) {
+		return size;
+	}
+	// Tail of a failed range is received again
+	return size - size % UPLOAD_BUFFER_SIZE;
+}
+
+int upload_get_crc32(const char *path, uint32_t *crc) {
+	ssize_t len;
+	uint8_t *buf;
+	int err = 0;
+	int fd;
+
+	buf = malloc(UPLOAD_BUFFER_SIZE);
+	if (!buf) {
+		return -ENOMEM;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err = -errno;
+		goto out_buf;
+	}
+
+	*crc = 0;
+	while ((len = read(fd, buf, UPLOAD_BUFFER_SIZE)) > 0) {
+		*crc = esp_rom_crc32_le(*crc, buf, len);
+	}
+	if (len < 0) {
+		err = -errno;
+	}
+
+	close(fd);
+out_buf:
+	free(buf);
+	return err;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_http_server.h>
+
+/*
+ * Streaming of request bodies to flash
+ *
+ * The body is received into one buffer while a writer task flushes the
+ * other one, so network and flash transfers overlap. Buffers are a multiple
+ * of the FAT sector size and written at sector aligned offsets, which lets
+ * FAT write them without going through its sector cache.
+ */
+
+#define UPLOAD_BUFFER_SIZE	8192
+#define UPLOAD_NUM_BUFFERS	2
+
+// Partial uploads received in ranges, removed on boot
+#define UPLOAD_STAGING_DIR	"/flash/uploads"
+
+typedef struct upload_stats {
+	size_t bytes;
+	int64_t duration_us;
+	// Time spent receiving from socket and writing to flash, overlapping
+	int64_t recv_us;
+	int64_t write_us;
+} upload_stats_t;
+
+// Init only
+void upload_init(void);
+
+/* Threadsafe */
+// Returns number of bytes written to fd or negative error code, -ECONNABORTED on socket errors
+int upload_receive_to_fd(httpd_req_t *req, int fd, upload_stats_t *stats);
+// Receives whole body into data, which must hold content_len bytes
+int upload_receive_to_memory(httpd_req_t *req, uint8_t *data, upload_stats_t *stats);
+// Throughput in KiB/s
+unsigned int upload_stats_get_throughput(const upload_stats_t *stats);
+// Write body to path at offset, data past offset is discarded. Offset must be a multiple of
+// UPLOAD_BUFFER_SIZE. Returns size of file afterwards, -ERANGE if offset is past end of file,
+// -EINVAL if it is not aligned or another negative error code
+int upload_receive_range(httpd_req_t *req, const char *path, size_t offset, upload_stats_t *stats);
+// Returns size of data received so far or negative error code
+int upload_get_committed_size(const char *path);
+// Returns aligned offset to continue an interrupted upload at or negative error code
+int upload_get_resume_offset(const char *path);
+int upload_get_crc32(const char *path, uint32_t *crc);
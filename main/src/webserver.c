@@ -12,7 +12,7 @@
 static const char *TAG = "webserver";
 
 #define ADD_EMBEDDED_STATIC_FILE(path_, mime_, name_) \
-	ESP_ERROR_CHECK(httpd_add_embedded_static_file(httpd, path_, mime_, EMBEDDED_FILE_PTRS(name_)))
+	ESP_ERROR_CHECK(httpd_add_embedded_static_file(httpd, path_, mime_, EMBEDDED_FILE_PTRS(name_), EMBEDDED_FILE_ETAG(name_)))
 
 #define ADD_EMBEDDED_STATIC_FILE_JS(path_, name_) \
 	ADD_EMBEDDED_STATIC_FILE("/js/"path_, MIME_TYPE_TEXT_JAVASCRIPT, name_)
@@ -24,7 +24,8 @@ static const char *TAG = "webserver";
 	ADD_EMBEDDED_STATIC_FILE("/"path_, MIME_TYPE_TEXT_HTML, name_)
 
 #define ADD_EMBEDDED_TEMPLATE_FILE(path_, name_) \
-	ESP_ERROR_CHECK(httpd_add_embedded_template_file(httpd, "/"path_, MIME_TYPE_TEXT_HTML, EMBEDDED_FILE_PTRS(name_)))
+	ESP_ERROR_CHECK(httpd_add_embedded_template_file(httpd, "/"path_, MIME_TYPE_TEXT_HTML, EMBEDDED_FILE_PTRS(name_), \
+							 EMBEDDED_FILE_ETAG(name_)))
 
 static httpd_t httpd_;
 
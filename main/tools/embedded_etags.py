@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""
+Generate ETags of embedded web files
+
+Generates a C file with one ETag string per file, named after the symbol
+the build system uses for the embedded file. Static files get a strong
+ETag of their content. Templates get a weak ETag derived from their inputs:
+the template itself, all files it includes and the firmware version, which
+covers the code rendering them.
+"""
+
+import argparse
+import hashlib
+import os
+import re
+
+HASH_LEN = 16
+TEMPLATE_EXT = '.thtml'
+INCLUDE_RE = re.compile(rb'\{\{include,file=([^,}]+)')
+
+
+def symbol_name(path):
+    return re.sub(r'[^A-Za-z0-9_]', '_', os.path.basename(path))
+
+
+def template_hash(path, webroot, salt, seen=()):
+    if path in seen:
+        raise ValueError('Include loop at %s' % path)
+    with open(path, 'rb') as f:
+        data = f.read()
+    digest = hashlib.sha256(salt)
+    digest.update(data)
+    for include in INCLUDE_RE.findall(data):
+        include_path = os.path.join(webroot, include.decode().lstrip('/'))
+        digest.update(template_hash(include_path, webroot, salt, seen + (path,)))
+    return digest.digest()
+
+
+def etag(path, webroot, salt):
+    if path.endswith(TEMPLATE_EXT):
+        return 'W/"%s"' % template_hash(path, webroot, salt).hex()[:HASH_LEN]
+    with open(path, 'rb') as f:
+        return '"%s"' % hashlib.sha256(f.read()).hexdigest()[:HASH_LEN]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--webroot', required=True, help='Directory include paths of templates are relative to')
+    parser.add_argument('--salt', default='', help='Firmware version, changes ETags of all templates')
+    parser.add_argument('--output', required=True)
+    parser.add_argument('files', nargs='+')
+    args = parser.parse_args()
+
+    salt = args.salt.strip().encode()
+    out = ['// Generated by embedded_etags.py, do not edit',
+           '',
+           '#include "embedded_files.h"',
+           '']
+    for path in sorted(args.files, key=symbol_name):
+        out.append('const char embedded_file_etag_%s[] = "%s";' %
+                   (symbol_name(path), etag(path, args.webroot, salt).replace('"', '\\"')))
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+Pre-rasterize fixed sizes of a font into 4 bit glyph tables
+
+Generates a C file with one table per size in the packed 4 bit format used
+by the display. Rasterization parameters must match fonts.c.
+"""
+
+import argparse
+
+import freetype
+
+DOTSIZE = 64
+GLYPH_MISSING = 0xffffffff
+
+
+def parse_ranges(ranges):
+    codepoints = set()
+    for part in ranges.split(','):
+        first, _, last = part.partition('-')
+        codepoints.update(range(int(first, 0), int(last or first, 0) + 1))
+    return codepoints
+
+
+def pack_4bpp(bitmap):
+    packed = bytearray()
+    for y in range(bitmap.rows):
+        row = bitmap.buffer[y * bitmap.pitch:y * bitmap.pitch + bitmap.width]
+        row = list(row) + [0] * (len(row) % 2)
+        for x in range(0, len(row), 2):
+            packed.append((row[x] & 0xf0) | (row[x + 1] >> 4))
+    return packed
+
+
+def format_bytes(data, indent='\t'):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(indent + ', '.join('0x%02x' % b for b in data[i:i + 16]) + ',')
+    return '\n'.join(lines)
+
+
+def rasterize_size(face, dpi, size_px, codepoints):
+    face.set_char_size(0, size_px * DOTSIZE, dpi, dpi)
+    glyphs = []
+    bitmaps = bytearray()
+    for codepoint in range(min(codepoints), max(codepoints) + 1):
+        if codepoint not in codepoints or not face.get_char_index(codepoint):
+            glyphs.append((0, 0, 0, 0, 0, GLYPH_MISSING))
+            continue
+        face.load_char(codepoint, freetype.FT_LOAD_RENDER)
+        slot = face.glyph
+        glyphs.append((slot.advance.x, slot.bitmap_left, slot.bitmap_top,
+                       slot.bitmap.width, slot.bitmap.rows, len(bitmaps)))
+        bitmaps += pack_4bpp(slot.bitmap)
+    return glyphs, bitmaps
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--name', required=True, help='Name of generated table array')
+    parser.add_argument('--dpi', type=int, required=True)
+    parser.add_argument('--sizes', required=True, help='Comma separated char heights in pixels')
+    parser.add_argument('--ranges', default='0x20-0x7e,0xa0-0xff', help='Comma separated codepoint ranges')
+    parser.add_argument('font')
+    parser.add_argument('output')
+    args = parser.parse_args()
+
+    face = freetype.Face(args.font)
+    codepoints = parse_ranges(args.ranges)
+    sizes = [int(size) for size in args.sizes.split(',')]
+
+    out = ['// Generated by font_tables.py from %s, do not edit' % args.font.split('/')[-1],
+           '',
+           '#include "font_tables.h"',
+           '']
+    for size in sizes:
+        glyphs, bitmaps = rasterize_size(face, args.dpi, size, codepoints)
+        prefix = '%s_%d' % (args.name, size)
+        out.append('static const uint8_t %s_bitmaps[] = {' % prefix)
+        out.append(format_bytes(bitmaps))
+        out.append('};')
+        out.append('')
+        out.append('static const font_table_glyph_t %s_glyphs[] = {' % prefix)
+        for glyph in glyphs:
+            out.append('\t{ %d, %d, %d, %u, %u, 0x%x },' % glyph)
+        out.append('};')
+        out.append('')
+
+    out.append('const font_table_t font_tables_%s[] = {' % args.name)
+    for size in sizes:
+        prefix = '%s_%d' % (args.name, size)
+        out.append('\t{')
+        out.append('\t\t.char_height_px = %d,' % size)
+        out.append('\t\t.first_codepoint = 0x%x,' % min(codepoints))
+        out.append('\t\t.num_glyphs = ARRAY_SIZE(%s_glyphs),' % prefix)
+        out.append('\t\t.glyphs = %s_glyphs,' % prefix)
+        out.append('\t\t.bitmaps = %s_bitmaps,' % prefix)
+        out.append('\t},')
+    out.append('};')
+    out.append('')
+    out.append('const unsigned int font_tables_%s_num = ARRAY_SIZE(font_tables_%s);' % (args.name, args.name))
+
+    with open(args.output, 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gifdecode.h"
+#include "host_test.h"
+#include "pixel_ops.h"
+#include "util.h"
+
+/*
+ * Lines per second of the GIF draw callback, against the per pixel palette
+ * averaging it replaced. Frames of 64 lines are drawn, so the lookup table is
+ * built once per frame. Both have to draw the same pixels for a gray palette,
+ * where average and luma agree.
+ */
+
+#define WIDTH		256
+#define HEIGHT		64
+#define STRIDE		(WIDTH / 2)
+#define BENCH_FRAMES	500
+
+typedef struct line_case {
+	const char *name;
+	uint8_t has_transparency;
+	uint8_t disposal_method;
+} line_case_t;
+
+static const line_case_t line_cases[] = {
+	{ .name = "opaque", .has_transparency = 0, .disposal_method = 1 },
+	{ .name = "transparent, disposal 2", .has_transparency = 1, .disposal_method = 2 },
+	{ .name = "transparent, keep", .has_transparency = 1, .disposal_method = 1 },
+};
+
+static uint8_t indices[HEIGHT][WIDTH];
+static uint8_t gray_palette[256 * 3];
+static uint8_t color_palette[256 * 3];
+static uint8_t pixels[STRIDE * HEIGHT];
+static uint8_t pixels_ref[STRIDE * HEIGHT];
+
+// Draw callback before the lookup table, as it was in gifdecode.c
+static inline void gifdecode_draw_pixel(GIFDRAW *draw, uint8_t *row, unsigned char palette_idx, int x) {
+	uint8_t *palette = draw->pPalette24 + 3 * palette_idx;
+	unsigned int r, g, b;
+
+	r = palette[0];
+	g = palette[1];
+	b = palette[2];
+	pixel_set_4bpp(row, x, PIXEL_TO_4BPP((r + g + b) / 3));
+}
+
+static void gifdecode_draw_line_per_pixel(GIFDRAW *draw) {
+	gifdecode_canvas_t *canvas = draw->pUser;
+	int y = draw->iY + draw->y;
+
+	if (y < canvas->height) {
+		uint8_t *row = &canvas->pixels[y * canvas->stride];
+		int x;
+		int draw_width = MIN(draw->iX + draw->iWidth, canvas->width);
+
+		for (x = draw->iX; x < draw_width; x++) {
+			if (draw->pPixels[x - draw->iX] == draw->ucTransparent && draw->ucDisposalMethod == 2) {
+				gifdecode_draw_pixel(draw, row, draw->ucBackground, x);
+			} else if (!draw->ucHasTransparency || draw->pPixels[x - draw->iX] != draw->ucTransparent) {
+				gifdecode_draw_pixel(draw, row, draw->pPixels[x - draw->iX], x);
+			}
+		}
+	}
+}
+
+static void draw_frame(void (*draw_line)(GIFDRAW *draw), gifdecode_canvas_t *canvas, const line_case_t *line_case,
+		       uint8_t *palette24) {
+	GIFDRAW draw = {
+		.iX = 0,
+		.iY = 0,
+		.iWidth = WIDTH,
+		.iHeight = HEIGHT,
+		.pUser = canvas,
+		.pPalette24 = palette24,
+		.ucTransparent = 0,
+		.ucHasTransparency = line_case->has_transparency,
+		.ucDisposalMethod = line_case->disposal_method,
+		.ucBackground = 255,
+	};
+	unsigned int y;
+
+	for (y = 0; y < HEIGHT; y++) {
+		draw.y = y;
+		draw.pPixels = indices[y];
+		draw_line(&draw);
+	}
+}
+
+static int64_t bench(void (*draw_line)(GIFDRAW *draw), const line_case_t *line_case, unsigned int frames) {
+	gifdecode_canvas_t canvas;
+	int64_t start_us;
+	unsigned int i;
+
+	gifdecode_canvas_init(&canvas, pixels, STRIDE, WIDTH, HEIGHT);
+	start_us = host_test_time_us();
+	for (i = 0; i < frames; i++) {
+		draw_frame(draw_line, &canvas, line_case, color_palette);
+	}
+	return host_test_time_us() - start_us;
+}
+
+static void check(const line_case_t *line_case) {
+	gifdecode_canvas_t canvas, canvas_ref;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(pixels); i++) {
+		pixels[i] = pixels_ref[i] = rand();
+	}
+	gifdecode_canvas_init(&canvas, pixels, STRIDE, WIDTH, HEIGHT);
+	gifdecode_canvas_init(&canvas_ref, pixels_ref, STRIDE, WIDTH, HEIGHT);
+	draw_frame(gifdecode_draw_line, &canvas, line_case, gray_palette);
+	draw_frame(gifdecode_draw_line_per_pixel, &canvas_ref, line_case, gray_palette);
+	CHECK(!memcmp(pixels, pixels_ref, sizeof(pixels)));
+}
+
+int main(int argc, char **argv) {
+	unsigned int frames = host_test_iterations(argc, argv, BENCH_FRAMES);
+	unsigned int i, x, y;
+
+	srand(1);
+	for (i = 0; i < 256; i++) {
+		gray_palette[3 * i] = gray_palette[3 * i + 1] = gray_palette[3 * i + 2] = i;
+	}
+	for (i = 0; i < sizeof(color_palette); i++) {
+		color_palette[i] = rand();
+	}
+	// Mostly short runs of one color, about one in eight pixels transparent
+	for (y = 0; y < HEIGHT; y++) {
+		for (x = 0; x < WIDTH; x++) {
+			indices[y][x] = rand() % 8 ? 1 + (x / 4 + y) % 255 : 0;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(line_cases); i++) {
+		const line_case_t *line_case = &line_cases[i];
+		char name[64];
+
+		check(line_case);
+		snprintf(name, sizeof(name), "%s, per pixel", line_case->name);
+		host_test_report(name, bench(gifdecode_draw_line_per_pixel, line_case, frames), frames, "lines", HEIGHT);
+		snprintf(name, sizeof(name), "%s, lookup table", line_case->name);
+		host_test_report(name, bench(gifdecode_draw_line, line_case, frames), frames, "lines", HEIGHT);
+	}
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "screens.h"
+#include "util.h"
+
+/*
+ * Full versus damaged renders of the menu and the charging screen. Damaged
+ * renders are checked to produce the same frame buffer as full renders.
+ */
+
+#define CHECK_FRAMES	64
+#define BENCH_FRAMES	500
+
+static bool fb_is_blank(const uint8_t *fb) {
+	unsigned int i;
+
+	for (i = 0; i < SCREEN_STRIDE * SCREEN_HEIGHT; i++) {
+		if (fb[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void check_screen(screen_t *screen) {
+	static uint8_t damaged_fb[SCREEN_STRIDE * SCREEN_HEIGHT];
+	static uint8_t full_fb[SCREEN_STRIDE * SCREEN_HEIGHT];
+	unsigned int frame;
+
+	screen_render(screen, damaged_fb, true);
+	CHECK(!fb_is_blank(damaged_fb));
+	for (frame = 0; frame < CHECK_FRAMES; frame++) {
+		screen->update(frame);
+		screen_render(screen, damaged_fb, false);
+		screen_render(screen, full_fb, true);
+		CHECK(!memcmp(damaged_fb, full_fb, sizeof(full_fb)));
+	}
+}
+
+static int64_t bench_screen(screen_t *screen, bool full, unsigned int frames) {
+	static uint8_t fb[SCREEN_STRIDE * SCREEN_HEIGHT];
+	int64_t start_us;
+	unsigned int frame;
+
+	screen_render(screen, fb, true);
+	start_us = host_test_time_us();
+	for (frame = 0; frame < frames; frame++) {
+		screen->update(frame);
+		screen_render(screen, fb, full);
+	}
+	return host_test_time_us() - start_us;
+}
+
+int main(int argc, char **argv) {
+	unsigned int frames = host_test_iterations(argc, argv, BENCH_FRAMES);
+	unsigned int i;
+
+	screens_init();
+	for (i = 0; i < num_screens; i++) {
+		screen_t *screen = &screens[i];
+		int64_t full_us, damaged_us;
+		char name[64];
+
+		check_screen(screen);
+
+		full_us = bench_screen(screen, true, frames);
+		damaged_us = bench_screen(screen, false, frames);
+		snprintf(name, sizeof(name), "%s full render", screen->name);
+		host_test_report(name, full_us, frames, "frames", 1);
+		snprintf(name, sizeof(name), "%s damaged render", screen->name);
+		host_test_report(name, damaged_us, frames, "frames", 1);
+		printf("%s speedup %.1fx\n", screen->name, damaged_us ? (double)full_us / damaged_us : 0);
+	}
+
+	return 0;
+}
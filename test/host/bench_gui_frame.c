@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "screens.h"
+
+/*
+ * Frame time of full renders into display format, against the 8 bit
+ * pipeline it replaced. The 8 bit element renderers no longer exist, so the
+ * baseline renders in display format as well and adds the two passes the old
+ * pipeline ran on top of rendering: clearing the 8 bit frame buffer and
+ * packing it into display format.
+ */
+
+#define BENCH_FRAMES	500
+
+static uint8_t fb[SCREEN_STRIDE * SCREEN_HEIGHT];
+static uint8_t fb_8bpp[SCREEN_WIDTH * SCREEN_HEIGHT];
+static uint8_t oled_fb[SCREEN_STRIDE * SCREEN_HEIGHT];
+
+// Conversion pass of the 8 bit pipeline, as it was in main.c
+static void fb_convert_grayscale(uint8_t *stuffed_4bit, const uint8_t *grayscale) {
+	for (int y = 0; y < 64; y++) {
+		for (int x = 0; x < 256 / 2; x++) {
+			unsigned int int1 = grayscale[y * 256 + x * 2 + 1];
+			unsigned int int2 = grayscale[y * 256 + x * 2 + 0];
+			stuffed_4bit[y * 128 + x] = (int1 >> 4) | (int2 & 0xf0);
+		}
+	}
+}
+
+static int64_t bench_screen(screen_t *screen, bool baseline, unsigned int frames) {
+	int64_t start_us = host_test_time_us();
+	unsigned int frame;
+
+	for (frame = 0; frame < frames; frame++) {
+		screen->update(frame);
+		if (baseline) {
+			memset(fb_8bpp, 0, sizeof(fb_8bpp));
+		}
+		screen_render(screen, fb, true);
+		if (baseline) {
+			fb_convert_grayscale(oled_fb, fb_8bpp);
+		}
+	}
+	return host_test_time_us() - start_us;
+}
+
+int main(int argc, char **argv) {
+	unsigned int frames = host_test_iterations(argc, argv, BENCH_FRAMES);
+	unsigned int i;
+
+	screens_init();
+	printf("Frame buffers: %u bytes direct, %u bytes with 8 bit pipeline\n",
+	       (unsigned int)sizeof(fb), (unsigned int)(sizeof(fb) + sizeof(fb_8bpp)));
+	for (i = 0; i < num_screens; i++) {
+		screen_t *screen = &screens[i];
+		int64_t baseline_us, direct_us;
+		char name[64];
+
+		baseline_us = bench_screen(screen, true, frames);
+		direct_us = bench_screen(screen, false, frames);
+		snprintf(name, sizeof(name), "%s 8 bit pipeline", screen->name);
+		host_test_report(name, baseline_us, frames, "frames", 1);
+		snprintf(name, sizeof(name), "%s direct", screen->name);
+		host_test_report(name, direct_us, frames, "frames", 1);
+	}
+
+	return 0;
+}
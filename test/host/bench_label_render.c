@@ -0,0 +1,119 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fonts.h"
+#include "gui.h"
+#include "gui_priv.h"
+#include "host_test.h"
+#include "screens.h"
+#include "util.h"
+
+/*
+ * Label render throughput with and without the glyph cache. A budget of zero
+ * keeps only the last glyph, which is about what rasterizing every character
+ * on every render costs. Both have to produce the same frame buffer.
+ */
+
+#define BENCH_RENDERS	200
+
+typedef struct label_case {
+	const char *name;
+	const char *text;
+	unsigned int font_size;
+	unsigned int width;
+	unsigned int height;
+} label_case_t;
+
+static const label_case_t label_cases[] = {
+	{
+		.name = "marquee",
+		.text = "All the cookies are belong to us. Accept all the cookies, "
+			"there is no way to decline any of them.",
+		.font_size = 13,
+		.width = SCREEN_WIDTH,
+		.height = 16,
+	},
+	{ .name = "battery percentage", .text = "100%", .font_size = 8, .width = 28, .height = 9 },
+};
+
+static const gui_ops_t gui_ops = { 0 };
+
+static gui_t gui;
+static gui_label_t label;
+static uint8_t fb[SCREEN_STRIDE * SCREEN_HEIGHT];
+
+static void render_label(void) {
+	gui_point_t size = { SCREEN_WIDTH, SCREEN_HEIGHT };
+	gui_area_t area = { .position = { 0, 0 }, .size = label.element.area.size };
+	gui_area_t damaged_area;
+
+	gui_element_damage(&label.element, &area);
+	gui_render(&gui, fb, SCREEN_STRIDE, &size, &damaged_area);
+}
+
+static int64_t bench_label(size_t budget, unsigned int renders, font_glyph_cache_stats_t *stats) {
+	font_glyph_cache_stats_t start_stats;
+	int64_t start_us, duration_us;
+	unsigned int i;
+
+	fonts_set_glyph_cache_budget(budget);
+	fonts_get_glyph_cache_stats(&start_stats);
+	start_us = host_test_time_us();
+	for (i = 0; i < renders; i++) {
+		render_label();
+	}
+	duration_us = host_test_time_us() - start_us;
+	fonts_get_glyph_cache_stats(stats);
+	stats->hits -= start_stats.hits;
+	stats->misses -= start_stats.misses;
+	stats->evictions -= start_stats.evictions;
+	return duration_us;
+}
+
+static void report(const char *label_name, const char *cache_name, int64_t duration_us, unsigned int renders,
+		   const font_glyph_cache_stats_t *stats, const char *text) {
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s, %s", label_name, cache_name);
+	host_test_report(name, duration_us, renders, "chars", strlen(text));
+	printf("  %u hits, %u misses, %u evictions, %u glyphs in %u bytes\n",
+	       stats->hits, stats->misses, stats->evictions, stats->num_glyphs, (unsigned int)stats->size);
+}
+
+int main(int argc, char **argv) {
+	unsigned int renders = host_test_iterations(argc, argv, BENCH_RENDERS);
+	static uint8_t uncached_fb[sizeof(fb)];
+	font_glyph_cache_stats_t stats;
+	size_t default_budget;
+	unsigned int i;
+
+	fonts_init();
+	fonts_get_glyph_cache_stats(&stats);
+	default_budget = stats.budget;
+
+	gui_init(&gui, NULL, &gui_ops);
+	gui_label_init(&label, NULL);
+	gui_element_add_child(&gui.container.element, &label.element);
+	gui_element_show(&label.element);
+
+	for (i = 0; i < ARRAY_SIZE(label_cases); i++) {
+		const label_case_t *label_case = &label_cases[i];
+		int64_t uncached_us, cached_us;
+
+		gui_label_set_text(&label, label_case->text);
+		gui_label_set_font_size(&label, label_case->font_size);
+		gui_element_set_size(&label.element, label_case->width, label_case->height);
+
+		uncached_us = bench_label(0, renders, &stats);
+		report(label_case->name, "cache budget 0", uncached_us, renders, &stats, label_case->text);
+		memcpy(uncached_fb, fb, sizeof(fb));
+		CHECK(stats.misses);
+
+		cached_us = bench_label(default_budget, renders, &stats);
+		report(label_case->name, "default cache budget", cached_us, renders, &stats, label_case->text);
+		CHECK(!memcmp(uncached_fb, fb, sizeof(fb)));
+	}
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gifdecode.h"
+#include "host_test.h"
+#include "oan.h"
+#include "pixel_ops.h"
+#include "screens.h"
+
+/*
+ * Playback speed of native animations from memory and from file, against
+ * drawing the same frames through the GIF draw callback. AnimatedGIF is not
+ * built for the host, so the GIF numbers exclude LZW decoding and are a lower
+ * bound of GIF playback cost. GIF lines are drawn for the rows that changed,
+ * as in a GIF with frame sized to the damage.
+ */
+
+#define NUM_FRAMES	100
+#define BENCH_LOOPS	5
+#define BOX_WIDTH	48
+#define BOX_HEIGHT	24
+#define BAND_Y		48
+#define BAND_HEIGHT	12
+
+static uint8_t frames_8bpp[NUM_FRAMES][SCREEN_WIDTH * SCREEN_HEIGHT];
+static uint8_t frames[NUM_FRAMES][SCREEN_STRIDE * SCREEN_HEIGHT];
+static uint8_t canvas[SCREEN_STRIDE * SCREEN_HEIGHT];
+static uint8_t palette24[256 * 3];
+
+// Static gradient, a bouncing box and a horizontally scrolling band
+static void render_frame(uint8_t *frame, unsigned int n) {
+	unsigned int box_x = n * 5 % (SCREEN_WIDTH - BOX_WIDTH);
+	unsigned int box_y = n * 3 % (BAND_Y - BOX_HEIGHT);
+	unsigned int x, y;
+
+	for (y = 0; y < SCREEN_HEIGHT; y++) {
+		for (x = 0; x < SCREEN_WIDTH; x++) {
+			uint8_t value = x / 4;
+
+			if (x >= box_x && x < box_x + BOX_WIDTH && y >= box_y && y < box_y + BOX_HEIGHT) {
+				value = (x - box_x) % 8 < 4 ? 0xff : 0x80;
+			} else if (y >= BAND_Y && y < BAND_Y + BAND_HEIGHT) {
+				value = ((x + n * 2) * 7 + y * 13) % 5 ? 0x00 : 0xf0;
+			}
+			frame[y * SCREEN_WIDTH + x] = value;
+		}
+	}
+}
+
+static size_t encode(const char *path) {
+	FILE *file = fopen(path, "w+");
+	oan_encoder_t enc;
+	unsigned int i;
+	long size;
+
+	CHECK(file);
+	CHECK(!oan_encoder_init(&enc, file, SCREEN_WIDTH, SCREEN_HEIGHT));
+	for (i = 0; i < NUM_FRAMES; i++) {
+		CHECK(!oan_encoder_add_frame(&enc, frames[i], 40));
+	}
+	CHECK(!oan_encoder_finish(&enc));
+	oan_encoder_free(&enc);
+	CHECK(!fseek(file, 0, SEEK_END));
+	size = ftell(file);
+	CHECK(!fclose(file));
+	return size;
+}
+
+static int64_t bench_oan(oan_t *oan, unsigned int loops) {
+	int64_t start_us = host_test_time_us();
+	unsigned int i;
+	int duration_ms;
+
+	for (i = 0; i < loops * NUM_FRAMES; i++) {
+		CHECK(oan_play_frame(oan, canvas, &duration_ms) >= 0);
+	}
+	CHECK(!memcmp(canvas, frames[NUM_FRAMES - 1], sizeof(canvas)));
+	return host_test_time_us() - start_us;
+}
+
+// Rows that differ from the previous frame, all rows for the first one
+static void changed_rows(unsigned int n, unsigned int *first_row, unsigned int *end_row) {
+	*first_row = 0;
+	*end_row = SCREEN_HEIGHT;
+	if (!n) {
+		return;
+	}
+	while (*first_row < *end_row &&
+	       !memcmp(&frames_8bpp[n][*first_row * SCREEN_WIDTH], &frames_8bpp[n - 1][*first_row * SCREEN_WIDTH], SCREEN_WIDTH)) {
+		(*first_row)++;
+	}
+	while (*end_row > *first_row &&
+	       !memcmp(&frames_8bpp[n][(*end_row - 1) * SCREEN_WIDTH], &frames_8bpp[n - 1][(*end_row - 1) * SCREEN_WIDTH], SCREEN_WIDTH)) {
+		(*end_row)--;
+	}
+}
+
+static int64_t bench_gif_draw(unsigned int loops) {
+	gifdecode_canvas_t gif_canvas;
+	GIFDRAW draw = {
+		.iX = 0,
+		.iWidth = SCREEN_WIDTH,
+		.iHeight = SCREEN_HEIGHT,
+		.pUser = &gif_canvas,
+		.pPalette24 = palette24,
+	};
+	int64_t start_us;
+	unsigned int i;
+
+	gifdecode_canvas_init(&gif_canvas, canvas, SCREEN_STRIDE, SCREEN_WIDTH, SCREEN_HEIGHT);
+	start_us = host_test_time_us();
+	for (i = 0; i < loops * NUM_FRAMES; i++) {
+		unsigned int n = i % NUM_FRAMES;
+		unsigned int first_row, end_row, y;
+
+		changed_rows(n, &first_row, &end_row);
+		draw.iY = first_row;
+		for (y = 0; y < end_row - first_row; y++) {
+			draw.y = y;
+			draw.pPixels = &frames_8bpp[n][(first_row + y) * SCREEN_WIDTH];
+			gifdecode_draw_line(&draw);
+		}
+	}
+	CHECK(!memcmp(canvas, frames[NUM_FRAMES - 1], sizeof(canvas)));
+	return host_test_time_us() - start_us;
+}
+
+int main(int argc, char **argv) {
+	unsigned int loops = host_test_iterations(argc, argv, BENCH_LOOPS);
+	char path[] = "/tmp/bench_oan_XXXXXX";
+	size_t size;
+	uint8_t *data;
+	FILE *file;
+	oan_t oan;
+	unsigned int i;
+	int fd;
+
+	// Gray levels that survive the luma lookup table unchanged
+	for (i = 0; i < 256; i++) {
+		palette24[3 * i] = palette24[3 * i + 1] = palette24[3 * i + 2] = i;
+	}
+	for (i = 0; i < NUM_FRAMES; i++) {
+		render_frame(frames_8bpp[i], i);
+		pixel_pack_8bpp_2d(frames[i], SCREEN_STRIDE, 0, frames_8bpp[i], SCREEN_WIDTH, SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+	size = encode(path);
+	printf("%u frames: %u bytes, %u bytes as raw frames\n", NUM_FRAMES, (unsigned int)size,
+	       (unsigned int)sizeof(frames));
+
+	file = fopen(path, "r");
+	CHECK(file);
+	data = malloc(size);
+	CHECK(data);
+	CHECK(fread(data, 1, size, file) == size);
+	fclose(file);
+
+	CHECK(!oan_open_memory(&oan, data, size));
+	host_test_report("oan from memory", bench_oan(&oan, loops), loops * NUM_FRAMES, "frames", 1);
+	oan_close(&oan);
+
+	CHECK(!oan_open(&oan, path));
+	host_test_report("oan from file", bench_oan(&oan, loops), loops * NUM_FRAMES, "frames", 1);
+	oan_close(&oan);
+
+	host_test_report("gif draw callback, without LZW", bench_gif_draw(loops), loops * NUM_FRAMES, "frames", 1);
+
+	free(data);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Helpers for host tests and benchmarks
+ *
+ * Benchmarks run a short pass by default so they stay quick under ctest.
+ * Pass a multiplier as first argument for stable numbers.
+ */
+
+#define CHECK(cond_) do {									\
+	if (!(cond_)) {										\
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond_);	\
+		exit(EXIT_FAILURE);								\
+	}											\
+} while (0)
+
+static inline int64_t host_test_time_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static inline unsigned int host_test_iterations(int argc, char **argv, unsigned int iterations) {
+	if (argc > 1) {
+		iterations *= strtoul(argv[1], NULL, 0);
+	}
+	return iterations ? iterations : 1;
+}
+
+// Print time per iteration and rate
+static inline void host_test_report(const char *name, int64_t duration_us, unsigned int iterations, const char *unit,
+				    double units_per_iteration) {
+	double seconds = duration_us / 1e6;
+
+	printf("%-40s %10.3f us/iteration %14.0f %s/s\n", name, (double)duration_us / iterations,
+	       seconds > 0 ? units_per_iteration * iterations / seconds : 0, unit);
+}
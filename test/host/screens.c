@@ -0,0 +1,144 @@
+#include "screens.h"
+
+#include <stdio.h>
+
+#include "embedded_files.h"
+#include "fonts.h"
+#include "gui_priv.h"
+#include "util.h"
+
+#define MENU_SELECT_INTERVAL	16
+
+typedef struct battery_status {
+	gui_container_t container;
+	gui_image_t icon;
+	gui_rectangle_t soc_rect;
+	gui_label_t soc_label;
+	char soc_text[10];
+} battery_status_t;
+
+static const char *menu_entries[] = {
+	"Applications",
+	"Settings",
+	"Power off",
+	"GIF player",
+	"Ambient light",
+	"BMS status",
+};
+
+static struct {
+	gui_container_t root;
+	gui_list_t list;
+	gui_label_t labels[ARRAY_SIZE(menu_entries)];
+	battery_status_t battery;
+} menu;
+
+static battery_status_t charging;
+
+// Battery icon with fill level and percentage, as on the charging screen
+static void battery_status_init(battery_status_t *status, gui_element_t *parent, unsigned int x, unsigned int y) {
+	gui_container_init(&status->container);
+	gui_element_set_position(&status->container.element, x, y);
+	gui_element_set_size(&status->container.element, 75, 10);
+	gui_element_add_child(parent, &status->container.element);
+
+	gui_image_init(&status->icon, 21, 10, EMBEDDED_FILE_PTR(battery_21x10_raw));
+	gui_element_set_position(&status->icon.element, 31, 0);
+	gui_element_add_child(&status->container.element, &status->icon.element);
+
+	gui_rectangle_init(&status->soc_rect);
+	gui_rectangle_set_filled(&status->soc_rect, true);
+	gui_rectangle_set_color(&status->soc_rect, 255);
+	gui_element_set_position(&status->soc_rect.element, 33, 2);
+	gui_element_set_size(&status->soc_rect.element, 11, 6);
+	gui_element_add_child(&status->container.element, &status->soc_rect.element);
+
+	gui_label_init(&status->soc_label, "100%");
+	gui_label_set_font_size(&status->soc_label, 8);
+	gui_label_set_text_offset(&status->soc_label, -1, 1);
+	gui_label_set_text_alignment(&status->soc_label, GUI_TEXT_ALIGN_END);
+	gui_element_set_size(&status->soc_label.element, 28, 9);
+	gui_element_add_child(&status->container.element, &status->soc_label.element);
+}
+
+static void battery_status_update(battery_status_t *status, unsigned int frame) {
+	unsigned int soc = frame % 101;
+
+	snprintf(status->soc_text, sizeof(status->soc_text), "%u%%", soc);
+	gui_label_set_text(&status->soc_label, status->soc_text);
+	gui_element_set_size(&status->soc_rect.element, DIV_ROUND(soc * 15, 100), 6);
+}
+
+static void menu_init(gui_t *gui) {
+	unsigned int i;
+
+	gui_container_init(&menu.root);
+	gui_element_set_size(&menu.root.element, SCREEN_WIDTH, SCREEN_HEIGHT);
+	gui_element_add_child(&gui->container.element, &menu.root.element);
+
+	gui_list_init(&menu.list);
+	gui_element_set_position(&menu.list.container.element, 14, 0);
+	gui_element_set_size(&menu.list.container.element, 144, SCREEN_HEIGHT);
+	gui_element_add_child(&menu.root.element, &menu.list.container.element);
+
+	for (i = 0; i < ARRAY_SIZE(menu_entries); i++) {
+		gui_label_init(&menu.labels[i], menu_entries[i]);
+		gui_label_set_font_size(&menu.labels[i], 15);
+		gui_label_set_text_offset(&menu.labels[i], 5, 3);
+		gui_element_set_size(&menu.labels[i].element, 132, 22);
+		gui_element_set_position(&menu.labels[i].element, 0, 22 * i);
+		gui_element_add_child(&menu.list.container.element, &menu.labels[i].element);
+	}
+	gui_list_set_selected_entry(&menu.list, &menu.labels[0].element);
+
+	battery_status_init(&menu.battery, &menu.root.element, SCREEN_WIDTH - 77, 2);
+	gui_element_show(&menu.root.element);
+}
+
+static void menu_update(unsigned int frame) {
+	battery_status_update(&menu.battery, frame);
+	if (frame % MENU_SELECT_INTERVAL == 0) {
+		unsigned int entry = frame / MENU_SELECT_INTERVAL % ARRAY_SIZE(menu_entries);
+
+		gui_list_set_selected_entry(&menu.list, &menu.labels[entry].element);
+	}
+}
+
+static void charging_init(gui_t *gui) {
+	battery_status_init(&charging, &gui->container.element, 2, SCREEN_HEIGHT - 10 - 2);
+	gui_element_show(&charging.container.element);
+}
+
+static void charging_update(unsigned int frame) {
+	battery_status_update(&charging, frame);
+}
+
+screen_t screens[] = {
+	{ .name = "menu", .init = menu_init, .update = menu_update },
+	{ .name = "charging screen", .init = charging_init, .update = charging_update },
+};
+
+void screen_render(screen_t *screen, uint8_t *fb, bool full) {
+	gui_point_t size = { SCREEN_WIDTH, SCREEN_HEIGHT };
+	gui_area_t area = { .position = { 0, 0 }, .size = size };
+	gui_area_t damaged_area;
+
+	if (full) {
+		gui_element_damage(&screen->gui.container.element, &area);
+	}
+	gui_render(&screen->gui, fb, SCREEN_STRIDE, &size, &damaged_area);
+}
+
+const unsigned int num_screens = ARRAY_SIZE(screens);
+
+static const gui_ops_t gui_ops = { 0 };
+
+void screens_init(void) {
+	unsigned int i;
+
+	fonts_init();
+	for (i = 0; i < num_screens; i++) {
+		gui_init(&screens[i].gui, NULL, &gui_ops);
+		screens[i].init(&screens[i].gui);
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gui.h"
+
+/*
+ * GUI layouts of the menu and the charging screen for benchmarks
+ *
+ * Each frame changes the battery status the way a battery gauge event does,
+ * the menu additionally moves its selection every few frames.
+ */
+
+#define SCREEN_WIDTH	256
+#define SCREEN_HEIGHT	64
+#define SCREEN_STRIDE	GUI_FB_STRIDE(SCREEN_WIDTH)
+
+typedef struct screen {
+	const char *name;
+	gui_t gui;
+	void (*init)(gui_t *gui);
+	void (*update)(unsigned int frame);
+} screen_t;
+
+extern screen_t screens[];
+extern const unsigned int num_screens;
+
+// Loads fonts and sets up a GUI per screen
+void screens_init(void);
+// Render damaged area only or all of the screen, as before damage tracking
+void screen_render(screen_t *screen, uint8_t *fb, bool full);
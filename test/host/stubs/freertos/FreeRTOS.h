@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Tests are single threaded, locks only need to compile
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE		1
+#define pdFALSE		0
+#define portMAX_DELAY	((TickType_t)~0U)
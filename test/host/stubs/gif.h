@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// Draw callback arguments of AnimatedGIF, the library itself is not built for the host
+typedef struct gifdraw {
+	int iX, iY;
+	int y;
+	int iWidth, iHeight;
+	void *pUser;
+	uint8_t *pPixels;
+	uint16_t *pPalette;
+	uint8_t *pPalette24;
+	uint8_t ucTransparent;
+	uint8_t ucHasTransparency;
+	uint8_t ucDisposalMethod;
+	uint8_t ucBackground;
+	uint8_t ucIsGlobalPalette;
+} GIFDRAW;
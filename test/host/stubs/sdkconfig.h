@@ -0,0 +1,4 @@
+#pragma once
+
+// No target selected, portable kernels are used
+#define CONFIG_WL_SECTOR_SIZE	4096
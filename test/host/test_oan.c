@@ -0,0 +1,211 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "oan.h"
+
+/*
+ * Encoder to reader round trip of random animations. Frames mix noise,
+ * small changes, runs of equal bytes and repeated frames, so raw and delta
+ * frames, empty row ranges and extended durations all occur. Every animation
+ * is played back from file and from memory and has to match exactly.
+ */
+
+#define ITERATIONS	200
+#define MAX_WIDTH	256
+#define MAX_HEIGHT	64
+#define MAX_FRAMES	24
+
+typedef struct animation {
+	unsigned int width;
+	unsigned int height;
+	unsigned int num_frames;
+	uint8_t *frames;
+	int durations[MAX_FRAMES];
+} animation_t;
+
+static size_t frame_size(const animation_t *anim) {
+	return OAN_STRIDE(anim->width) * anim->height;
+}
+
+static uint8_t *frame_pixels(const animation_t *anim, unsigned int frame) {
+	return &anim->frames[frame * frame_size(anim)];
+}
+
+static void randomize(uint8_t *buf, size_t len) {
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = rand();
+	}
+}
+
+static void next_frame(const animation_t *anim, uint8_t *frame, const uint8_t *prev) {
+	unsigned int stride = OAN_STRIDE(anim->width);
+	size_t size = frame_size(anim);
+	unsigned int i, changes;
+
+	if (prev) {
+		memcpy(frame, prev, size);
+	}
+	switch (prev ? rand() % 4 : 0) {
+	case 0:
+		// Noise
+		randomize(frame, size);
+		break;
+	case 1:
+		// A few scattered bytes
+		changes = 1 + rand() % 8;
+		for (i = 0; i < changes; i++) {
+			frame[rand() % size] = rand();
+		}
+		break;
+	case 2:
+		// Band of rows filled with one value, compresses to runs
+		i = rand() % anim->height;
+		memset(&frame[i * stride], rand(), (1 + rand() % (anim->height - i)) * stride);
+		break;
+	default:
+		// Unchanged
+		break;
+	}
+}
+
+static void encode(const animation_t *anim, const char *path) {
+	FILE *file = fopen(path, "w+");
+	oan_encoder_t enc;
+	unsigned int i;
+
+	CHECK(file);
+	CHECK(!oan_encoder_init(&enc, file, anim->width, anim->height));
+	for (i = 0; i < anim->num_frames; i++) {
+		CHECK(!oan_encoder_add_frame(&enc, frame_pixels(anim, i), anim->durations[i]));
+	}
+	CHECK(!oan_encoder_finish(&enc));
+	oan_encoder_free(&enc);
+	CHECK(!fclose(file));
+}
+
+static void play(oan_t *oan, const animation_t *anim) {
+	uint8_t *canvas = calloc(1, frame_size(anim));
+	unsigned int i;
+	int duration_ms;
+
+	CHECK(canvas);
+	CHECK(oan->header.width == anim->width);
+	CHECK(oan->header.height == anim->height);
+	CHECK(oan->header.num_frames == anim->num_frames);
+	// Second pass checks that playback restarts with a key frame
+	for (i = 0; i < 2 * anim->num_frames; i++) {
+		unsigned int frame = i % anim->num_frames;
+		int ret = oan_play_frame(oan, canvas, &duration_ms);
+
+		CHECK(ret == (frame == anim->num_frames - 1 ? 0 : 1));
+		CHECK(duration_ms == anim->durations[frame]);
+		CHECK(!memcmp(canvas, frame_pixels(anim, frame), frame_size(anim)));
+	}
+	free(canvas);
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+	FILE *file = fopen(path, "r");
+	uint8_t *data;
+	long len;
+
+	CHECK(file);
+	CHECK(!fseek(file, 0, SEEK_END));
+	len = ftell(file);
+	CHECK(len > 0);
+	rewind(file);
+	data = malloc(len);
+	CHECK(data);
+	CHECK(fread(data, 1, len, file) == (size_t)len);
+	fclose(file);
+	*size = len;
+	return data;
+}
+
+static void test_animation(const char *path) {
+	animation_t anim;
+	oan_t oan;
+	uint8_t *data;
+	size_t size;
+	unsigned int i;
+
+	anim.width = 1 + rand() % MAX_WIDTH;
+	anim.height = 1 + rand() % MAX_HEIGHT;
+	anim.num_frames = 1 + rand() % MAX_FRAMES;
+	anim.frames = malloc(anim.num_frames * frame_size(&anim));
+	CHECK(anim.frames);
+	for (i = 0; i < anim.num_frames; i++) {
+		next_frame(&anim, frame_pixels(&anim, i), i ? frame_pixels(&anim, i - 1) : NULL);
+		anim.durations[i] = rand() % 1000;
+	}
+
+	encode(&anim, path);
+	CHECK(oan_probe(path));
+
+	CHECK(!oan_open(&oan, path));
+	play(&oan, &anim);
+	oan_close(&oan);
+
+	data = read_file(path, &size);
+	CHECK(oan_probe_memory(data, size));
+	CHECK(!oan_open_memory(&oan, data, size));
+	play(&oan, &anim);
+	oan_close(&oan);
+
+	// Index must not be read past the end of truncated data
+	CHECK(oan_open_memory(&oan, data, size - 1) == -EINVAL);
+	free(data);
+	free(anim.frames);
+}
+
+// Repeated frames are folded into the previous one
+static void test_extend_last_frame(const char *path) {
+	uint8_t frame[OAN_STRIDE(8) * 2] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0 };
+	oan_encoder_t enc;
+	oan_t oan;
+	int duration_ms;
+	FILE *file;
+
+	file = fopen(path, "w+");
+	CHECK(file);
+	CHECK(!oan_encoder_init(&enc, file, 8, 2));
+	CHECK(oan_encoder_extend_last_frame(&enc, 10) == -EINVAL);
+	CHECK(!oan_encoder_add_frame(&enc, frame, 100));
+	CHECK(!oan_encoder_extend_last_frame(&enc, 50));
+	CHECK(!oan_encoder_finish(&enc));
+	oan_encoder_free(&enc);
+	CHECK(!fclose(file));
+
+	CHECK(!oan_open(&oan, path));
+	CHECK(oan.header.num_frames == 1);
+	memset(frame, 0, sizeof(frame));
+	CHECK(oan_play_frame(&oan, frame, &duration_ms) == 0);
+	CHECK(duration_ms == 150);
+	CHECK(frame[0] == 0x12 && frame[7] == 0xf0);
+	oan_close(&oan);
+}
+
+int main(void) {
+	char path[] = "/tmp/test_oan_XXXXXX";
+	unsigned int i;
+	int fd;
+
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+
+	srand(1);
+	for (i = 0; i < ITERATIONS; i++) {
+		test_animation(path);
+	}
+	test_extend_last_frame(path);
+
+	unlink(path);
+	return 0;
+}
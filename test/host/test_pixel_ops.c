@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "pixel_ops.h"
+
+/*
+ * Row kernels and blending against per pixel references, at random
+ * positions, widths and buffer alignments. The SIMD kernels are checked on
+ * the device at boot, see CONFIG_PIXEL_OPS_SELFTEST.
+ */
+
+#define RUNS		2000
+#define MAX_WIDTH	300
+#define ROW_SIZE	(MAX_WIDTH + 32)
+
+static uint8_t actual[ROW_SIZE];
+static uint8_t expected[ROW_SIZE];
+static uint8_t src[2 * ROW_SIZE];
+static uint8_t src_b[ROW_SIZE];
+
+static void randomize(uint8_t *buf, size_t len) {
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = rand();
+	}
+}
+
+static void prepare(void) {
+	randomize(actual, sizeof(actual));
+	memcpy(expected, actual, sizeof(actual));
+	randomize(src, sizeof(src));
+	randomize(src_b, sizeof(src_b));
+}
+
+static void test_fill(unsigned int x, unsigned int width) {
+	uint8_t value = rand() & 0x0f;
+	unsigned int i;
+
+	prepare();
+	pixel_fill_4bpp(actual, x, width, value);
+	for (i = 0; i < width; i++) {
+		pixel_set_4bpp(expected, x + i, value);
+	}
+	CHECK(!memcmp(actual, expected, sizeof(actual)));
+}
+
+static void test_invert(unsigned int x, unsigned int width) {
+	unsigned int i;
+
+	prepare();
+	pixel_invert_4bpp(actual, x, width);
+	for (i = 0; i < width; i++) {
+		pixel_set_4bpp(expected, x + i, pixel_get_4bpp(expected, x + i) ^ 0x0f);
+	}
+	CHECK(!memcmp(actual, expected, sizeof(actual)));
+}
+
+static void test_pack(unsigned int x, unsigned int width) {
+	unsigned int i;
+
+	prepare();
+	pixel_pack_8bpp(actual, x, src, width);
+	for (i = 0; i < width; i++) {
+		pixel_set_4bpp(expected, x + i, PIXEL_TO_4BPP(src[i]));
+	}
+	CHECK(!memcmp(actual, expected, sizeof(actual)));
+}
+
+static void test_copy(unsigned int x, unsigned int width) {
+	unsigned int src_x = rand() % 32;
+	unsigned int i;
+
+	prepare();
+	pixel_copy_4bpp(actual, x, src, src_x, width);
+	for (i = 0; i < width; i++) {
+		pixel_set_4bpp(expected, x + i, pixel_get_4bpp(src, src_x + i));
+	}
+	CHECK(!memcmp(actual, expected, sizeof(actual)));
+}
+
+static unsigned int blend_pixel(unsigned int a, unsigned int b, unsigned int alpha) {
+	return (a * (PIXEL_BLEND_MAX - alpha) + b * alpha + PIXEL_BLEND_MAX / 2) / PIXEL_BLEND_MAX;
+}
+
+// Blending works on bytes, x selects the byte offset of all three buffers
+static void test_blend(unsigned int x, unsigned int width) {
+	unsigned int alpha = rand() % (PIXEL_BLEND_MAX + 1);
+	unsigned int a_offset = rand() % 2 ? x : rand() % 8;
+	unsigned int b_offset = rand() % 2 ? x : rand() % 8;
+	size_t len = width / 2;
+	size_t i;
+
+	prepare();
+	pixel_blend_bytes(&actual[x], &src[a_offset], &src_b[b_offset], alpha, len);
+	for (i = 0; i < len; i++) {
+		uint8_t a = src[a_offset + i];
+		uint8_t b = src_b[b_offset + i];
+		unsigned int hi = blend_pixel(a >> 4, b >> 4, alpha);
+		unsigned int lo = blend_pixel(a & 0x0f, b & 0x0f, alpha);
+
+		expected[x + i] = (hi << 4) | lo;
+	}
+	CHECK(!memcmp(actual, expected, sizeof(actual)));
+}
+
+int main(void) {
+	void (*tests[])(unsigned int x, unsigned int width) = {
+		test_fill,
+		test_invert,
+		test_pack,
+		test_copy,
+		test_blend,
+	};
+	unsigned int i, run;
+
+	srand(1);
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		for (run = 0; run < RUNS; run++) {
+			unsigned int x = rand() % 32;
+			unsigned int width = rand() % (MAX_WIDTH - 32);
+
+			tests[i](x, width);
+		}
+	}
+
+	return 0;
+}